@@ -0,0 +1,135 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <cush/host.h>
+#include <cush/spherical_harmonics.h>
+
+// Host backend benchmarks (see include/cush/host.h). The volumes are cubes of the given edge length. Each benchmark
+// reports its voxels/s, coefficients/s and bytes/s (the bytes the function must read and write at least).
+
+namespace
+{
+std::vector<float> random_coefficients(const size_t count)
+{
+  std::mt19937                          generator   (0);
+  std::uniform_real_distribution<float> distribution(-1.0F, 1.0F);
+  std::vector<float>                    coefficients(count);
+  for (auto& coefficient : coefficients)
+    coefficient = distribution(generator);
+  return coefficients;
+}
+// Reports the voxels and coefficients processed per second, and the bytes read and written per second.
+void set_throughput(
+  benchmark::State& state            ,
+  const size_t      voxel_count      ,
+  const size_t      coefficient_count,
+  const size_t      bytes            )
+{
+  state.counters["voxels"      ] = benchmark::Counter(double(voxel_count)                    , benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["coefficients"] = benchmark::Counter(double(voxel_count * coefficient_count), benchmark::Counter::kIsIterationInvariantRate);
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(bytes));
+}
+}
+
+// Arguments: max_l, volume edge. The couplings are read from the cached host Gaunt table of the degree, which is built
+// before timing. Still O(entry_count) per voxel, i.e. roughly O(max_l^5), hence the small volumes.
+void product(benchmark::State& state)
+{
+  const auto max_l             = unsigned(state.range(0));
+  const auto dimensions        = uint3 {unsigned(state.range(1)), unsigned(state.range(1)), unsigned(state.range(1))};
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(max_l);
+
+  auto lhs = random_coefficients(voxel_count * coefficient_count);
+  auto rhs = random_coefficients(voxel_count * coefficient_count);
+  std::vector<float> out(voxel_count * coefficient_count);
+  cush::cached_host_gaunt_table<float>(max_l);
+
+  for (auto _ : state)
+  {
+    cush::host::product(dimensions, coefficient_count, lhs.data(), rhs.data(), out.data());
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  set_throughput(state, voxel_count, coefficient_count, 3 * voxel_count * coefficient_count * sizeof(float));
+}
+BENCHMARK(product)->ArgNames({"max_l", "edge"})->ArgsProduct({benchmark::CreateDenseRange(2, 12, 1), {4, 8}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Arguments: max_l, volume edge, longitude tessellations (the latitude tessellations are half).
+void sample_sums(benchmark::State& state)
+{
+  const auto max_l             = unsigned(state.range(0));
+  const auto dimensions        = uint3 {unsigned(state.range(1)), unsigned(state.range(1)), unsigned(state.range(1))};
+  const auto tessellations     = uint2 {unsigned(state.range(2)), unsigned(state.range(2) / 2)};
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(max_l);
+  const auto point_count       = size_t(tessellations.x) * tessellations.y;
+
+  auto coefficients = random_coefficients(voxel_count * coefficient_count);
+  std::vector<float3>       points (voxel_count * point_count);
+  std::vector<unsigned int> indices(voxel_count * point_count * 6);
+
+  for (auto _ : state)
+  {
+    cush::host::sample_sums(dimensions, coefficient_count, tessellations, coefficients.data(), points.data(), indices.data());
+    benchmark::DoNotOptimize(points.data());
+    benchmark::ClobberMemory();
+  }
+  set_throughput(state, voxel_count, coefficient_count,
+    voxel_count * (coefficient_count * sizeof(float) + point_count * (sizeof(float3) + 6 * sizeof(unsigned int))));
+}
+BENCHMARK(sample_sums)->ArgNames({"max_l", "edge", "tessellations"})->ArgsProduct({benchmark::CreateDenseRange(2, 12, 1), {8}, {32, 64}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Arguments: max_l, volume edge. The vectors are shared by all voxels, i.e. the normal equations are factorized once.
+void fit(benchmark::State& state)
+{
+  const auto max_l             = unsigned(state.range(0));
+  const auto dimensions        = uint3 {unsigned(state.range(1)), unsigned(state.range(1)), unsigned(state.range(1))};
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(max_l);
+  const auto vector_count      = 2 * coefficient_count;
+
+  std::vector<float3> vectors(vector_count);
+  for (auto index = 0u; index < vector_count; index++)
+    vectors[index] = {0.0F, 2.399963F * index, std::acos(1.0F - 2.0F * (index + 0.5F) / vector_count)};
+  auto samples = random_coefficients(voxel_count * vector_count);
+  std::vector<float> coefficients(voxel_count * coefficient_count);
+
+  for (auto _ : state)
+  {
+    cush::host::fit(vector_count, coefficient_count, vectors.data(), unsigned(voxel_count), samples.data(), coefficients.data());
+    benchmark::DoNotOptimize(coefficients.data());
+    benchmark::ClobberMemory();
+  }
+  set_throughput(state, voxel_count, coefficient_count, voxel_count * (vector_count + coefficient_count) * sizeof(float));
+}
+BENCHMARK(fit)->ArgNames({"max_l", "edge"})->ArgsProduct({benchmark::CreateDenseRange(2, 12, 1), {8, 16}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Arguments: max_l, database size. A voxel is a database vector here, compared against 256 queries.
+void pairwise_distances(benchmark::State& state)
+{
+  const auto max_l             = unsigned(state.range(0));
+  const auto database_count    = unsigned(state.range(1));
+  const auto query_count       = 256u;
+  const auto coefficient_count = cush::coefficient_count(max_l);
+
+  auto queries  = random_coefficients(size_t(query_count   ) * coefficient_count);
+  auto database = random_coefficients(size_t(database_count) * coefficient_count);
+  std::vector<float> distances(size_t(query_count) * database_count);
+
+  for (auto _ : state)
+  {
+    cush::host::pairwise_distances(query_count, database_count, coefficient_count, queries.data(), database.data(), distances.data());
+    benchmark::DoNotOptimize(distances.data());
+    benchmark::ClobberMemory();
+  }
+  set_throughput(state, database_count, coefficient_count,
+    ((size_t(query_count) + database_count) * coefficient_count + size_t(query_count) * database_count) * sizeof(float));
+}
+BENCHMARK(pairwise_distances)->ArgNames({"max_l", "database"})->ArgsProduct({benchmark::CreateDenseRange(2, 12, 1), {1024, 8192}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,465 @@
+#include <nvbench/nvbench.cuh>
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include <thrust/device_vector.h>
+
+#include <cush/distance.h>
+#include <cush/fitting.h>
+#include <cush/rotation.h>
+#include <cush/sampling.h>
+#include <cush/spherical_harmonics.h>
+#include <cush/workspace.h>
+
+// Kernel benchmarks. The volumes are cubes of the given edge length. The element count of each benchmark is its number
+// of voxels (database vectors for the distances), i.e. nvbench's Elem/s is voxels/s; coefficients/s is Elem/s times
+// the coefficient_count (max_l + 1)^2 of the max_l axis. The max_l axis covers every degree from 2 to 12, since the odd
+// degrees take the runtime degree variants of the kernels with fixed degree specializations (see dispatch_max_l). The
+// global memory reads and writes are the bytes the kernels must move at least, hence BWUtil is relative to the roofline
+// of the device.
+
+namespace
+{
+thrust::device_vector<float> random_coefficients(const size_t count)
+{
+  std::mt19937                          generator   (0);
+  std::uniform_real_distribution<float> distribution(-1.0F, 1.0F);
+  std::vector<float>                    coefficients(count);
+  for (auto& coefficient : coefficients)
+    coefficient = distribution(generator);
+  return thrust::device_vector<float>(coefficients.begin(), coefficients.end());
+}
+// Count well spread (unused, theta, phi) directions on a spiral, repeated for each of copies voxels.
+thrust::device_vector<float3> spiral_directions(const unsigned int count, const size_t copies = 1)
+{
+  std::vector<float3> vectors(count * copies);
+  for (auto index = 0u; index < vectors.size(); index++)
+  {
+    auto point     = index % count;
+    vectors[index] = float3 {1.0F, 2.399963F * point, std::acos(1.0F - 2.0F * (point + 0.5F) / count)};
+  }
+  return thrust::device_vector<float3>(vectors.begin(), vectors.end());
+}
+uint3 cube(const nvbench::state& state)
+{
+  auto edge = static_cast<unsigned int>(state.get_int64("edge"));
+  return uint3 {edge, edge, edge};
+}
+}
+
+void product(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+
+  auto lhs = random_coefficients(voxel_count * coefficient_count);
+  auto rhs = random_coefficients(voxel_count * coefficient_count);
+  thrust::device_vector<float> out(voxel_count * coefficient_count);
+
+  // The first launch builds the cached table of the degree.
+  cush::cached_gaunt_table<float>(cush::maximum_degree(coefficient_count));
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float>(2 * voxel_count * coefficient_count);
+  state.add_global_memory_writes<float>(    voxel_count * coefficient_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_product(dimensions, coefficient_count,
+      thrust::raw_pointer_cast(lhs.data()),
+      thrust::raw_pointer_cast(rhs.data()),
+      thrust::raw_pointer_cast(out.data()),
+      launch.get_stream());
+  });
+}
+NVBENCH_BENCH(product)
+  .add_int64_axis             ("max_l", nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge" , nvbench::range(4, 6));
+
+// The fallback of product which computes the couplings on the fly.
+void product_on_the_fly(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+
+  auto lhs = random_coefficients(voxel_count * coefficient_count);
+  auto rhs = random_coefficients(voxel_count * coefficient_count);
+  thrust::device_vector<float> out(voxel_count * coefficient_count);
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float>(2 * voxel_count * coefficient_count);
+  state.add_global_memory_writes<float>(    voxel_count * coefficient_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_product_on_the_fly(dimensions, coefficient_count,
+      thrust::raw_pointer_cast(lhs.data()),
+      thrust::raw_pointer_cast(rhs.data()),
+      thrust::raw_pointer_cast(out.data()),
+      launch.get_stream());
+  });
+}
+NVBENCH_BENCH(product_on_the_fly)
+  .add_int64_axis             ("max_l", nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge" , nvbench::range(4, 6));
+
+// The tessellations axis is the longitude tessellations, the latitude tessellations are half.
+void sample_sums(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+  const auto tessellations     = uint2 {static_cast<unsigned int>(state.get_int64("tessellations")), static_cast<unsigned int>(state.get_int64("tessellations") / 2)};
+  const auto point_count       = size_t(tessellations.x) * tessellations.y;
+
+  auto coefficients = random_coefficients(voxel_count * coefficient_count);
+  thrust::device_vector<float3>       points (voxel_count * point_count);
+  thrust::device_vector<unsigned int> indices(voxel_count * point_count * 6);
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float>       (voxel_count * coefficient_count);
+  state.add_global_memory_writes<float3>      (voxel_count * point_count);
+  state.add_global_memory_writes<unsigned int>(voxel_count * point_count * 6);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_sample_sums(dimensions, coefficient_count, tessellations,
+      thrust::raw_pointer_cast(coefficients.data()),
+      thrust::raw_pointer_cast(points      .data()),
+      thrust::raw_pointer_cast(indices     .data()),
+      0, true, launch.get_stream());
+  });
+}
+NVBENCH_BENCH(sample_sums)
+  .add_int64_axis             ("max_l"        , nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge"         , nvbench::range(3, 5))
+  .add_int64_axis             ("tessellations", {32, 64, 128});
+
+void extract_maxima(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+  const auto tessellations     = uint2 {static_cast<unsigned int>(state.get_int64("tessellations")), static_cast<unsigned int>(state.get_int64("tessellations") / 2)};
+  const auto maxima_count      = 3u;
+
+  auto coefficients = random_coefficients(voxel_count * coefficient_count);
+  thrust::device_vector<float3> maxima(voxel_count * maxima_count);
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float> (voxel_count * coefficient_count);
+  state.add_global_memory_writes<float3>(voxel_count * maxima_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_extract_maxima(dimensions, coefficient_count,
+      thrust::raw_pointer_cast(coefficients.data()), tessellations, maxima_count,
+      thrust::raw_pointer_cast(maxima      .data()),
+      true, true, launch.get_stream());
+  });
+}
+NVBENCH_BENCH(extract_maxima)
+  .add_int64_axis             ("max_l"        , nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge"         , nvbench::range(3, 5))
+  .add_int64_axis             ("tessellations", {32, 64, 128});
+
+void convolve_zonal(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto max_l             = static_cast<unsigned int>(state.get_int64("max_l"));
+  const auto coefficient_count = cush::coefficient_count(max_l);
+
+  auto coefficients = random_coefficients(voxel_count * coefficient_count);
+  auto scales       = random_coefficients(max_l + 1);
+  thrust::device_vector<float> output(voxel_count * coefficient_count);
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float>(voxel_count * coefficient_count);
+  state.add_global_memory_writes<float>(voxel_count * coefficient_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_convolve_zonal(dimensions, coefficient_count,
+      thrust::raw_pointer_cast(coefficients.data()),
+      thrust::raw_pointer_cast(scales      .data()),
+      thrust::raw_pointer_cast(output      .data()),
+      launch.get_stream());
+  });
+}
+NVBENCH_BENCH(convolve_zonal)
+  .add_int64_axis             ("max_l", nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge" , nvbench::range(4, 6));
+
+void calculate_descriptors(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto max_l             = static_cast<unsigned int>(state.get_int64("max_l"));
+  const auto coefficient_count = cush::coefficient_count(max_l);
+
+  auto coefficients = random_coefficients(voxel_count * coefficient_count);
+  thrust::device_vector<float> descriptors(voxel_count * (max_l + 1));
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float>(voxel_count * coefficient_count);
+  state.add_global_memory_writes<float>(voxel_count * (max_l + 1));
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_calculate_descriptors(dimensions, coefficient_count,
+      thrust::raw_pointer_cast(coefficients.data()),
+      thrust::raw_pointer_cast(descriptors .data()),
+      launch.get_stream());
+  });
+}
+NVBENCH_BENCH(calculate_descriptors)
+  .add_int64_axis             ("max_l", nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge" , nvbench::range(4, 6));
+
+void rotate_voxels(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+
+  // The benchmark does not depend on the rotations being orthogonal.
+  auto coefficients = random_coefficients(voxel_count * coefficient_count);
+  auto rotations    = random_coefficients(voxel_count * 9);
+  thrust::device_vector<float> output(voxel_count * coefficient_count);
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float>(voxel_count * (coefficient_count + 9));
+  state.add_global_memory_writes<float>(voxel_count * coefficient_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_rotate_voxels(dimensions, coefficient_count,
+      thrust::raw_pointer_cast(rotations   .data()),
+      thrust::raw_pointer_cast(coefficients.data()),
+      thrust::raw_pointer_cast(output      .data()),
+      launch.get_stream());
+  });
+}
+NVBENCH_BENCH(rotate_voxels)
+  .add_int64_axis             ("max_l", nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge" , nvbench::range(3, 5));
+
+// A database vector is a voxel here, compared against 1024 queries.
+void pairwise_distances(nvbench::state& state)
+{
+  const auto database_count    = static_cast<unsigned int>(state.get_int64("database"));
+  const auto query_count       = 1024u;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+
+  auto queries  = random_coefficients(size_t(query_count   ) * coefficient_count);
+  auto database = random_coefficients(size_t(database_count) * coefficient_count);
+  thrust::device_vector<float> distances(size_t(query_count) * database_count);
+
+  state.add_element_count(database_count, "Vectors");
+  state.add_global_memory_reads <float>((size_t(query_count) + database_count) * coefficient_count);
+  state.add_global_memory_writes<float>( size_t(query_count) * database_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_pairwise_distances(query_count, database_count, coefficient_count,
+      thrust::raw_pointer_cast(queries  .data()),
+      thrust::raw_pointer_cast(database .data()),
+      thrust::raw_pointer_cast(distances.data()),
+      cush::distance_metric::l2, launch.get_stream());
+  });
+}
+NVBENCH_BENCH(pairwise_distances)
+  .add_int64_axis             ("max_l"   , nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("database", nvbench::range(12, 16, 2));
+
+// The vectors are shared by all voxels. The matrices are the voxel-major basis matrices of fit_batched.
+void calculate_matrices(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+  const auto vector_count      = 64u;
+
+  auto vectors = spiral_directions(vector_count, voxel_count);
+  thrust::device_vector<float> matrices(voxel_count * vector_count * coefficient_count);
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float3>(voxel_count * vector_count);
+  state.add_global_memory_writes<float> (voxel_count * vector_count * coefficient_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_calculate_matrices(dimensions, vector_count, coefficient_count,
+      thrust::raw_pointer_cast(vectors .data()),
+      thrust::raw_pointer_cast(matrices.data()),
+      false, cush::matrix_layout::column_major, launch.get_stream());
+  });
+}
+NVBENCH_BENCH(calculate_matrices)
+  .add_int64_axis             ("max_l", nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge" , nvbench::range(3, 4));
+
+// Twice as many vectors as coefficients, shared by all voxels, i.e. a GEMM with the pseudo-inverse of the plan.
+void fit(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+  const auto vector_count      = 2 * coefficient_count;
+
+  auto vectors = spiral_directions(vector_count);
+  auto samples = random_coefficients(voxel_count * vector_count);
+  thrust::device_vector<float> coefficients(voxel_count * coefficient_count);
+  const cush::fitting_plan<float> plan(vector_count, coefficient_count, thrust::raw_pointer_cast(vectors.data()));
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float>(voxel_count * vector_count + size_t(vector_count) * coefficient_count);
+  state.add_global_memory_writes<float>(voxel_count * coefficient_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    plan.fit(unsigned(voxel_count),
+      thrust::raw_pointer_cast(samples     .data()),
+      thrust::raw_pointer_cast(coefficients.data()),
+      launch.get_stream());
+  });
+}
+NVBENCH_BENCH(fit)
+  .add_int64_axis             ("max_l", nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge" , nvbench::range(4, 6));
+
+// Twice as many vectors as coefficients per voxel. The workspace holds a basis matrix and a normal matrix per voxel,
+// hence the small volumes.
+void fit_batched(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+  const auto vector_count      = 2 * coefficient_count;
+
+  auto vectors = spiral_directions(vector_count, voxel_count);
+  auto samples = random_coefficients(voxel_count * vector_count);
+  thrust::device_vector<float> coefficients(voxel_count * coefficient_count);
+
+  cublasHandle_t     cublas  ;
+  cusolverDnHandle_t cusolver;
+  cublasCreate    (&cublas  );
+  cusolverDnCreate(&cusolver);
+  cush::workspace scratch(cush::fit_batched_workspace_size<float>(dimensions, vector_count, coefficient_count), state.get_cuda_stream().get_stream());
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float3>(voxel_count * vector_count);
+  state.add_global_memory_reads <float> (voxel_count * vector_count);
+  state.add_global_memory_writes<float> (voxel_count * coefficient_count);
+  state.exec([&] (nvbench::launch&)
+  {
+    cush::fit_batched(cublas, cusolver, dimensions, vector_count, coefficient_count,
+      thrust::raw_pointer_cast(vectors     .data()),
+      thrust::raw_pointer_cast(samples     .data()),
+      thrust::raw_pointer_cast(coefficients.data()),
+      scratch);
+  });
+
+  cusolverDnDestroy(cusolver);
+  cublasDestroy    (cublas  );
+}
+NVBENCH_BENCH(fit_batched)
+  .add_int64_axis             ("max_l", nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge" , nvbench::range(2, 3));
+
+// The maxima are seeded by extract_maxima on a 32 x 16 grid and refined in place. The tolerance is zero, so that every
+// launch performs all iterations although the previous launches have refined the maxima already.
+void refine_maxima(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+  const auto maxima_count      = 3u;
+
+  auto coefficients = random_coefficients(voxel_count * coefficient_count);
+  thrust::device_vector<float3> maxima(voxel_count * maxima_count);
+  cush::launch_extract_maxima(dimensions, coefficient_count,
+    thrust::raw_pointer_cast(coefficients.data()), uint2 {32, 16}, maxima_count,
+    thrust::raw_pointer_cast(maxima      .data()), true);
+  cudaDeviceSynchronize();
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float> (voxel_count * coefficient_count);
+  state.add_global_memory_reads <float3>(voxel_count * maxima_count);
+  state.add_global_memory_writes<float3>(voxel_count * maxima_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    cush::launch_refine_maxima(unsigned(voxel_count), coefficient_count,
+      thrust::raw_pointer_cast(coefficients.data()), maxima_count,
+      thrust::raw_pointer_cast(maxima      .data()),
+      8, 0.1F, 0.0F, launch.get_stream());
+  });
+}
+NVBENCH_BENCH(refine_maxima)
+  .add_int64_axis             ("max_l", nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge" , nvbench::range(3, 5));
+
+// A database vector is a voxel here, searched by 1024 queries in batches of 256 for their 8 nearest neighbors.
+void nearest_neighbors(nvbench::state& state)
+{
+  const auto database_count    = static_cast<unsigned int>(state.get_int64("database"));
+  const auto query_count       = 1024u;
+  const auto neighbor_count    = 8u;
+  const auto batch_size        = 256u;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+
+  auto queries  = random_coefficients(size_t(query_count   ) * coefficient_count);
+  auto database = random_coefficients(size_t(database_count) * coefficient_count);
+  thrust::device_vector<unsigned int> indices  (size_t(query_count) * neighbor_count);
+  thrust::device_vector<float>        distances(size_t(query_count) * neighbor_count);
+
+  cublasHandle_t cublas;
+  cublasCreate(&cublas);
+  cush::workspace scratch(cush::nearest_neighbors_workspace_size<float>(database_count, cush::distance_metric::l2, batch_size), state.get_cuda_stream().get_stream());
+
+  state.add_element_count(database_count, "Vectors");
+  state.add_global_memory_reads <float>       ((size_t(query_count) + database_count) * coefficient_count);
+  state.add_global_memory_writes<unsigned int>( size_t(query_count) * neighbor_count);
+  state.add_global_memory_writes<float>       ( size_t(query_count) * neighbor_count);
+  state.exec([&] (nvbench::launch&)
+  {
+    cush::launch_nearest_neighbors(cublas, query_count, database_count, coefficient_count,
+      thrust::raw_pointer_cast(queries  .data()),
+      thrust::raw_pointer_cast(database .data()), neighbor_count,
+      thrust::raw_pointer_cast(indices  .data()),
+      thrust::raw_pointer_cast(distances.data()),
+      scratch, cush::distance_metric::l2, batch_size);
+  });
+
+  cublasDestroy(cublas);
+}
+NVBENCH_BENCH(nearest_neighbors)
+  .add_int64_axis             ("max_l"   , nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("database", nvbench::range(12, 16, 2));
+
+// The tessellations axis is the longitude tessellations, the latitude tessellations are half. The values are sampled by
+// a GEMM with the basis matrix of the plan, without normalization.
+void sampling_plan(nvbench::state& state)
+{
+  const auto dimensions        = cube(state);
+  const auto voxel_count       = size_t(dimensions.x) * dimensions.y * dimensions.z;
+  const auto coefficient_count = cush::coefficient_count(static_cast<unsigned int>(state.get_int64("max_l")));
+  const auto tessellations     = uint2 {static_cast<unsigned int>(state.get_int64("tessellations")), static_cast<unsigned int>(state.get_int64("tessellations") / 2)};
+  const auto point_count       = size_t(tessellations.x) * tessellations.y;
+
+  auto coefficients = random_coefficients(voxel_count * coefficient_count);
+  thrust::device_vector<float> values(voxel_count * point_count);
+  const cush::sampling_plan<float> plan(tessellations, coefficient_count);
+  cudaDeviceSynchronize();
+
+  state.add_element_count(voxel_count, "Voxels");
+  state.add_global_memory_reads <float>(voxel_count * coefficient_count + point_count * coefficient_count);
+  state.add_global_memory_writes<float>(voxel_count * point_count);
+  state.exec([&] (nvbench::launch& launch)
+  {
+    plan.sample(unsigned(voxel_count),
+      thrust::raw_pointer_cast(coefficients.data()),
+      thrust::raw_pointer_cast(values      .data()),
+      false, launch.get_stream());
+  });
+}
+NVBENCH_BENCH(sampling_plan)
+  .add_int64_axis             ("max_l"        , nvbench::range(2, 12))
+  .add_int64_power_of_two_axis("edge"         , nvbench::range(3, 4))
+  .add_int64_axis             ("tessellations", {32, 64, 128});
@@ -0,0 +1,102 @@
+#ifndef CUSH_BLAS_H_
+#define CUSH_BLAS_H_
+
+#include <cublas_v2.h>
+#include <cuda_bf16.h>
+#include <cuda_fp16.h>
+#include <cusolverDn.h>
+
+// Precision overloads of the cuBLAS and cuSOLVER routines used by the library. All matrices are column-major.
+namespace cush
+{
+inline cublasStatus_t     gemm                (cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+                                               const float*  alpha, const float*  a, int lda, const float*  b, int ldb, const float*  beta, float*  c, int ldc)
+{
+  return cublasSgemm(handle, transa, transb, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+inline cublasStatus_t     gemm                (cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+                                               const double* alpha, const double* a, int lda, const double* b, int ldb, const double* beta, double* c, int ldc)
+{
+  return cublasDgemm(handle, transa, transb, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+// The 16-bit overloads accumulate in float, hence alpha and beta are float.
+inline cublasStatus_t     gemm                (cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+                                               const float*  alpha, const __half*        a, int lda, const __half*        b, int ldb, const float*  beta, __half*        c, int ldc)
+{
+  return cublasGemmEx(handle, transa, transb, m, n, k, alpha, a, CUDA_R_16F , lda, b, CUDA_R_16F , ldb, beta, c, CUDA_R_16F , ldc, CUBLAS_COMPUTE_32F, CUBLAS_GEMM_DEFAULT);
+}
+inline cublasStatus_t     gemm                (cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+                                               const float*  alpha, const __nv_bfloat16* a, int lda, const __nv_bfloat16* b, int ldb, const float*  beta, __nv_bfloat16* c, int ldc)
+{
+  return cublasGemmEx(handle, transa, transb, m, n, k, alpha, a, CUDA_R_16BF, lda, b, CUDA_R_16BF, ldb, beta, c, CUDA_R_16BF, ldc, CUBLAS_COMPUTE_32F, CUBLAS_GEMM_DEFAULT);
+}
+
+inline cublasStatus_t     gemm_strided_batched(cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+                                               const float*  alpha, const float*  a, int lda, long long stride_a, const float*  b, int ldb, long long stride_b,
+                                               const float*  beta , float*        c, int ldc, long long stride_c, int batch_count)
+{
+  return cublasSgemmStridedBatched(handle, transa, transb, m, n, k, alpha, a, lda, stride_a, b, ldb, stride_b, beta, c, ldc, stride_c, batch_count);
+}
+inline cublasStatus_t     gemm_strided_batched(cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+                                               const double* alpha, const double* a, int lda, long long stride_a, const double* b, int ldb, long long stride_b,
+                                               const double* beta , double*       c, int ldc, long long stride_c, int batch_count)
+{
+  return cublasDgemmStridedBatched(handle, transa, transb, m, n, k, alpha, a, lda, stride_a, b, ldb, stride_b, beta, c, ldc, stride_c, batch_count);
+}
+
+inline cublasStatus_t     geam                (cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n,
+                                               const float*  alpha, const float*  a, int lda, const float*  beta, const float*  b, int ldb, float*  c, int ldc)
+{
+  return cublasSgeam(handle, transa, transb, m, n, alpha, a, lda, beta, b, ldb, c, ldc);
+}
+inline cublasStatus_t     geam                (cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n,
+                                               const double* alpha, const double* a, int lda, const double* beta, const double* b, int ldb, double* c, int ldc)
+{
+  return cublasDgeam(handle, transa, transb, m, n, alpha, a, lda, beta, b, ldb, c, ldc);
+}
+
+inline cusolverStatus_t   potrf_buffer_size   (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, float*  a, int lda, int* size)
+{
+  return cusolverDnSpotrf_bufferSize(handle, uplo, n, a, lda, size);
+}
+inline cusolverStatus_t   potrf_buffer_size   (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, double* a, int lda, int* size)
+{
+  return cusolverDnDpotrf_bufferSize(handle, uplo, n, a, lda, size);
+}
+inline cusolverStatus_t   potrf               (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, float*  a, int lda, float*  workspace, int size, int* info)
+{
+  return cusolverDnSpotrf(handle, uplo, n, a, lda, workspace, size, info);
+}
+inline cusolverStatus_t   potrf               (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, double* a, int lda, double* workspace, int size, int* info)
+{
+  return cusolverDnDpotrf(handle, uplo, n, a, lda, workspace, size, info);
+}
+inline cusolverStatus_t   potrs               (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, int nrhs, const float*  a, int lda, float*  b, int ldb, int* info)
+{
+  return cusolverDnSpotrs(handle, uplo, n, nrhs, a, lda, b, ldb, info);
+}
+inline cusolverStatus_t   potrs               (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, int nrhs, const double* a, int lda, double* b, int ldb, int* info)
+{
+  return cusolverDnDpotrs(handle, uplo, n, nrhs, a, lda, b, ldb, info);
+}
+
+inline cusolverStatus_t   potrf_batched       (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, float*  a[], int lda, int* info, int batch_count)
+{
+  return cusolverDnSpotrfBatched(handle, uplo, n, a, lda, info, batch_count);
+}
+inline cusolverStatus_t   potrf_batched       (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, double* a[], int lda, int* info, int batch_count)
+{
+  return cusolverDnDpotrfBatched(handle, uplo, n, a, lda, info, batch_count);
+}
+// The batched solve supports a single right hand side only.
+inline cusolverStatus_t   potrs_batched       (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, float*  a[], int lda, float*  b[], int ldb, int* info, int batch_count)
+{
+  return cusolverDnSpotrsBatched(handle, uplo, n, 1, a, lda, b, ldb, info, batch_count);
+}
+inline cusolverStatus_t   potrs_batched       (cusolverDnHandle_t handle, cublasFillMode_t uplo, int n, double* a[], int lda, double* b[], int ldb, int* info, int batch_count)
+{
+  return cusolverDnDpotrsBatched(handle, uplo, n, 1, a, lda, b, ldb, info, batch_count);
+}
+}
+
+#endif
@@ -1,9 +1,8 @@
 #ifndef CUSH_CHOOSE_H_
 #define CUSH_CHOOSE_H_
 
-#include <host_defines.h>
-
 #include <cush/factorial.h>
+#include <cush/portability.h>
 
 namespace cush
 {
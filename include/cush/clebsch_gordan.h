@@ -1,9 +1,10 @@
 #ifndef CUSH_CLEBSCH_GORDAN_H_
 #define CUSH_CLEBSCH_GORDAN_H_
 
-#include <host_defines.h>
 #include <math.h>
 
+#include <cush/math.h>
+#include <cush/portability.h>
 #include <cush/wigner.h>
 
 namespace cush
@@ -12,12 +13,12 @@ namespace cush
 template<typename precision>
 __host__ __device__ precision clebsch_gordan(
   unsigned int l1, unsigned int l2, unsigned int l3,
-  unsigned int m1, unsigned int m2, unsigned int m3)
+  int          m1, int          m2, int          m3)
 {
-  return pow (precision(-1.0) , m3 + l1 - l2) *   
-         sqrt(precision( 2.0) * l3 + precision(1.0)) *
-         wigner_3j<precision>(precision(2.0) * l1, precision(2.0) * l2,  precision(2.0) * l3, 
-                              precision(2.0) * m1, precision(2.0) * m2, -precision(2.0) * m3);
+  return (m3 + int(l1) - int(l2) & 1 ? precision(-1) : precision(1)) *
+         math::sqrt(precision(2 * l3 + 1)) *
+         wigner_3j<precision>(2 * l1, 2 * l2,  2 * l3, 
+                              2 * m1, 2 * m2, -2 * m3);
 }
 }
 
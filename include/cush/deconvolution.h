@@ -0,0 +1,393 @@
+#ifndef CUSH_DECONVOLUTION_H_
+#define CUSH_DECONVOLUTION_H_
+
+#include <cublas_v2.h>
+#include <cuda_runtime_api.h>
+#include <cusolverDn.h>
+#include <device_launch_parameters.h>
+#include <stdexcept>
+#include <string>
+#include <vector_types.h>
+
+#include <cush/blas.h>
+#include <cush/fitting.h>
+#include <cush/launch.h>
+#include <cush/reduce.h>
+#include <cush/spherical_harmonics.h>
+#include <cush/workspace.h>
+
+// Constrained spherical deconvolution, based on "Robust determination of the fibre orientation distribution in diffusion
+// MRI: Non-negativity constrained super-resolved spherical deconvolution" by Tournier et al.
+namespace cush
+{
+// Call on a column_count 1D grid.
+// Scales the even degree columns of the column-major row_count x column_count matrix by the per degree scales.
+template<typename precision>
+__global__ void scale_even_columns(
+  const unsigned int row_count   ,
+  const unsigned int column_count,
+  const precision*   scales      ,
+  precision*         matrix      )
+{
+  auto column = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (column >= column_count)
+    return;
+
+  auto l = 0u;
+  while (even_coefficient_count(l) <= column)
+    l += 2;
+  for (auto row = 0u; row < row_count; row++)
+    matrix[row + row_count * column] *= scales[l];
+}
+// Bytes of dynamic shared memory required per block by constrained_normal_matrices.
+__forceinline__ __host__ __device__ unsigned int constrained_normal_matrices_shared_size(const unsigned int constraint_count)
+{
+  return constraint_count * sizeof(bool);
+}
+// Call on a voxel_count 1D grid of 1D blocks, i.e. a block per voxel, with
+// constrained_normal_matrices_shared_size(constraint_count) bytes of dynamic shared memory.
+// Adds weight * C_n^T C_n to the normal_matrix for each voxel, where C_n are the rows of the column-major
+// constraint_count x column_count constraint matrix at which the voxel's amplitudes fall below threshold times their mean.
+// The voxel_count x constraint_count constrained sets of the previous iteration are updated to these rows, and the voxels
+// whose set changed are counted into changes.
+template<typename precision>
+__global__ void constrained_normal_matrices(
+  const unsigned int voxel_count      ,
+  const unsigned int column_count     ,
+  const unsigned int constraint_count ,
+  const precision*   normal_matrix    ,
+  const precision*   constraint_matrix,
+  const precision*   amplitudes       ,
+  const precision    threshold        ,
+  const precision    weight           ,
+  precision*         output_matrices  ,
+  bool*              constrained_sets ,
+  unsigned int*      changes          )
+{
+  extern __shared__ bool constrained_normal_matrices_memory[];
+
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= voxel_count)
+    return;
+
+  auto negatives        = constrained_normal_matrices_memory;
+  auto voxel_amplitudes = amplitudes + volume_index * constraint_count;
+
+  precision sum(0);
+  for (auto point = threadIdx.x; point < constraint_count; point += blockDim.x)
+    sum += voxel_amplitudes[point];
+  auto minimum = threshold * block_reduce(sum, sum_operation<precision>(), precision(0)) / constraint_count;
+  auto voxel_set = constrained_sets + volume_index * constraint_count;
+  auto changed   = 0;
+  for (auto point = threadIdx.x; point < constraint_count; point += blockDim.x)
+  {
+    negatives[point]  = voxel_amplitudes[point] < minimum;
+    changed          |= negatives[point] != voxel_set[point];
+    voxel_set[point]  = negatives[point];
+  }
+  if (__syncthreads_or(changed) && threadIdx.x == 0)
+    atomicAdd(changes, 1u);
+
+  auto voxel_matrix = output_matrices + volume_index * column_count * column_count;
+  for (auto element = threadIdx.x; element < column_count * column_count; element += blockDim.x)
+  {
+    auto row    = element % column_count;
+    auto column = element / column_count;
+    auto value  = precision(0);
+    for (auto point = 0u; point < constraint_count; point++)
+      if (negatives[point])
+        value += constraint_matrix[point + constraint_count * row] * constraint_matrix[point + constraint_count * column];
+    voxel_matrix[element] = normal_matrix[element] + weight * value;
+  }
+}
+
+// Deconvolves the signals of all voxels sharing a single direction set by a response function, constraining the
+// fiber orientation distribution to be non-negative at a set of constraint directions. Only the even degrees are solved
+// for, as the response of the antipodally symmetric signals vanishes at the odd degrees.
+//
+// The response is given as max_l + 1 per degree scales (see zonal_convolution_scales), by which the columns of the basis
+// matrix B of the directions are scaled to M. On construction, the ridge regularized M^T M and pseudo-inverse of M are
+// computed once. Solving then starts from the unconstrained GEMM fit, and each iteration is a GEMM for the amplitudes at
+// the constraint directions, a block per voxel adding the rows of the negative amplitudes to the regularized M^T M, and a
+// batched Cholesky solve of all voxels, until the negative amplitudes of no voxel change. The floating-point types are
+// float and double.
+template<typename precision>
+class deconvolution_plan
+{
+public:
+  // The vectors and constraint vectors are in device memory, in the (unused, theta, phi) layout of calculate_matrix, the
+  // response is in host memory. The regularization weighs both the constraint rows and the ridge of the estimates, the
+  // amplitudes below threshold times their mean are constrained. Throws std::runtime_error if the regularized normal
+  // matrix is not positive definite.
+  template<typename vector_type>
+  deconvolution_plan           (
+    const unsigned int vector_count      ,
+    const unsigned int coefficient_count ,
+    const vector_type* vectors           ,
+    const precision*   response          ,
+    const unsigned int constraint_count  ,
+    const vector_type* constraint_vectors,
+    const precision    regularization    = precision(1),
+    const precision    threshold         = precision(0.1),
+    cudaStream_t       stream            = nullptr)
+  : vector_count_     (vector_count)
+  , coefficient_count_(coefficient_count)
+  , column_count_     (matrix_column_count(coefficient_count, true))
+  , constraint_count_ (constraint_count)
+  , regularization_   (regularization)
+  , threshold_        (threshold)
+  , stream_           (stream)
+  {
+    cublasCreate        (&cublas_);
+    cublasSetStream     ( cublas_, stream);
+    cusolverDnCreate    (&cusolver_);
+    cusolverDnSetStream ( cusolver_, stream);
+
+    precision* scales   ;
+    precision* transpose;
+    precision* inverse  ;
+    int*       info     ;
+    cudaMalloc(reinterpret_cast<void**>(&scales)            , (maximum_degree(coefficient_count) + 1) * sizeof(precision));
+    cudaMalloc(reinterpret_cast<void**>(&transpose)         , column_count_ * vector_count      * sizeof(precision));
+    cudaMalloc(reinterpret_cast<void**>(&inverse)           , column_count_ * column_count_     * sizeof(precision));
+    cudaMalloc(reinterpret_cast<void**>(&info)              , sizeof(int));
+    cudaMalloc(reinterpret_cast<void**>(&response_matrix_)  , vector_count     * column_count_  * sizeof(precision));
+    cudaMalloc(reinterpret_cast<void**>(&constraint_matrix_), constraint_count * column_count_  * sizeof(precision));
+    cudaMalloc(reinterpret_cast<void**>(&normal_matrix_)    , column_count_    * column_count_  * sizeof(precision));
+    cudaMalloc(reinterpret_cast<void**>(&pseudoinverse_)    , column_count_    * vector_count   * sizeof(precision));
+    cudaMemcpy(scales, response, (maximum_degree(coefficient_count) + 1) * sizeof(precision), cudaMemcpyHostToDevice);
+
+    calculate_matrix<<<grid_size_1d(vector_count)    , block_size_1d(), 0, stream>>>(
+      vector_count      ,
+      coefficient_count ,
+      vectors           ,
+      response_matrix_  ,
+      true              ,
+      matrix_layout::column_major);
+    calculate_matrix<<<grid_size_1d(constraint_count), block_size_1d(), 0, stream>>>(
+      constraint_count  ,
+      coefficient_count ,
+      constraint_vectors,
+      constraint_matrix_,
+      true              ,
+      matrix_layout::column_major);
+    scale_even_columns<<<grid_size_1d(column_count_), block_size_1d(), 0, stream>>>(
+      vector_count      ,
+      column_count_     ,
+      scales            ,
+      response_matrix_  );
+
+    const precision alpha(1), beta(0);
+    gemm(cublas_, CUBLAS_OP_T, CUBLAS_OP_N, column_count_, column_count_, vector_count,
+      &alpha, response_matrix_, vector_count, response_matrix_, vector_count, &beta, normal_matrix_, column_count_);
+    // The estimates are regularized, as the high degree columns are scaled nearly to zero by the response. The ridge is
+    // part of the normal matrix, hence of the constrained estimates of every iteration as well.
+    add_to_diagonals<<<grid_size_1d(column_count_), block_size_1d(), 0, stream>>>(1u, column_count_, regularization * regularization, normal_matrix_);
+    cudaMemcpyAsync(inverse, normal_matrix_, column_count_ * column_count_ * sizeof(precision), cudaMemcpyDeviceToDevice, stream);
+    geam(cublas_, CUBLAS_OP_T, CUBLAS_OP_T, column_count_, vector_count,
+      &alpha, response_matrix_, vector_count, &beta, response_matrix_, vector_count, transpose, column_count_);
+
+    int        workspace_size;
+    precision* workspace     ;
+    potrf_buffer_size(cusolver_, CUBLAS_FILL_MODE_LOWER, column_count_, inverse, column_count_, &workspace_size);
+    cudaMalloc(reinterpret_cast<void**>(&workspace), workspace_size * sizeof(precision));
+    potrf(cusolver_, CUBLAS_FILL_MODE_LOWER, column_count_, inverse, column_count_, workspace, workspace_size, info);
+    int factorization_info = 0;
+    cudaMemcpyAsync(&factorization_info, info, sizeof(int), cudaMemcpyDeviceToHost, stream);
+    potrs(cusolver_, CUBLAS_FILL_MODE_LOWER, column_count_, vector_count, inverse, column_count_, transpose, column_count_, info);
+    cudaMemcpyAsync(pseudoinverse_, transpose, column_count_ * vector_count * sizeof(precision), cudaMemcpyDeviceToDevice, stream);
+    cudaStreamSynchronize(stream);
+
+    cudaFree(workspace);
+    cudaFree(info     );
+    cudaFree(inverse  );
+    cudaFree(transpose);
+    cudaFree(scales   );
+
+    if (factorization_info != 0)
+    {
+      cudaFree         (pseudoinverse_    );
+      cudaFree         (normal_matrix_    );
+      cudaFree         (constraint_matrix_);
+      cudaFree         (response_matrix_  );
+      cusolverDnDestroy(cusolver_         );
+      cublasDestroy    (cublas_           );
+      throw std::runtime_error("cush: deconvolution_plan: the regularized normal matrix is not positive definite (at its "
+        "leading minor of order " + std::to_string(factorization_info) + "), e.g. without regularization.");
+    }
+  }
+  deconvolution_plan           (const deconvolution_plan&  that) = delete ;
+  deconvolution_plan           (      deconvolution_plan&& temp)
+  : vector_count_     (temp.vector_count_)
+  , coefficient_count_(temp.coefficient_count_)
+  , column_count_     (temp.column_count_)
+  , constraint_count_ (temp.constraint_count_)
+  , regularization_   (temp.regularization_)
+  , threshold_        (temp.threshold_)
+  , response_matrix_  (temp.response_matrix_)
+  , constraint_matrix_(temp.constraint_matrix_)
+  , normal_matrix_    (temp.normal_matrix_)
+  , pseudoinverse_    (temp.pseudoinverse_)
+  , cublas_           (temp.cublas_)
+  , cusolver_         (temp.cusolver_)
+  , stream_           (temp.stream_)
+  {
+    temp.response_matrix_   = nullptr;
+    temp.constraint_matrix_ = nullptr;
+    temp.normal_matrix_     = nullptr;
+    temp.pseudoinverse_     = nullptr;
+    temp.cublas_            = nullptr;
+    temp.cusolver_          = nullptr;
+  }
+ ~deconvolution_plan           ()
+  {
+    if (response_matrix_ != nullptr)
+      cudaFree(response_matrix_);
+    if (constraint_matrix_ != nullptr)
+      cudaFree(constraint_matrix_);
+    if (normal_matrix_ != nullptr)
+      cudaFree(normal_matrix_);
+    if (pseudoinverse_ != nullptr)
+      cudaFree(pseudoinverse_);
+    if (cusolver_ != nullptr)
+      cusolverDnDestroy(cusolver_);
+    if (cublas_ != nullptr)
+      cublasDestroy(cublas_);
+  }
+  deconvolution_plan& operator=(const deconvolution_plan&  that) = delete ;
+  deconvolution_plan& operator=(      deconvolution_plan&& temp) = delete ;
+
+  // The workspace size of solve, dominated by the O(voxel_count * column_count^2) normal matrices, hence large volumes
+  // should be solved in slabs.
+  size_t       workspace_size   (const unsigned int voxel_count) const
+  {
+    auto voxels = static_cast<size_t>(voxel_count);
+    return
+      cush::workspace_size<precision >(voxels * column_count_) * 2             +
+      cush::workspace_size<precision >(voxels * constraint_count_)             +
+      cush::workspace_size<precision >(voxels * column_count_ * column_count_) +
+      cush::workspace_size<precision*>(voxels) * 2                             +
+      cush::workspace_size<int       >(voxels)                                 +
+      cush::workspace_size<int       >(1)                                      +
+      cush::workspace_size<bool      >(voxels * constraint_count_)             +
+      cush::workspace_size<unsigned  >(1)                                      +
+      cush::workspace_size<solver_failures>(1);
+  }
+  // The samples are voxel_count x vector_count and the coefficients voxel_count x coefficient_count, voxel-major. The
+  // workspace must be on the stream of the plan. Iterates until the constrained directions of no voxel change, up to
+  // iterations times, and returns the iterations which changed a constrained set. Synchronizes the stream of the plan
+  // once per iteration, and throws std::runtime_error if the normal matrix of a voxel is not positive definite (see
+  // check_failures), e.g. for a vanishing regularization in float.
+  unsigned int solve            (const unsigned int voxel_count, const precision* samples, precision* coefficients, workspace& workspace, const unsigned int iterations = 10) const
+  {
+    // The sizes as in workspace_size, which exceed 32 bits for large volumes.
+    auto voxels = static_cast<size_t>(voxel_count);
+    workspace_scope scope(workspace);
+    auto right_hand_sides  = workspace.allocate<precision >(voxels * column_count_    );
+    auto solutions         = workspace.allocate<precision >(voxels * column_count_    );
+    auto amplitudes        = workspace.allocate<precision >(voxels * constraint_count_);
+    auto normal_matrices   = workspace.allocate<precision >(voxels * column_count_ * column_count_);
+    auto normal_pointers   = workspace.allocate<precision*>(voxels);
+    auto solution_pointers = workspace.allocate<precision*>(voxels);
+    auto info              = workspace.allocate<int       >(voxels);
+    auto solve_info        = workspace.allocate<int       >(1);
+    auto constrained_sets  = workspace.allocate<bool      >(voxels * constraint_count_);
+    auto changes           = workspace.allocate<unsigned  >(1);
+    auto failures          = workspace.allocate<solver_failures>(1);
+
+    const precision alpha(1), beta(0);
+    gemm(cublas_, CUBLAS_OP_T, CUBLAS_OP_N, column_count_, voxel_count, vector_count_,
+      &alpha, response_matrix_, vector_count_, samples, vector_count_, &beta, right_hand_sides, column_count_);
+    gemm(cublas_, CUBLAS_OP_N, CUBLAS_OP_N, column_count_, voxel_count, vector_count_,
+      &alpha, pseudoinverse_  , column_count_, samples, vector_count_, &beta, solutions       , column_count_);
+
+    launch_1d(calculate_batch_pointers<precision>, thread_grid(voxel_count), 0, stream_, voxel_count, column_count_ * column_count_, normal_matrices, normal_pointers  );
+    launch_1d(calculate_batch_pointers<precision>, thread_grid(voxel_count), 0, stream_, voxel_count, column_count_                , solutions      , solution_pointers);
+    // The unconstrained estimate is that of no constrained directions.
+    cudaMemsetAsync(constrained_sets, 0, voxels * constraint_count_ * sizeof(bool), stream_);
+    reset_failures (failures, stream_);
+
+    auto iteration = 0u;
+    for (; iteration < iterations; iteration++)
+    {
+      gemm(cublas_, CUBLAS_OP_N, CUBLAS_OP_N, constraint_count_, voxel_count, column_count_,
+        &alpha, constraint_matrix_, constraint_count_, solutions, column_count_, &beta, amplitudes, constraint_count_);
+      cudaMemsetAsync(changes, 0, sizeof(unsigned), stream_);
+      launch_1d_in_place(constrained_normal_matrices<precision>, block_grid(voxel_count), constrained_normal_matrices_shared_size(constraint_count_), stream_,
+        voxel_count       ,
+        column_count_     ,
+        constraint_count_ ,
+        normal_matrix_    ,
+        constraint_matrix_,
+        amplitudes        ,
+        threshold_        ,
+        regularization_ * regularization_,
+        normal_matrices   ,
+        constrained_sets  ,
+        changes           );
+
+      // The solutions of unchanged constrained sets are those of the previous iteration.
+      unsigned changed_voxels = 0;
+      cudaMemcpyAsync      (&changed_voxels, changes, sizeof(unsigned), cudaMemcpyDeviceToHost, stream_);
+      cudaStreamSynchronize(stream_);
+      if (changed_voxels == 0)
+        break;
+
+      cudaMemcpyAsync(solutions, right_hand_sides, voxels * column_count_ * sizeof(precision), cudaMemcpyDeviceToDevice, stream_);
+      potrf_batched(cusolver_, CUBLAS_FILL_MODE_LOWER, column_count_, normal_pointers, column_count_, info, voxel_count);
+      launch_1d_in_place(count_failures<int>, thread_grid(voxel_count), 0, stream_, voxel_count, static_cast<const int*>(info), failures);
+      // The info of potrs_batched is a single value, of its arguments only.
+      potrs_batched(cusolver_, CUBLAS_FILL_MODE_LOWER, column_count_, normal_pointers, column_count_, solution_pointers, column_count_, solve_info, voxel_count);
+      check_failures("deconvolution_plan::solve", failures, stream_);
+    }
+
+    launch_1d(expand_even_rows<precision, precision>, thread_grid(voxel_count * coefficient_count_), 0, stream_,
+      coefficient_count_, voxel_count, solutions, coefficients);
+    return iteration;
+  }
+  // As above, with a temporary workspace.
+  unsigned int solve            (const unsigned int voxel_count, const precision* samples, precision* coefficients, const unsigned int iterations = 10) const
+  {
+    workspace scratch(workspace_size(voxel_count), stream_);
+    auto performed = solve(voxel_count, samples, coefficients, scratch, iterations);
+    cudaStreamSynchronize(stream_);
+    return performed;
+  }
+  unsigned int solve            (const uint3        dimensions , const precision* samples, precision* coefficients, const unsigned int iterations = 10) const
+  {
+    return solve(dimensions.x * dimensions.y * dimensions.z, samples, coefficients, iterations);
+  }
+
+  unsigned int vector_count     () const
+  {
+    return vector_count_;
+  }
+  unsigned int coefficient_count() const
+  {
+    return coefficient_count_;
+  }
+  unsigned int constraint_count () const
+  {
+    return constraint_count_;
+  }
+
+protected:
+  unsigned int       vector_count_      = 0;
+  unsigned int       coefficient_count_ = 0;
+  unsigned int       column_count_      = 0;
+  unsigned int       constraint_count_  = 0;
+  precision          regularization_    = precision(1);
+  precision          threshold_         = precision(0.1);
+  precision*         response_matrix_   = nullptr;
+  precision*         constraint_matrix_ = nullptr;
+  precision*         normal_matrix_     = nullptr;
+  precision*         pseudoinverse_     = nullptr;
+  cublasHandle_t     cublas_            = nullptr;
+  cusolverDnHandle_t cusolver_          = nullptr;
+  cudaStream_t       stream_            = nullptr;
+};
+}
+
+#endif
@@ -0,0 +1,388 @@
+#ifndef CUSH_DISTANCE_H_
+#define CUSH_DISTANCE_H_
+
+#ifndef CUSH_CPU_ONLY
+#include <cublas_v2.h>
+#include <cuda_runtime_api.h>
+#include <device_launch_parameters.h>
+#endif
+#include <math.h>
+
+#ifndef CUSH_CPU_ONLY
+#include <cush/blas.h>
+#include <cush/launch.h>
+#endif
+#include <cush/layout.h>
+#include <cush/math.h>
+#include <cush/portability.h>
+#include <cush/precision.h>
+#include <cush/profile.h>
+#ifndef CUSH_CPU_ONLY
+#include <cush/reduce.h>
+#include <cush/workspace.h>
+#endif
+
+// All-pairs and nearest neighbor distances between sets of coefficient vectors, with the semantics of l1_distance and
+// l2_distance. The coefficient vectors are count x coefficient_count, vector-major (i.e. a column-major
+// coefficient_count x count matrix), and the distances are column-major database_count x query_count, i.e. the distances
+// of each query are contiguous. The launchers take the layout of the database (see layout.h) as their last template
+// argument, e.g. a soa database coalesces the loads of consecutive database vectors, while the queries stay vector-major
+// so that they can be batched.
+namespace cush
+{
+enum class distance_metric
+{
+  l1,
+  l2
+};
+
+// The edge of the square tiles of pairwise_distances, which is also its block size in both dimensions.
+__forceinline__ __host__ __device__ constexpr unsigned int distance_tile_size()
+{
+  return 32;
+}
+
+#ifndef CUSH_CPU_ONLY
+// Call on a database_count x query_count 2D grid of distance_tile_size() x distance_tile_size() blocks.
+// Each block computes a tile of the distances, streaming tiles of its queries' and database vectors' coefficients
+// through shared memory so that each coefficient is read from global memory once per tile instead of once per pair.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+__global__ void pairwise_distances(
+  const unsigned int              query_count      ,
+  const unsigned int              database_count   ,
+  const unsigned int              coefficient_count,
+  const precision*                queries          ,
+  const precision*                database         ,
+  const distance_metric           metric           ,
+  compute_precision_t<precision>* distances        )
+{
+  using compute_type = compute_precision_t<precision>;
+
+  // The rows are padded by one element, so that the column accesses below do not conflict in the shared memory banks.
+  __shared__ compute_type query_tile   [distance_tile_size()][distance_tile_size() + 1];
+  __shared__ compute_type database_tile[distance_tile_size()][distance_tile_size() + 1];
+
+  auto database_offset = blockIdx.x * distance_tile_size();
+  auto query_offset    = blockIdx.y * distance_tile_size();
+  auto database_index  = database_offset + threadIdx.x;
+  auto query_index     = query_offset    + threadIdx.y;
+
+  compute_type value(0);
+  for (auto tile_offset = 0u; tile_offset < coefficient_count; tile_offset += distance_tile_size())
+  {
+    // Consecutive threads load consecutive coefficients of a query, and consecutive coefficients of a database vector in
+    // the aos layout, else a coefficient of consecutive database vectors (transposed into the tile).
+    auto coefficient_index = tile_offset + threadIdx.x;
+    auto load_query        = query_offset + threadIdx.y;
+    query_tile   [threadIdx.y][threadIdx.x] = load_query    < query_count    && coefficient_index < coefficient_count
+      ? convert<compute_type>(queries [static_cast<size_t>(load_query   ) * coefficient_count + coefficient_index]) : compute_type(0);
+    if (layout == coefficient_layout::aos)
+    {
+      auto load_database = database_offset + threadIdx.y;
+      database_tile[threadIdx.y][threadIdx.x] = load_database < database_count && coefficient_index < coefficient_count
+        ? convert<compute_type>(database[static_cast<size_t>(load_database) * coefficient_count + coefficient_index]) : compute_type(0);
+    }
+    else
+    {
+      auto load_database    = database_offset + threadIdx.x;
+      auto load_coefficient = tile_offset     + threadIdx.y;
+      database_tile[threadIdx.x][threadIdx.y] = load_database < database_count && load_coefficient < coefficient_count
+        ? convert<compute_type>(database[layout_offset<layout>(database_count, coefficient_count, load_database, load_coefficient)]) : compute_type(0);
+    }
+    __syncthreads();
+
+    // The padded coefficients are zero in both tiles, hence contribute nothing.
+    if (metric == distance_metric::l1)
+      for (auto index = 0u; index < distance_tile_size(); index++)
+        value += abs(database_tile[threadIdx.x][index] - query_tile[threadIdx.y][index]);
+    else
+      for (auto index = 0u; index < distance_tile_size(); index++)
+      {
+        auto difference = database_tile[threadIdx.x][index] - query_tile[threadIdx.y][index];
+        value += difference * difference;
+      }
+    __syncthreads();
+  }
+
+  if (database_index >= database_count ||
+      query_index    >= query_count    )
+    return;
+
+  distances[database_index + static_cast<size_t>(database_count) * query_index] = metric == distance_metric::l1 ? value : math::sqrt(value);
+}
+// Call on a count 1D grid.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+__global__ void squared_norms(
+  const unsigned int count            ,
+  const unsigned int coefficient_count,
+  const precision*   coefficients     ,
+  precision*         norms            )
+{
+  auto index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (index >= count)
+    return;
+
+  precision value(0);
+  for (auto coefficient_index = 0u; coefficient_index < coefficient_count; coefficient_index++)
+  {
+    auto coefficient = coefficients[layout_offset<layout>(count, coefficient_count, index, coefficient_index)];
+    value += coefficient * coefficient;
+  }
+  norms[index] = value;
+}
+// Call on a query_count 1D grid of 1D blocks, i.e. a block per query, so that database_count x query_count distances
+// beyond the range of a 1D grid of threads are completed as well.
+// Completes ||a - b|| = sqrt(||a||^2 + ||b||^2 - 2 a.b) given the -2 a.b products in distances. The sum is clamped to
+// zero, since it may be slightly negative from rounding for nearly identical vectors.
+template<typename precision>
+__global__ void complete_l2_distances(
+  const unsigned int query_count   ,
+  const unsigned int database_count,
+  const precision*   query_norms   ,
+  const precision*   database_norms,
+  precision*         distances     )
+{
+  auto query_index = blockIdx.x;
+
+  if (query_index >= query_count)
+    return;
+
+  auto query_distances = distances + static_cast<size_t>(query_index) * database_count;
+  for (auto database_index = threadIdx.x; database_index < database_count; database_index += blockDim.x)
+  {
+    auto value = query_norms[query_index] + database_norms[database_index] + query_distances[database_index];
+    query_distances[database_index] = value > precision(0) ? math::sqrt(value) : precision(0);
+  }
+}
+// Call on a query_count 1D grid of 1D blocks, i.e. a block per query.
+// Selects the neighbor_count smallest distances of each query in ascending order, ties broken by index. Each neighbor is
+// the smallest entry following the previous neighbor in (distance, index) order, found by a block reduction, hence the
+// distances are left intact and neither a sort nor shared memory besides that of the reductions is needed. The indices
+// beyond the database_count-th neighbor are set to database_count and their distances to infinity.
+template<typename precision>
+__global__ void select_nearest(
+  const unsigned int query_count     ,
+  const unsigned int database_count  ,
+  const unsigned int neighbor_count  ,
+  const precision*   distances       ,
+  unsigned int*      output_indices  ,
+  precision*         output_distances)
+{
+  auto query_index = blockIdx.x;
+
+  if (query_index >= query_count)
+    return;
+
+  auto query_distances    = distances        + static_cast<size_t>(query_index) * database_count;
+  auto neighbor_indices   = output_indices   + static_cast<size_t>(query_index) * neighbor_count;
+  auto neighbor_distances = output_distances + static_cast<size_t>(query_index) * neighbor_count;
+
+  auto previous_value = precision(-INFINITY);
+  auto previous_index = database_count;
+  for (auto neighbor = 0u; neighbor < neighbor_count; neighbor++)
+  {
+    auto value = precision(INFINITY);
+    auto index = database_count;
+    for (auto database_index = threadIdx.x; database_index < database_count; database_index += blockDim.x)
+    {
+      auto candidate = query_distances[database_index];
+      auto follows   = candidate > previous_value || (candidate == previous_value && database_index > previous_index);
+      if (follows && (candidate < value || (candidate == value && database_index < index)))
+      {
+        value = candidate;
+        index = database_index;
+      }
+    }
+
+    auto minimum = block_reduce(value, minimum_operation<precision>(), precision(INFINITY));
+    index        = block_reduce(value == minimum ? index : database_count, minimum_operation<unsigned int>(), database_count);
+
+    if (threadIdx.x == 0)
+    {
+      neighbor_indices  [neighbor] = index  ;
+      neighbor_distances[neighbor] = minimum;
+    }
+    previous_value = minimum;
+    previous_index = index  ;
+  }
+}
+
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void launch_pairwise_distances(
+  const unsigned int              query_count      ,
+  const unsigned int              database_count   ,
+  const unsigned int              coefficient_count,
+  const precision*                queries          ,
+  const precision*                database         ,
+  compute_precision_t<precision>* distances        ,
+  const distance_metric           metric           = distance_metric::l2,
+  cudaStream_t                    stream           = nullptr)
+{
+  profile_scope profile("pairwise_distances", stream, database_count,
+    (static_cast<size_t>(query_count) + database_count) * coefficient_count * sizeof(precision) + static_cast<size_t>(query_count) * database_count * sizeof(compute_precision_t<precision>));
+  const dim3 grid_size((database_count + distance_tile_size() - 1) / distance_tile_size(), (query_count + distance_tile_size() - 1) / distance_tile_size());
+  const dim3 block_size(distance_tile_size(), distance_tile_size());
+  pairwise_distances<precision, layout><<<grid_size, block_size, 0, stream>>>(
+    query_count      ,
+    database_count   ,
+    coefficient_count,
+    queries          ,
+    database         ,
+    metric           ,
+    distances        );
+}
+// The workspace size of launch_l2_distances, i.e. of the squared norms.
+template<typename precision>
+size_t l2_distances_workspace_size(
+  const unsigned int query_count   ,
+  const unsigned int database_count)
+{
+  return workspace_size<precision>(query_count) + workspace_size<precision>(database_count);
+}
+// The L2 distances as a GEMM of the queries and the database, for float and double, on the stream of the workspace. An
+// aosoa database is not a strided matrix, its distances are computed by pairwise_distances instead.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void launch_l2_distances(
+  cublasHandle_t     cublas           ,
+  const unsigned int query_count      ,
+  const unsigned int database_count   ,
+  const unsigned int coefficient_count,
+  const precision*   queries          ,
+  const precision*   database         ,
+  precision*         distances        ,
+  workspace&         workspace        )
+{
+  auto stream = workspace.stream();
+  profile_scope profile("l2_distances", stream, database_count,
+    ((static_cast<size_t>(query_count) + database_count) * coefficient_count + static_cast<size_t>(query_count) * database_count) * sizeof(precision));
+  if (layout == coefficient_layout::aosoa)
+  {
+    launch_pairwise_distances<precision, layout>(query_count, database_count, coefficient_count, queries, database, distances, distance_metric::l2, stream);
+    return;
+  }
+  cublasSetStream(cublas, stream);
+
+  workspace_scope scope(workspace);
+  auto query_norms    = workspace.allocate<precision>(query_count   );
+  auto database_norms = workspace.allocate<precision>(database_count);
+
+  launch_1d(squared_norms<precision>, thread_grid(query_count)   , 0, stream, query_count   , coefficient_count, queries , query_norms   );
+  launch_1d(squared_norms<precision, layout>, thread_grid(database_count), 0, stream, database_count, coefficient_count, database, database_norms);
+
+  // A soa database is a column-major database_count x coefficient_count matrix.
+  const precision alpha(-2), beta(0);
+  gemm(cublas, layout == coefficient_layout::soa ? CUBLAS_OP_N : CUBLAS_OP_T, CUBLAS_OP_N, database_count, query_count, coefficient_count,
+    &alpha, database, layout == coefficient_layout::soa ? database_count : coefficient_count, queries, coefficient_count, &beta, distances, database_count);
+
+  launch_1d_in_place(complete_l2_distances<precision>, block_grid(query_count), 0, stream,
+    query_count, database_count, query_norms, database_norms, distances);
+}
+// As above, with a temporary workspace.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void launch_l2_distances(
+  cublasHandle_t     cublas           ,
+  const unsigned int query_count      ,
+  const unsigned int database_count   ,
+  const unsigned int coefficient_count,
+  const precision*   queries          ,
+  const precision*   database         ,
+  precision*         distances        ,
+  cudaStream_t       stream           = nullptr)
+{
+  workspace scratch(l2_distances_workspace_size<precision>(query_count, database_count), stream);
+  launch_l2_distances<precision, layout>(cublas, query_count, database_count, coefficient_count, queries, database, distances, scratch);
+  cudaStreamSynchronize(stream);
+}
+template<typename precision>
+void launch_select_nearest(
+  const unsigned int query_count     ,
+  const unsigned int database_count  ,
+  const unsigned int neighbor_count  ,
+  const precision*   distances       ,
+  unsigned int*      output_indices  ,
+  precision*         output_distances,
+  cudaStream_t       stream          = nullptr)
+{
+  profile_scope profile("select_nearest", stream, database_count,
+    static_cast<size_t>(query_count) * (database_count * sizeof(precision) + neighbor_count * (sizeof(unsigned int) + sizeof(precision))));
+  launch_1d(select_nearest<precision>, block_grid(query_count), 0, stream,
+    query_count     ,
+    database_count  ,
+    neighbor_count  ,
+    distances       ,
+    output_indices  ,
+    output_distances);
+}
+// The workspace size of launch_nearest_neighbors.
+template<typename precision>
+size_t nearest_neighbors_workspace_size(
+  const unsigned int    database_count,
+  const distance_metric metric        = distance_metric::l2,
+  const unsigned int    batch_size    = 1024)
+{
+  return workspace_size<precision>(static_cast<size_t>(batch_size) * database_count) +
+    (metric == distance_metric::l2 ? l2_distances_workspace_size<precision>(batch_size, database_count) : 0);
+}
+// The neighbor_count nearest database vectors of each query, as query_count x neighbor_count indices and distances in
+// ascending order, for float and double, on the stream of the workspace. The queries are processed in batches of
+// batch_size, bounding the workspace to batch_size x database_count distances. The L2 distances are computed by
+// launch_l2_distances, the L1 distances by launch_pairwise_distances.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void launch_nearest_neighbors(
+  cublasHandle_t        cublas           ,
+  const unsigned int    query_count      ,
+  const unsigned int    database_count   ,
+  const unsigned int    coefficient_count,
+  const precision*      queries          ,
+  const precision*      database         ,
+  const unsigned int    neighbor_count   ,
+  unsigned int*         output_indices   ,
+  precision*            output_distances ,
+  workspace&            workspace        ,
+  const distance_metric metric           = distance_metric::l2,
+  const unsigned int    batch_size       = 1024)
+{
+  auto stream = workspace.stream();
+
+  workspace_scope scope(workspace);
+  auto distances = workspace.allocate<precision>(static_cast<size_t>(batch_size) * database_count);
+
+  for (auto batch_offset = 0u; batch_offset < query_count; batch_offset += batch_size)
+  {
+    auto batch_count   = query_count - batch_offset < batch_size ? query_count - batch_offset : batch_size;
+    auto batch_queries = queries + static_cast<size_t>(batch_offset) * coefficient_count;
+    if (metric == distance_metric::l2)
+      launch_l2_distances      <precision, layout>(cublas, batch_count, database_count, coefficient_count, batch_queries, database, distances, workspace);
+    else
+      launch_pairwise_distances<precision, layout>(        batch_count, database_count, coefficient_count, batch_queries, database, distances, metric, stream);
+    launch_select_nearest(batch_count, database_count, neighbor_count, distances,
+      output_indices   + static_cast<size_t>(batch_offset) * neighbor_count,
+      output_distances + static_cast<size_t>(batch_offset) * neighbor_count, stream);
+  }
+}
+// As above, with a temporary workspace.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void launch_nearest_neighbors(
+  cublasHandle_t        cublas           ,
+  const unsigned int    query_count      ,
+  const unsigned int    database_count   ,
+  const unsigned int    coefficient_count,
+  const precision*      queries          ,
+  const precision*      database         ,
+  const unsigned int    neighbor_count   ,
+  unsigned int*         output_indices   ,
+  precision*            output_distances ,
+  const distance_metric metric           = distance_metric::l2,
+  const unsigned int    batch_size       = 1024,
+  cudaStream_t          stream           = nullptr)
+{
+  workspace scratch(nearest_neighbors_workspace_size<precision>(database_count, metric, batch_size), stream);
+  launch_nearest_neighbors<precision, layout>(cublas, query_count, database_count, coefficient_count, queries, database, neighbor_count,
+    output_indices, output_distances, scratch, metric, batch_size);
+  cudaStreamSynchronize(stream);
+}
+#endif
+}
+
+#endif
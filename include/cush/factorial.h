@@ -1,28 +1,124 @@
 #ifndef CUSH_FACTORIAL_H_
 #define CUSH_FACTORIAL_H_
 
-#include <host_defines.h>
 #include <math.h>
 
+#include <cush/portability.h>
+
+// Number of entries in the factorial lookup tables, i.e. the largest tabulated argument is CUSH_FACTORIAL_TABLE_SIZE - 1.
+// The default is the largest n for which n! fits in a double. Arguments beyond the tables fall back to loops or lgamma.
+#ifndef CUSH_FACTORIAL_TABLE_SIZE
+#define CUSH_FACTORIAL_TABLE_SIZE 171
+#endif
+
 namespace cush
 {
+template<typename type, unsigned int size>
+struct lookup_table
+{
+  type values[size];
+};
+
+// Natural logarithm usable in constant expressions. Reduces x to [1, 2) and sums the series of 2 atanh((x - 1) / (x + 1)).
+__host__ __device__ constexpr double constexpr_log(double x)
+{
+  auto exponent = 0;
+  while (x >= 2.0)
+  {
+    x /= 2.0;
+    exponent++;
+  }
+  while (x < 1.0)
+  {
+    x *= 2.0;
+    exponent--;
+  }
+
+  auto z     = (x - 1.0) / (x + 1.0);
+  auto term  = z;
+  auto sum   = 0.0;
+  for (auto k = 1; k < 64; k += 2)
+  {
+    sum  += term / k;
+    term *= z * z;
+  }
+  return exponent * 0.693147180559945309417232121458 + 2.0 * sum;
+}
+
+template<unsigned int size>
+__host__ __device__ constexpr lookup_table<double, size> make_factorial_table          ()
+{
+  lookup_table<double, size> table {};
+  for (unsigned int n = 0; n < size; n++)
+    table.values[n] = n < 2 ? 1.0 : table.values[n - 1] * n;
+  return table;
+}
+template<unsigned int size>
+__host__ __device__ constexpr lookup_table<double, size> make_ln_factorial_table       ()
+{
+  lookup_table<double, size> table {};
+  for (unsigned int n = 0; n < size; n++)
+    table.values[n] = n < 2 ? 0.0 : table.values[n - 1] + constexpr_log(n);
+  return table;
+}
+template<unsigned int size>
+__host__ __device__ constexpr lookup_table<double, size> make_double_factorial_table   ()
+{
+  lookup_table<double, size> table {};
+  for (unsigned int n = 0; n < size; n++)
+    table.values[n] = n < 2 ? 1.0 : table.values[n - 2] * n;
+  return table;
+}
+template<unsigned int size>
+__host__ __device__ constexpr lookup_table<double, size> make_ln_double_factorial_table()
+{
+  lookup_table<double, size> table {};
+  for (unsigned int n = 0; n < size; n++)
+    table.values[n] = n < 2 ? 0.0 : table.values[n - 2] + constexpr_log(n);
+  return table;
+}
+
+// The host tables are evaluated at compile time, the device tables are their copies in constant memory.
+static constexpr    lookup_table<double, CUSH_FACTORIAL_TABLE_SIZE> host_factorial_table             = make_factorial_table          <CUSH_FACTORIAL_TABLE_SIZE>();
+static constexpr    lookup_table<double, CUSH_FACTORIAL_TABLE_SIZE> host_ln_factorial_table          = make_ln_factorial_table       <CUSH_FACTORIAL_TABLE_SIZE>();
+static constexpr    lookup_table<double, CUSH_FACTORIAL_TABLE_SIZE> host_double_factorial_table      = make_double_factorial_table   <CUSH_FACTORIAL_TABLE_SIZE>();
+static constexpr    lookup_table<double, CUSH_FACTORIAL_TABLE_SIZE> host_ln_double_factorial_table   = make_ln_double_factorial_table<CUSH_FACTORIAL_TABLE_SIZE>();
+static __constant__ lookup_table<double, CUSH_FACTORIAL_TABLE_SIZE> device_factorial_table           = make_factorial_table          <CUSH_FACTORIAL_TABLE_SIZE>();
+static __constant__ lookup_table<double, CUSH_FACTORIAL_TABLE_SIZE> device_ln_factorial_table        = make_ln_factorial_table       <CUSH_FACTORIAL_TABLE_SIZE>();
+static __constant__ lookup_table<double, CUSH_FACTORIAL_TABLE_SIZE> device_double_factorial_table    = make_double_factorial_table   <CUSH_FACTORIAL_TABLE_SIZE>();
+static __constant__ lookup_table<double, CUSH_FACTORIAL_TABLE_SIZE> device_ln_double_factorial_table = make_ln_double_factorial_table<CUSH_FACTORIAL_TABLE_SIZE>();
+
+#ifdef __CUDA_ARCH__
+#define CUSH_FACTORIAL_TABLE(NAME) device_##NAME##_table.values
+#else
+#define CUSH_FACTORIAL_TABLE(NAME) host_##NAME##_table.values
+#endif
+
 template<typename precision = double>
 __host__ __device__ precision factorial          (unsigned int n)
 {
+  if (n < CUSH_FACTORIAL_TABLE_SIZE)
+    return precision(CUSH_FACTORIAL_TABLE(factorial)[n]);
+
   precision out(1.0);
-  for (auto i = 2; i <= n; i++)
+  for (auto i = 2u; i <= n; i++)
     out *= i;
   return out;
 }
 template<typename precision = double>
 __host__ __device__ precision ln_factorial       (unsigned int n)
 {
-  return log(factorial<precision>(n));
+  if (n < CUSH_FACTORIAL_TABLE_SIZE)
+    return precision(CUSH_FACTORIAL_TABLE(ln_factorial)[n]);
+  return lgamma(precision(n + 1));
 }
 
 template<typename precision = double>
 __host__ __device__ precision double_factorial   (unsigned int n)
 {
+  if (n < CUSH_FACTORIAL_TABLE_SIZE)
+    return precision(CUSH_FACTORIAL_TABLE(double_factorial)[n]);
+
   precision out(1.0);
   while (n > 1)
   {
@@ -34,8 +130,31 @@ __host__ __device__ precision double_factorial   (unsigned int n)
 template<typename precision = double>
 __host__ __device__ precision ln_double_factorial(unsigned int n)
 {
-  return log(double_factorial<precision>(n));
+  if (n < CUSH_FACTORIAL_TABLE_SIZE)
+    return precision(CUSH_FACTORIAL_TABLE(ln_double_factorial)[n]);
+
+  precision out(0.0);
+  while (n > 1)
+  {
+    out += log(precision(n));
+    n   -= 2;
+  }
+  return out;
+}
+
+// Fixed degree variants, evaluated at compile time.
+template<typename precision, unsigned int n>
+__host__ __device__ constexpr precision factorial       ()
+{
+  return n < 2 ? precision(1) : precision(n) * factorial       <precision, (n < 2 ? 0 : n - 1)>();
 }
+template<typename precision, unsigned int n>
+__host__ __device__ constexpr precision double_factorial()
+{
+  return n < 2 ? precision(1) : precision(n) * double_factorial<precision, (n < 2 ? 0 : n - 2)>();
 }
+}
+
+#undef CUSH_FACTORIAL_TABLE
 
 #endif
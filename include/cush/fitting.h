@@ -0,0 +1,399 @@
+#ifndef CUSH_FITTING_H_
+#define CUSH_FITTING_H_
+
+#include <cublas_v2.h>
+#include <cuda_runtime_api.h>
+#include <cusolverDn.h>
+#include <device_launch_parameters.h>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector_types.h>
+
+#include <cush/blas.h>
+#include <cush/launch.h>
+#include <cush/precision.h>
+#include <cush/profile.h>
+#include <cush/spherical_harmonics.h>
+#include <cush/workspace.h>
+
+// Least squares fitting of spherical harmonics coefficients to samples along directions, i.e. solving
+// (A^T A + regularization * I) x = A^T b for the vector_count x column_count basis matrix A of calculate_matrix.
+namespace cush
+{
+// Call on a batch_count * size 1D grid.
+template<typename precision>
+__global__ void add_to_diagonals(
+  const unsigned int batch_count,
+  const unsigned int size       ,
+  const precision    value      ,
+  precision*         matrices   )
+{
+  auto global_index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (global_index >= batch_count * size)
+    return;
+
+  auto batch_index    = global_index / size;
+  auto diagonal_index = global_index % size;
+  matrices[batch_index * size * size + diagonal_index * (size + 1)] += value;
+}
+// Call on a size 1D grid.
+template<typename input_type, typename output_type>
+__global__ void convert_values(
+  const unsigned int size  ,
+  const input_type*  input ,
+  output_type*       output)
+{
+  auto index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (index >= size)
+    return;
+
+  output[index] = convert<output_type>(input[index]);
+}
+// Call on a coefficient_count * column_count 1D grid.
+// Scatters the rows of a column-major even_coefficient_count(max_l) x column_count matrix into the even degree rows of a
+// column-major coefficient_count x column_count matrix and zeroes its odd degree rows.
+template<typename input_type, typename output_type>
+__global__ void expand_even_rows(
+  const unsigned int coefficient_count,
+  const unsigned int column_count     ,
+  const input_type*  input            ,
+  output_type*       output           )
+{
+  auto global_index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (global_index >= coefficient_count * column_count)
+    return;
+
+  auto row    = global_index % coefficient_count;
+  auto column = global_index / coefficient_count;
+  auto lm     = coefficient_lm(row);
+  output[global_index] = lm.x % 2 == 0
+    ? convert<output_type>(input[even_coefficient_index(lm.x, lm.y) + even_coefficient_count(maximum_degree(coefficient_count)) * column])
+    : convert<output_type>(0.0F);
+}
+// Call on a batch_count 1D grid.
+template<typename type>
+__global__ void calculate_batch_pointers(
+  const unsigned int batch_count,
+  const unsigned int stride     ,
+  type*              base       ,
+  type**             output     )
+{
+  auto batch_index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (batch_index >= batch_count)
+    return;
+
+  output[batch_index] = base + batch_index * stride;
+}
+
+// The voxels whose normal matrix is not positive definite, e.g. of fewer distinct vectors than columns without
+// regularization, as reported by the info of potrf_batched. Their Cholesky factorization fails and their coefficients
+// are NaN.
+struct solver_failures
+{
+  unsigned int count      ;
+  unsigned int first_voxel; // The lowest failing voxel index, UINT_MAX if the count is zero.
+};
+// Call on a batch_count 1D grid, after resetting the failures by reset_failures.
+template<typename info_type>
+__global__ void count_failures(
+  const unsigned int batch_count,
+  const info_type*   info       ,
+  solver_failures*   failures   )
+{
+  auto batch_index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (batch_index >= batch_count || info[batch_index] == 0)
+    return;
+
+  atomicAdd(&failures->count      , 1u);
+  atomicMin(&failures->first_voxel, batch_index);
+}
+inline void reset_failures(solver_failures* failures, cudaStream_t stream)
+{
+  cudaMemsetAsync(&failures->count      , 0x00, sizeof(unsigned int), stream);
+  cudaMemsetAsync(&failures->first_voxel, 0xFF, sizeof(unsigned int), stream);
+}
+// Synchronizes stream and throws std::runtime_error if the failures (in device memory) of the launcher of name are not
+// zero.
+inline void check_failures(const char* name, const solver_failures* failures, cudaStream_t stream)
+{
+  solver_failures result;
+  cudaMemcpyAsync      (&result, failures, sizeof(solver_failures), cudaMemcpyDeviceToHost, stream);
+  cudaStreamSynchronize(stream);
+  if (result.count > 0)
+    throw std::runtime_error(std::string("cush: ") + name + ": the normal matrices of " + std::to_string(result.count) +
+      " voxels are not positive definite, the first is that of voxel " + std::to_string(result.first_voxel) + ".");
+}
+
+// Fits all voxels sharing a single direction set. The coefficient_count x vector_count pseudo-inverse of the basis matrix
+// is computed once on construction, after which fitting a volume is one GEMM of the pseudo-inverse and the samples,
+// requiring O(vector_count * coefficient_count) memory instead of a basis matrix per voxel.
+// The samples, coefficients and pseudo-inverse are stored in precision (e.g. __half), the pseudo-inverse is computed and
+// the GEMM accumulates in compute_type.
+template<typename precision, typename compute_type = compute_precision_t<precision>>
+class fitting_plan
+{
+public:
+  // The vectors are in device memory, in the (unused, theta, phi) layout of calculate_matrix.
+  // If even_only, only the even degrees are fit and the odd degree coefficients are zero. Throws std::runtime_error if
+  // the normal matrix of the vectors is not positive definite.
+  template<typename vector_type>
+  fitting_plan           (
+    const unsigned int vector_count     ,
+    const unsigned int coefficient_count,
+    const vector_type* vectors          ,
+    const bool         even_only        = false    ,
+    const compute_type regularization   = compute_type(0),
+    cudaStream_t       stream           = nullptr  )
+  : vector_count_(vector_count), coefficient_count_(coefficient_count)
+  {
+    auto column_count = matrix_column_count(coefficient_count, even_only);
+
+    cublasCreate        (&cublas_);
+    cublasSetStream     ( cublas_, stream);
+    cusolverDnHandle_t cusolver;
+    cusolverDnCreate    (&cusolver);
+    cusolverDnSetStream ( cusolver, stream);
+
+    compute_type* matrix       ;
+    compute_type* normal_matrix;
+    compute_type* transpose    ;
+    int*          info         ;
+    cudaMalloc(reinterpret_cast<void**>(&matrix)        , vector_count * column_count      * sizeof(compute_type));
+    cudaMalloc(reinterpret_cast<void**>(&normal_matrix) , column_count * column_count      * sizeof(compute_type));
+    cudaMalloc(reinterpret_cast<void**>(&transpose)     , column_count * vector_count      * sizeof(compute_type));
+    cudaMalloc(reinterpret_cast<void**>(&pseudoinverse_), coefficient_count * vector_count * sizeof(precision));
+    cudaMalloc(reinterpret_cast<void**>(&info)          , sizeof(int));
+
+    calculate_matrix<<<grid_size_1d(vector_count), block_size_1d(), 0, stream>>>(
+      vector_count     ,
+      coefficient_count,
+      vectors          ,
+      matrix           ,
+      even_only        ,
+      matrix_layout::column_major);
+
+    const compute_type alpha(1), beta(0);
+    gemm(cublas_, CUBLAS_OP_T, CUBLAS_OP_N, column_count, column_count, vector_count,
+      &alpha, matrix, vector_count, matrix, vector_count, &beta, normal_matrix, column_count);
+    if (regularization != compute_type(0))
+      add_to_diagonals<<<grid_size_1d(column_count), block_size_1d(), 0, stream>>>(1u, column_count, regularization, normal_matrix);
+    geam(cublas_, CUBLAS_OP_T, CUBLAS_OP_T, column_count, vector_count,
+      &alpha, matrix, vector_count, &beta, matrix, vector_count, transpose, column_count);
+
+    int           workspace_size;
+    compute_type* workspace     ;
+    potrf_buffer_size(cusolver, CUBLAS_FILL_MODE_LOWER, column_count, normal_matrix, column_count, &workspace_size);
+    cudaMalloc(reinterpret_cast<void**>(&workspace), workspace_size * sizeof(compute_type));
+    potrf(cusolver, CUBLAS_FILL_MODE_LOWER, column_count, normal_matrix, column_count, workspace, workspace_size, info);
+    int factorization_info = 0;
+    cudaMemcpyAsync(&factorization_info, info, sizeof(int), cudaMemcpyDeviceToHost, stream);
+    potrs(cusolver, CUBLAS_FILL_MODE_LOWER, column_count, vector_count, normal_matrix, column_count, transpose, column_count, info);
+
+    if (even_only)
+      expand_even_rows<<<grid_size_1d(coefficient_count * vector_count), block_size_1d(), 0, stream>>>(
+        coefficient_count, vector_count, transpose, pseudoinverse_);
+    else if (std::is_same<precision, compute_type>::value)
+      cudaMemcpyAsync(pseudoinverse_, transpose, coefficient_count * vector_count * sizeof(precision), cudaMemcpyDeviceToDevice, stream);
+    else
+      convert_values<<<grid_size_1d(coefficient_count * vector_count), block_size_1d(), 0, stream>>>(
+        coefficient_count * vector_count, transpose, pseudoinverse_);
+    cudaStreamSynchronize(stream);
+
+    cudaFree          (workspace    );
+    cudaFree          (info         );
+    cudaFree          (transpose    );
+    cudaFree          (normal_matrix);
+    cudaFree          (matrix       );
+    cusolverDnDestroy (cusolver     );
+
+    if (factorization_info != 0)
+    {
+      cudaFree     (pseudoinverse_);
+      cublasDestroy(cublas_       );
+      throw std::runtime_error("cush: fitting_plan: the normal matrix is not positive definite (at its leading minor of "
+        "order " + std::to_string(factorization_info) + "), e.g. of fewer distinct vectors than columns without regularization.");
+    }
+  }
+  fitting_plan           (const fitting_plan&  that) = delete ;
+  fitting_plan           (      fitting_plan&& temp) : vector_count_(temp.vector_count_), coefficient_count_(temp.coefficient_count_), pseudoinverse_(temp.pseudoinverse_), cublas_(temp.cublas_)
+  {
+    temp.pseudoinverse_ = nullptr;
+    temp.cublas_        = nullptr;
+  }
+ ~fitting_plan           ()
+  {
+    if (pseudoinverse_ != nullptr)
+      cudaFree(pseudoinverse_);
+    if (cublas_ != nullptr)
+      cublasDestroy(cublas_);
+  }
+  fitting_plan& operator=(const fitting_plan&  that) = delete ;
+  fitting_plan& operator=(      fitting_plan&& temp) = delete ;
+
+  // The samples are voxel_count x vector_count and the coefficients voxel_count x coefficient_count, voxel-major.
+  void             fit              (const unsigned int voxel_count, const precision* samples, precision* coefficients) const
+  {
+    const compute_type alpha(1), beta(0);
+    gemm(cublas_, CUBLAS_OP_N, CUBLAS_OP_N, coefficient_count_, voxel_count, vector_count_,
+      &alpha, pseudoinverse_, coefficient_count_, samples, vector_count_, &beta, coefficients, coefficient_count_);
+  }
+  void             fit              (const uint3        dimensions , const precision* samples, precision* coefficients) const
+  {
+    fit(dimensions.x * dimensions.y * dimensions.z, samples, coefficients);
+  }
+  // As fit, on stream instead of the stream of construction, e.g. for the streams of a slab_executor.
+  void             fit              (const unsigned int voxel_count, const precision* samples, precision* coefficients, cudaStream_t stream) const
+  {
+    cudaStream_t plan_stream;
+    cublasGetStream(cublas_, &plan_stream);
+    cublasSetStream(cublas_, stream);
+    fit(voxel_count, samples, coefficients);
+    cublasSetStream(cublas_, plan_stream);
+  }
+
+  unsigned int     vector_count     () const
+  {
+    return vector_count_;
+  }
+  unsigned int     coefficient_count() const
+  {
+    return coefficient_count_;
+  }
+  // Column-major coefficient_count x vector_count.
+  const precision* pseudoinverse    () const
+  {
+    return pseudoinverse_;
+  }
+
+protected:
+  unsigned int   vector_count_      = 0;
+  unsigned int   coefficient_count_ = 0;
+  precision*     pseudoinverse_     = nullptr;
+  cublasHandle_t cublas_            = nullptr;
+};
+
+// The workspace size of fit_batched.
+template<typename precision>
+size_t fit_batched_workspace_size(
+  const uint3        dimensions       ,
+  const unsigned int vector_count     ,
+  const unsigned int coefficient_count,
+  const bool         even_only        = false)
+{
+  auto voxel_count  = static_cast<size_t>(dimensions.x) * dimensions.y * dimensions.z;
+  auto column_count = matrix_column_count(coefficient_count, even_only);
+  return
+    workspace_size<precision >(voxel_count * vector_count * column_count) +
+    workspace_size<precision >(voxel_count * column_count * column_count) +
+    workspace_size<precision*>(voxel_count)                               +
+    workspace_size<precision*>(voxel_count)                               +
+    workspace_size<int       >(voxel_count)                               +
+    workspace_size<int       >(1)                                         +
+    (even_only ? workspace_size<precision>(voxel_count * column_count) : 0);
+}
+// Fits voxels with a direction set per voxel by forming and solving the normal equations of all voxels with batched
+// GEMMs and a batched Cholesky factorization. The vectors and samples are voxel-major voxel_count x vector_count,
+// the coefficients voxel-major voxel_count x coefficient_count. Requires fit_batched_workspace_size bytes of the
+// workspace, i.e. the memory of a basis matrix per voxel, and runs on the stream of the workspace. If failures (in device
+// memory) is not nullptr, the voxels whose normal matrix is not positive definite are counted into it, to be checked
+// e.g. by check_failures once the stream is synchronized anyway.
+template<typename vector_type, typename precision>
+void fit_batched(
+  cublasHandle_t     cublas           ,
+  cusolverDnHandle_t cusolver         ,
+  const uint3        dimensions       ,
+  const unsigned int vector_count     ,
+  const unsigned int coefficient_count,
+  const vector_type* vectors          ,
+  const precision*   samples          ,
+  precision*         coefficients     ,
+  workspace&         workspace        ,
+  const bool         even_only        = false,
+  const precision    regularization   = precision(0),
+  solver_failures*   failures         = nullptr)
+{
+  auto voxel_count  = dimensions.x * dimensions.y * dimensions.z;
+  auto column_count = matrix_column_count(coefficient_count, even_only);
+  auto stream       = workspace.stream();
+  profile_scope profile("fit_batched", stream, voxel_count,
+    static_cast<size_t>(voxel_count) * (vector_count * (sizeof(vector_type) + sizeof(precision)) + coefficient_count * sizeof(precision)));
+
+  cublasSetStream    (cublas  , stream);
+  cusolverDnSetStream(cusolver, stream);
+
+  // The sizes as in fit_batched_workspace_size, which exceed 32 bits for large volumes.
+  auto voxels = static_cast<size_t>(voxel_count);
+  workspace_scope scope(workspace);
+  auto matrices          = workspace.allocate<precision >(voxels * vector_count * column_count);
+  auto normal_matrices   = workspace.allocate<precision >(voxels * column_count * column_count);
+  auto normal_pointers   = workspace.allocate<precision*>(voxels);
+  auto solution_pointers = workspace.allocate<precision*>(voxels);
+  auto info              = workspace.allocate<int       >(voxels);
+  auto solve_info        = workspace.allocate<int       >(1);
+  auto solutions         = even_only ? workspace.allocate<precision>(voxels * column_count) : coefficients;
+
+  launch_calculate_matrices(
+    dimensions       ,
+    vector_count     ,
+    coefficient_count,
+    vectors          ,
+    matrices         ,
+    even_only        ,
+    matrix_layout::column_major,
+    stream           );
+
+  const precision alpha(1), beta(0);
+  gemm_strided_batched(cublas, CUBLAS_OP_T, CUBLAS_OP_N, column_count, column_count, vector_count,
+    &alpha, matrices, vector_count, vector_count * column_count, matrices, vector_count, vector_count * column_count,
+    &beta , normal_matrices, column_count, column_count * column_count, voxel_count);
+  gemm_strided_batched(cublas, CUBLAS_OP_T, CUBLAS_OP_N, column_count, 1, vector_count,
+    &alpha, matrices, vector_count, vector_count * column_count, samples, vector_count, vector_count,
+    &beta , solutions, column_count, column_count, voxel_count);
+  if (regularization != precision(0))
+    launch_1d_in_place(add_to_diagonals<precision>, thread_grid(voxel_count * column_count), 0, stream, voxel_count, column_count, regularization, normal_matrices);
+
+  launch_1d(calculate_batch_pointers<precision>, thread_grid(voxel_count), 0, stream, voxel_count, column_count * column_count, normal_matrices, normal_pointers  );
+  launch_1d(calculate_batch_pointers<precision>, thread_grid(voxel_count), 0, stream, voxel_count, column_count               , solutions      , solution_pointers);
+  potrf_batched(cusolver, CUBLAS_FILL_MODE_LOWER, column_count, normal_pointers, column_count, info, voxel_count);
+  if (failures != nullptr)
+  {
+    reset_failures(failures, stream);
+    launch_1d_in_place(count_failures<int>, thread_grid(voxel_count), 0, stream, voxel_count, static_cast<const int*>(info), failures);
+  }
+  // The info of potrs_batched is a single value, of its arguments only.
+  potrs_batched(cusolver, CUBLAS_FILL_MODE_LOWER, column_count, normal_pointers, column_count, solution_pointers, column_count, solve_info, voxel_count);
+
+  if (even_only)
+    launch_1d(expand_even_rows<precision, precision>, thread_grid(voxel_count * coefficient_count), 0, stream,
+      coefficient_count, voxel_count, solutions, coefficients);
+}
+// As above, with a temporary workspace. Throws std::runtime_error if the normal matrix of a voxel is not positive
+// definite (see check_failures).
+template<typename vector_type, typename precision>
+void fit_batched(
+  cublasHandle_t     cublas           ,
+  cusolverDnHandle_t cusolver         ,
+  const uint3        dimensions       ,
+  const unsigned int vector_count     ,
+  const unsigned int coefficient_count,
+  const vector_type* vectors          ,
+  const precision*   samples          ,
+  precision*         coefficients     ,
+  const bool         even_only        = false,
+  const precision    regularization   = precision(0),
+  cudaStream_t       stream           = nullptr)
+{
+  workspace scratch(fit_batched_workspace_size<precision>(dimensions, vector_count, coefficient_count, even_only) + workspace_size<solver_failures>(1), stream);
+  auto failures = scratch.allocate<solver_failures>(1);
+  fit_batched(cublas, cusolver, dimensions, vector_count, coefficient_count, vectors, samples, coefficients, scratch, even_only, regularization, failures);
+  check_failures("fit_batched", failures, stream);
+}
+}
+
+#endif
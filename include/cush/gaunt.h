@@ -0,0 +1,324 @@
+#ifndef CUSH_GAUNT_H_
+#define CUSH_GAUNT_H_
+
+#define _USE_MATH_DEFINES
+
+#ifndef CUSH_CPU_ONLY
+#include <cuda_runtime_api.h>
+#endif
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cush/clebsch_gordan.h>
+#include <cush/math.h>
+#include <cush/portability.h>
+#include <cush/precision.h>
+#include <cush/wigner.h>
+
+namespace cush
+{
+template<typename precision>
+struct gaunt_entry
+{
+  unsigned int lhs_index;
+  unsigned int rhs_index;
+  unsigned int out_index;
+  precision    value    ;
+};
+
+// Based on Modern Quantum Mechanics 2nd Edition page 216 by Jun John Sakurai.
+template<typename precision>
+__host__ __device__ precision gaunt_coefficient(
+  const unsigned int l1, const int m1,
+  const unsigned int l2, const int m2,
+  const unsigned int l3, const int m3)
+{
+  return math::sqrt_ratio(precision(2 * l1 + 1) * precision(2 * l2 + 1), precision(4) * pi<precision>() * precision(2 * l3 + 1)) *
+         clebsch_gordan<precision>(l1, l2, l3, 0 , 0 , 0 ) *
+         clebsch_gordan<precision>(l1, l2, l3, m1, m2, m3);
+}
+
+// Whether value is an accidental zero among the couplings of l1, l2 and l3, which cancels only up to rounding (e.g. l1 =
+// l2 = 3, l3 = 2, m1 = -2, m2 = 2). Their 3j symbols are at most 1 in magnitude, hence the tolerance is the epsilon of
+// the precision relative to the scale sqrt((2 l1 + 1) (2 l2 + 1) (2 l3 + 1) / 4 pi) of the couplings. Unlike an absolute
+// one, it keeps the small couplings of high degrees in double.
+template<typename precision>
+__forceinline__ __host__ __device__ bool is_gaunt_zero(const precision value, const int l1, const int l2, const int l3)
+{
+  return abs(value) < epsilon<precision>() *
+    math::sqrt(precision(2 * l1 + 1) * precision(2 * l2 + 1) * precision(2 * l3 + 1) / (precision(4) * pi<precision>()));
+}
+
+// Calls function(lhs_index, rhs_index, value) for each nonzero coupling into the output coefficient (l3, m3).
+// Visits only the (l1, m1, l2, m2) combinations satisfying the triangle, parity and m1 + m2 = m3 rules.
+template<typename precision, typename function_type>
+__host__ __device__ void for_each_gaunt_coupling(
+  const unsigned int max_l   ,
+  const int          l3      ,
+  const int          m3      ,
+  function_type      function)
+{
+  const int degree = max_l;
+  for (int l1 = 0; l1 <= degree; l1++)
+    for (int l2 = abs(l1 - l3); l2 <= l1 + l3 && l2 <= degree; l2 += 2)
+      for (int m1 = -l1; m1 <= l1; m1++)
+      {
+        auto m2 = m3 - m1;
+        if (abs(m2) > l2)
+          continue;
+
+        // Also drops the accidental zeros (see is_gaunt_zero).
+        auto value = gaunt_coefficient<precision>(l1, m1, l2, m2, l3, m3);
+        if (is_gaunt_zero(value, l1, l2, l3))
+          continue;
+
+        function(unsigned(l1 * (l1 + 1) + m1), unsigned(l2 * (l2 + 1) + m2), value);
+      }
+}
+
+// Writes the nonzero couplings into entries (if not nullptr) ordered by out_index and returns their count.
+// Call once with nullptr to query the entry count. Computes gaunt_coefficient per entry, i.e. O(max_l^6), without
+// allocating, hence callable on the device as well.
+template<typename precision>
+__host__ __device__ unsigned int calculate_gaunt_entries(
+  const unsigned int       max_l  ,
+  gaunt_entry<precision>*  entries = nullptr)
+{
+  unsigned int entry_count = 0;
+  for (int l3 = 0; l3 <= int(max_l); l3++)
+    for (int m3 = -l3; m3 <= l3; m3++)
+      for_each_gaunt_coupling<precision>(max_l, l3, m3, 
+      [&] (const unsigned int lhs_index, const unsigned int rhs_index, const precision& value)
+      {
+        if (entries != nullptr)
+          entries[entry_count] = {lhs_index, rhs_index, unsigned(l3 * (l3 + 1) + m3), value};
+        entry_count++;
+      });
+  return entry_count;
+}
+// As calculate_gaunt_entries, on the host. Generates all l3 of each (l1, m1, l2, m2) at once with wigner_3j_range, i.e.
+// O(max_l^5) instead of the O(max_l^6) of gaunt_coefficient per entry, and collects them into a std::vector before
+// ordering them by out_index. The entries and their order are those of calculate_gaunt_entries, the values agree up to
+// rounding.
+template<typename precision>
+unsigned int calculate_gaunt_entries_recursive(
+  const unsigned int       max_l  ,
+  gaunt_entry<precision>*  entries = nullptr)
+{
+  const int degree = max_l;
+  std::vector<gaunt_entry<precision>> couplings;
+  std::vector<precision>              zero_m (2 * degree + 1);
+  std::vector<precision>              range  (2 * degree + 1);
+  for (int l1 = 0; l1 <= degree; l1++)
+    for (int l2 = 0; l2 <= degree; l2++)
+    {
+      const auto zero_m_begin = wigner_3j_range_begin(2 * l1, 2 * l2, 0, 0) / 2;
+      wigner_3j_range(2 * l1, 2 * l2, 0, 0, zero_m.data());
+      for (int m1 = -l1; m1 <= l1; m1++)
+        for (int m2 = -l2; m2 <= l2; m2++)
+        {
+          const auto m3          = m1 + m2;
+          const auto range_begin = wigner_3j_range_begin(2 * l1, 2 * l2, 2 * m1, 2 * m2) / 2;
+          const auto range_size  = wigner_3j_range      (2 * l1, 2 * l2, 2 * m1, 2 * m2, range.data());
+          for (int l3 = range_begin + ((l1 + l2 + range_begin) & 1); l3 < range_begin + range_size && l3 <= degree; l3 += 2)
+          {
+            // Also drops the accidental zeros (see is_gaunt_zero).
+            const auto value = 
+              math::sqrt(precision(2 * l1 + 1) * precision(2 * l2 + 1) * precision(2 * l3 + 1) / (precision(4) * pi<precision>())) *
+              (m3 & 1 ? precision(-1) : precision(1)) * zero_m[l3 - zero_m_begin] * range[l3 - range_begin];
+            if (is_gaunt_zero(value, l1, l2, l3))
+              continue;
+
+            couplings.push_back({unsigned(l1 * (l1 + 1) + m1), unsigned(l2 * (l2 + 1) + m2), unsigned(l3 * (l3 + 1) + m3), value});
+          }
+        }
+    }
+
+  std::stable_sort(couplings.begin(), couplings.end(), [ ] (const gaunt_entry<precision>& lhs, const gaunt_entry<precision>& rhs)
+  {
+    return lhs.out_index < rhs.out_index;
+  });
+  if (entries != nullptr)
+    std::copy(couplings.begin(), couplings.end(), entries);
+  return unsigned(couplings.size());
+}
+// Fills the coefficient_count + 1 row offsets of entries ordered by out_index, i.e. the couplings into output
+// coefficient i are entries[offsets[i]] to entries[offsets[i + 1] - 1].
+template<typename precision>
+__host__ __device__ void calculate_gaunt_offsets(
+  const unsigned int             coefficient_count,
+  const unsigned int             entry_count      ,
+  const gaunt_entry<precision>*  entries          ,
+  unsigned int*                  offsets          )
+{
+  unsigned int entry_index = 0;
+  for (unsigned int out_index = 0; out_index <= coefficient_count; out_index++)
+  {
+    while (entry_index < entry_count && entries[entry_index].out_index < out_index)
+      entry_index++;
+    offsets[out_index] = entry_index;
+  }
+}
+
+// The nonzero couplings of a degree max_l product and their per output offsets on the host, computed by
+// calculate_gaunt_entries_recursive. Build once per max_l, e.g. through cached_host_gaunt_table, pass to host::product.
+template<typename precision>
+class host_gaunt_table
+{
+public:
+  explicit host_gaunt_table(const unsigned int max_l)
+  : max_l_(max_l), entries_(calculate_gaunt_entries_recursive<precision>(max_l)), offsets_(coefficient_count() + 1)
+  {
+    calculate_gaunt_entries_recursive(max_l_, entries_.data());
+    calculate_gaunt_offsets(coefficient_count(), entry_count(), entries_.data(), offsets_.data());
+  }
+
+  unsigned int                  max_l            () const
+  {
+    return max_l_;
+  }
+  unsigned int                  coefficient_count() const
+  {
+    return (max_l_ + 1) * (max_l_ + 1);
+  }
+  unsigned int                  entry_count      () const
+  {
+    return unsigned(entries_.size());
+  }
+  const gaunt_entry<precision>* entries          () const
+  {
+    return entries_.data();
+  }
+  const unsigned int*           offsets          () const
+  {
+    return offsets_.data();
+  }
+
+protected:
+  unsigned int                        max_l_  ;
+  std::vector<gaunt_entry<precision>> entries_;
+  std::vector<unsigned int>           offsets_;
+};
+// The table of max_l, built on first use and kept until exit. Thread-safe.
+template<typename precision>
+const host_gaunt_table<precision>& cached_host_gaunt_table(const unsigned int max_l)
+{
+  static std::map<unsigned int, std::unique_ptr<host_gaunt_table<precision>>> tables;
+  static std::mutex                                                           mutex;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& table = tables[max_l];
+  if (!table)
+    table.reset(new host_gaunt_table<precision>(max_l));
+  return *table;
+}
+
+#ifndef CUSH_CPU_ONLY
+// Owns the device copies of the nonzero couplings of a degree max_l product and their per output offsets, on the device
+// which is current at construction. Build once per max_l, e.g. through cached_gaunt_table, pass to product.
+template<typename precision>
+class gaunt_table
+{
+public:
+  // Throws std::bad_alloc if the device allocations fail, and std::runtime_error if the copies fail.
+  explicit gaunt_table  (const unsigned int max_l) : max_l_(max_l)
+  {
+    const host_gaunt_table<precision> table(max_l_);
+    entry_count_ = table.entry_count();
+
+    if (cudaMalloc(reinterpret_cast<void**>(&entries_), entry_count_              * sizeof(gaunt_entry<precision>)) != cudaSuccess ||
+        cudaMalloc(reinterpret_cast<void**>(&offsets_), (coefficient_count() + 1) * sizeof(unsigned int)          ) != cudaSuccess)
+    {
+      release();
+      throw std::bad_alloc();
+    }
+    auto error = cudaMemcpy(entries_, table.entries(), entry_count_              * sizeof(gaunt_entry<precision>), cudaMemcpyHostToDevice);
+    if (error == cudaSuccess)
+      error    = cudaMemcpy(offsets_, table.offsets(), (coefficient_count() + 1) * sizeof(unsigned int)          , cudaMemcpyHostToDevice);
+    if (error != cudaSuccess)
+    {
+      release();
+      throw std::runtime_error(std::string("cush: gaunt_table: copying the entries failed: ") + cudaGetErrorString(error));
+    }
+  }
+  gaunt_table           (const gaunt_table&  that) = delete ;
+  gaunt_table           (      gaunt_table&& temp) : max_l_(temp.max_l_), entry_count_(temp.entry_count_), entries_(temp.entries_), offsets_(temp.offsets_)
+  {
+    temp.entry_count_ = 0;
+    temp.entries_     = nullptr;
+    temp.offsets_     = nullptr;
+  }
+ ~gaunt_table           ()
+  {
+    release();
+  }
+  gaunt_table& operator=(const gaunt_table&  that) = delete ;
+  gaunt_table& operator=(      gaunt_table&& temp) = delete ;
+
+  unsigned int                  max_l            () const
+  {
+    return max_l_;
+  }
+  unsigned int                  coefficient_count() const
+  {
+    return (max_l_ + 1) * (max_l_ + 1);
+  }
+  unsigned int                  entry_count      () const
+  {
+    return entry_count_;
+  }
+  const gaunt_entry<precision>* entries          () const
+  {
+    return entries_;
+  }
+  const unsigned int*           offsets          () const
+  {
+    return offsets_;
+  }
+
+protected:
+  void release()
+  {
+    if (entries_ != nullptr)
+      cudaFree(entries_);
+    if (offsets_ != nullptr)
+      cudaFree(offsets_);
+    entries_ = nullptr;
+    offsets_ = nullptr;
+  }
+
+  unsigned int            max_l_       = 0;
+  unsigned int            entry_count_ = 0;
+  gaunt_entry<precision>* entries_     = nullptr;
+  unsigned int*           offsets_     = nullptr;
+};
+// The table of max_l on the current device, built on first use and kept until exit. Thread-safe, and the tables of
+// different devices are distinct. Throws as the gaunt_table constructor, or std::runtime_error without a current device.
+template<typename precision>
+const gaunt_table<precision>& cached_gaunt_table(const unsigned int max_l)
+{
+  static std::map<std::pair<int, unsigned int>, std::unique_ptr<gaunt_table<precision>>> tables;
+  static std::mutex                                                                      mutex;
+
+  auto device = 0;
+  if (cudaGetDevice(&device) != cudaSuccess)
+    throw std::runtime_error("cush: cached_gaunt_table: there is no current device");
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& table = tables[std::make_pair(device, max_l)];
+  if (!table)
+    table.reset(new gaunt_table<precision>(max_l));
+  return *table;
+}
+#endif
+}
+
+#endif
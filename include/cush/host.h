@@ -0,0 +1,492 @@
+#ifndef CUSH_HOST_H_
+#define CUSH_HOST_H_
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include <cush/distance.h>
+#include <cush/gaunt.h>
+#include <cush/layout.h>
+#include <cush/math.h>
+#include <cush/portability.h>
+#include <cush/precision.h>
+#include <cush/spherical_harmonics.h>
+
+// The CPU backend, for nodes without a device. The per direction recurrences of for_each_harmonic are evaluated for a
+// batch of host_batch_size() directions at once, lane by lane in fixed size arrays, so that the compiler maps each step
+// to the vector units (e.g. 2 x 8 float lanes of AVX2 or 16 of AVX-512, depending on -march). The batched operations
+// mirror the semantics of the corresponding launchers and parallelize across voxels (or queries). The simd and parallel
+// for pragmas take effect when compiling with OpenMP (see the OPENMP option), and the loops run serially otherwise.
+namespace cush
+{
+namespace host
+{
+__forceinline__ constexpr unsigned int host_batch_size()
+{
+  return 16;
+}
+
+// Calls function(index, values) for every basis function up to max_l, values[lane] being its value at the direction
+// (thetas[lane], phis[lane]) of each of the host_batch_size() lanes. The recurrences are those of for_each_harmonic.
+template<typename precision, typename function_type>
+__forceinline__ void for_each_harmonic_batch(
+  const unsigned int max_l   ,
+  const precision*   thetas  ,
+  const precision*   phis    ,
+  function_type      function)
+{
+  constexpr auto lanes = host_batch_size();
+
+  const precision sqrt_2 = math::sqrt(precision(2));
+  alignas(64) precision x[lanes], y[lanes], cos_theta[lanes], cos_m[lanes], cos_m1[lanes], sin_m[lanes], sin_m1[lanes];
+  alignas(64) precision p_mm[lanes], p_l2m[lanes], p_l1m[lanes], p_lm[lanes], values[lanes];
+
+#pragma omp simd
+  for (auto lane = 0u; lane < lanes; lane++)
+  {
+    precision sin_theta;
+    math::sincos(thetas[lane], &sin_theta, &cos_theta[lane]);
+    x     [lane] = math::cos (phis[lane]);
+    y     [lane] = math::sqrt(precision(1) - x[lane] * x[lane]);
+    p_mm  [lane] = math::rsqrt(precision(4) * pi<precision>());
+    cos_m [lane] = 1;
+    cos_m1[lane] = cos_theta[lane];
+    sin_m [lane] = 0;
+    sin_m1[lane] = -sin_theta;
+  }
+
+  for (int m = 0; m <= int(max_l); m++)
+  {
+    if (m > 0)
+    {
+      const auto p_factor = -math::sqrt_ratio(precision(2 * m + 1), precision(2 * m));
+#pragma omp simd
+      for (auto lane = 0u; lane < lanes; lane++)
+      {
+        p_mm[lane] *= p_factor * y[lane];
+
+        auto cos_m2 = cos_m1[lane], sin_m2 = sin_m1[lane];
+        cos_m1[lane] = cos_m[lane];
+        sin_m1[lane] = sin_m[lane];
+        cos_m [lane] = 2 * cos_theta[lane] * cos_m1[lane] - cos_m2;
+        sin_m [lane] = 2 * cos_theta[lane] * sin_m1[lane] - sin_m2;
+      }
+    }
+
+#pragma omp simd
+    for (auto lane = 0u; lane < lanes; lane++)
+    {
+      p_l2m[lane] = 0;
+      p_l1m[lane] = 0;
+      p_lm [lane] = p_mm[lane];
+    }
+    for (int l = m; l <= int(max_l); l++)
+    {
+      if (l == m + 1)
+      {
+        const auto factor = math::sqrt(precision(2 * m + 3));
+#pragma omp simd
+        for (auto lane = 0u; lane < lanes; lane++)
+          p_lm[lane] = factor * x[lane] * p_l1m[lane];
+      }
+      else if (l > m + 1)
+      {
+        const auto factor      = math::sqrt_ratio(precision(4 * l * l - 1), precision(l * l - m * m));
+        const auto last_factor = math::sqrt_ratio(precision((l - 1) * (l - 1) - m * m), precision(4 * (l - 1) * (l - 1) - 1));
+#pragma omp simd
+        for (auto lane = 0u; lane < lanes; lane++)
+          p_lm[lane] = factor * (x[lane] * p_l1m[lane] - last_factor * p_l2m[lane]);
+      }
+
+      if (m == 0)
+        function(coefficient_index(l, 0), static_cast<const precision*>(p_lm));
+      else
+      {
+#pragma omp simd
+        for (auto lane = 0u; lane < lanes; lane++)
+          values[lane] = sqrt_2 * p_lm[lane] * cos_m[lane];
+        function(coefficient_index(l,  m), static_cast<const precision*>(values));
+#pragma omp simd
+        for (auto lane = 0u; lane < lanes; lane++)
+          values[lane] = sqrt_2 * p_lm[lane] * sin_m[lane];
+        function(coefficient_index(l, -m), static_cast<const precision*>(values));
+      }
+
+#pragma omp simd
+      for (auto lane = 0u; lane < lanes; lane++)
+      {
+        p_l2m[lane] = p_l1m[lane];
+        p_l1m[lane] = p_lm [lane];
+      }
+    }
+  }
+}
+// The sums of a batch of host_batch_size() directions, see evaluate_sum for the coefficients.
+template<typename precision, typename coefficients_type>
+void evaluate_sum_batch(
+  const unsigned int      max_l       ,
+  const precision*        thetas      ,
+  const precision*        phis        ,
+  const coefficients_type coefficients,
+  precision*              sums        )
+{
+#pragma omp simd
+  for (auto lane = 0u; lane < host_batch_size(); lane++)
+    sums[lane] = 0;
+  for_each_harmonic_batch(max_l, thetas, phis, [&] (const unsigned int index, const precision* values)
+  {
+    auto coefficient = convert<precision>(coefficients[index]);
+#pragma omp simd
+    for (auto lane = 0u; lane < host_batch_size(); lane++)
+      sums[lane] += values[lane] * coefficient;
+  });
+}
+// Calls function(offset, sum) for each of the direction_count sums. The last batch is padded with the pole.
+template<typename precision, typename coefficients_type, typename function_type>
+void for_each_sum(
+  const unsigned int      max_l          ,
+  const unsigned int      direction_count,
+  const precision*        thetas         ,
+  const precision*        phis           ,
+  const coefficients_type coefficients   ,
+  function_type           function       )
+{
+  constexpr auto lanes = host_batch_size();
+
+  alignas(64) precision batch_thetas[lanes], batch_phis[lanes], sums[lanes];
+  for (auto batch_offset = 0u; batch_offset < direction_count; batch_offset += lanes)
+  {
+    auto batch_count = direction_count - batch_offset < lanes ? direction_count - batch_offset : lanes;
+    for (auto lane = 0u; lane < lanes; lane++)
+    {
+      batch_thetas[lane] = lane < batch_count ? thetas[batch_offset + lane] : precision(0);
+      batch_phis  [lane] = lane < batch_count ? phis  [batch_offset + lane] : precision(0);
+    }
+    evaluate_sum_batch(max_l, batch_thetas, batch_phis, coefficients, sums);
+    for (auto lane = 0u; lane < batch_count; lane++)
+      function(batch_offset + lane, sums[lane]);
+  }
+}
+// The values of a single function at direction_count directions, in parallel over the batches.
+template<typename precision, typename coefficients_type>
+void evaluate_sums(
+  const unsigned int      max_l          ,
+  const unsigned int      direction_count,
+  const precision*        thetas         ,
+  const precision*        phis           ,
+  const coefficients_type coefficients   ,
+  precision*              values         )
+{
+  auto batch_count = int((direction_count + host_batch_size() - 1) / host_batch_size());
+#pragma omp parallel for schedule(static)
+  for (auto batch_index = 0; batch_index < batch_count; batch_index++)
+  {
+    auto batch_offset = unsigned(batch_index) * host_batch_size();
+    auto count        = direction_count - batch_offset < host_batch_size() ? direction_count - batch_offset : host_batch_size();
+    for_each_sum(max_l, count, thetas + batch_offset, phis + batch_offset, coefficients, [&] (const unsigned int offset, const precision& sum)
+    {
+      values[batch_offset + offset] = sum;
+    });
+  }
+}
+
+// As launch_sample_sums, on the tessellations.x x tessellations.y longitude-latitude grid of sample_sums.
+template<typename precision, typename point_type, coefficient_layout layout = coefficient_layout::aos>
+void sample_sums(
+  const uint3        dimensions       ,
+  const unsigned int coefficient_count,
+  const uint2        tessellations    ,
+  const precision*   coefficients     ,
+  point_type*        output_points    ,
+  unsigned int*      output_indices   ,
+  const unsigned int base_index       = 0   ,
+  const bool         normalize        = true)
+{
+  using value_type   = decltype(output_points[0].x);
+  using compute_type = compute_precision_t<precision>;
+
+  auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  auto points_size = tessellations.x * tessellations.y;
+  auto max_l       = maximum_degree(coefficient_count);
+
+  std::vector<compute_type> thetas(points_size), phis(points_size);
+  for (auto point_offset = 0u; point_offset < points_size; point_offset++)
+  {
+    thetas[point_offset] = compute_type(2 * pi<value_type>() * (point_offset / tessellations.y) /  tessellations.x);
+    phis  [point_offset] = compute_type(    pi<value_type>() * (point_offset % tessellations.y) / (tessellations.y - 1));
+  }
+
+#pragma omp parallel for schedule(dynamic)
+  for (auto volume_index = 0; volume_index < int(voxel_count); volume_index++)
+  {
+    auto points_offset = volume_index * points_size;
+    auto points        = output_points + points_offset;
+    auto maximum       = value_type(0);
+    for_each_sum(max_l, points_size, thetas.data(), phis.data(), voxel_coefficients<layout>(coefficients, voxel_count, coefficient_count, volume_index),
+    [&] (const unsigned int point_offset, const compute_type& sum)
+    {
+      auto& point = points[point_offset];
+      point.y = 2 * pi<value_type>() * (point_offset / tessellations.y) /  tessellations.x;
+      point.z =     pi<value_type>() * (point_offset % tessellations.y) / (tessellations.y - 1);
+      point.x = value_type(sum);
+      if (maximum < point.x)
+        maximum = point.x;
+
+      if (output_indices != nullptr)
+        sample_indices(tessellations, point_offset / tessellations.y, point_offset % tessellations.y, output_indices + 6 * points_offset, base_index + points_offset);
+    });
+
+    if (normalize)
+      for (auto point_offset = 0u; point_offset < points_size; point_offset++)
+        points[point_offset].x /= maximum;
+  }
+}
+
+// As launch_product, in parallel over the voxels.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void product(
+  const uint3                                             dimensions       ,
+  const host_gaunt_table<compute_precision_t<precision>>& table            ,
+  const precision*                                        lhs_coefficients ,
+  const precision*                                        rhs_coefficients ,
+  precision*                                              out_coefficients )
+{
+  auto voxel_count       = dimensions.x * dimensions.y * dimensions.z;
+  auto coefficient_count = table.coefficient_count();
+#pragma omp parallel for schedule(static)
+  for (auto volume_index = 0; volume_index < int(voxel_count); volume_index++)
+  {
+    auto lhs = voxel_coefficients<layout>(lhs_coefficients, voxel_count, coefficient_count, volume_index);
+    auto rhs = voxel_coefficients<layout>(rhs_coefficients, voxel_count, coefficient_count, volume_index);
+    for (auto out_index = 0u; out_index < coefficient_count; out_index++)
+      out_coefficients[layout_offset<layout>(voxel_count, coefficient_count, volume_index, out_index)] =
+        convert<precision>(product_coefficient(out_index, table.offsets(), table.entries(), lhs, rhs));
+  }
+}
+// Reads the couplings from the cached_host_gaunt_table of maximum_degree(coefficient_count).
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void product(
+  const uint3        dimensions       ,
+  const unsigned int coefficient_count,
+  const precision*   lhs_coefficients ,
+  const precision*   rhs_coefficients ,
+  precision*         out_coefficients )
+{
+  product<precision, layout>(dimensions, cached_host_gaunt_table<compute_precision_t<precision>>(maximum_degree(coefficient_count)),
+    lhs_coefficients, rhs_coefficients, out_coefficients);
+}
+
+// Factorizes the symmetric positive definite column-major size x size matrix into its lower Cholesky factor in place.
+// Returns false if the matrix is not positive definite.
+template<typename precision>
+bool cholesky_factorize(const unsigned int size, precision* matrix)
+{
+  for (auto column = 0u; column < size; column++)
+  {
+    auto diagonal = matrix[column + column * size];
+    for (auto index = 0u; index < column; index++)
+      diagonal -= matrix[column + index * size] * matrix[column + index * size];
+    if (!(diagonal > precision(0)))
+      return false;
+
+    diagonal = std::sqrt(diagonal);
+    matrix[column + column * size] = diagonal;
+    for (auto row = column + 1; row < size; row++)
+    {
+      auto value = matrix[row + column * size];
+#pragma omp simd reduction(-:value)
+      for (auto index = 0u; index < column; index++)
+        value -= matrix[row + index * size] * matrix[column + index * size];
+      matrix[row + column * size] = value / diagonal;
+    }
+  }
+  return true;
+}
+// Solves L L^T x = b in place, given the lower Cholesky factor L of cholesky_factorize.
+template<typename precision>
+void cholesky_solve(const unsigned int size, const precision* factor, precision* vector)
+{
+  for (auto row = 0u; row < size; row++)
+  {
+    auto value = vector[row];
+    for (auto index = 0u; index < row; index++)
+      value -= factor[row + index * size] * vector[index];
+    vector[row] = value / factor[row + row * size];
+  }
+  for (auto row = int(size) - 1; row >= 0; row--)
+  {
+    auto value = vector[row];
+    for (auto index = unsigned(row) + 1; index < size; index++)
+      value -= factor[index + row * size] * vector[index];
+    vector[row] = value / factor[row + row * size];
+  }
+}
+
+// The normal matrix A^T A + regularization * I and A^T of the vector_count x column_count basis matrix of a direction
+// set, the latter column-major column_count x vector_count.
+template<typename vector_type, typename precision>
+void calculate_normal_equations(
+  const unsigned int vector_count     ,
+  const unsigned int coefficient_count,
+  const vector_type* vectors          ,
+  const bool         even_only        ,
+  const precision    regularization   ,
+  precision*         normal_matrix    ,
+  precision*         transposed_matrix)
+{
+  auto column_count = matrix_column_count(coefficient_count, even_only);
+  for (auto vector_index = 0u; vector_index < vector_count; vector_index++)
+    calculate_matrix_row(vector_index, vector_count, coefficient_count, vectors[vector_index], transposed_matrix, even_only, matrix_layout::row_major);
+
+  for (auto column = 0u; column < column_count; column++)
+    for (auto row = column; row < column_count; row++)
+    {
+      auto value = row == column ? regularization : precision(0);
+#pragma omp simd reduction(+:value)
+      for (auto vector_index = 0u; vector_index < vector_count; vector_index++)
+        value += transposed_matrix[row + vector_index * column_count] * transposed_matrix[column + vector_index * column_count];
+      normal_matrix[row + column * column_count] = value;
+      normal_matrix[column + row * column_count] = value;
+    }
+}
+// Solves for the coefficients of a voxel given its samples and the factorized normal equations, scattering the even
+// degree solution if even_only. The coefficients of a voxel whose normal matrix is not positive definite are NaN.
+template<typename precision, typename compute_type>
+void solve_normal_equations(
+  const unsigned int  vector_count     ,
+  const unsigned int  coefficient_count,
+  const bool          even_only        ,
+  const bool          factorized       ,
+  const compute_type* factor           ,
+  const compute_type* transposed_matrix,
+  const precision*    samples          ,
+  compute_type*       solution         ,
+  precision*          coefficients     )
+{
+  auto column_count = matrix_column_count(coefficient_count, even_only);
+  for (auto column = 0u; column < column_count; column++)
+  {
+    auto value = compute_type(0);
+#pragma omp simd reduction(+:value)
+    for (auto vector_index = 0u; vector_index < vector_count; vector_index++)
+      value += transposed_matrix[column + vector_index * column_count] * convert<compute_type>(samples[vector_index]);
+    solution[column] = value;
+  }
+  if (factorized)
+    cholesky_solve(column_count, factor, solution);
+  else
+    for (auto column = 0u; column < column_count; column++)
+      solution[column] = std::numeric_limits<compute_type>::quiet_NaN();
+
+  for (auto coefficient_index = 0u; coefficient_index < coefficient_count; coefficient_index++)
+  {
+    auto lm = coefficient_lm(coefficient_index);
+    coefficients[coefficient_index] = convert<precision>(
+      !even_only     ? solution[coefficient_index]                 :
+      lm.x % 2 == 0  ? solution[even_coefficient_index(lm.x, lm.y)] : compute_type(0));
+  }
+}
+
+// As fitting_plan::fit, for voxel_count voxels sharing a single direction set. The normal matrix is factorized once.
+template<typename vector_type, typename precision>
+void fit(
+  const unsigned int                    vector_count     ,
+  const unsigned int                    coefficient_count,
+  const vector_type*                    vectors          ,
+  const unsigned int                    voxel_count      ,
+  const precision*                      samples          ,
+  precision*                            coefficients     ,
+  const bool                            even_only        = false,
+  const compute_precision_t<precision>  regularization   = compute_precision_t<precision>(0))
+{
+  using compute_type = compute_precision_t<precision>;
+
+  auto column_count = matrix_column_count(coefficient_count, even_only);
+  std::vector<compute_type> normal_matrix(column_count * column_count), transposed_matrix(column_count * vector_count);
+  calculate_normal_equations(vector_count, coefficient_count, vectors, even_only, regularization, normal_matrix.data(), transposed_matrix.data());
+  auto factorized = cholesky_factorize(column_count, normal_matrix.data());
+
+#pragma omp parallel for schedule(static)
+  for (auto volume_index = 0; volume_index < int(voxel_count); volume_index++)
+  {
+    std::vector<compute_type> solution(column_count);
+    solve_normal_equations(vector_count, coefficient_count, even_only, factorized, normal_matrix.data(), transposed_matrix.data(),
+      samples      + static_cast<size_t>(volume_index) * vector_count     , solution.data(),
+      coefficients + static_cast<size_t>(volume_index) * coefficient_count);
+  }
+}
+// As fit_batched, for voxels with a direction set per voxel, in parallel over the voxels.
+template<typename vector_type, typename precision>
+void fit_batched(
+  const uint3                          dimensions       ,
+  const unsigned int                   vector_count     ,
+  const unsigned int                   coefficient_count,
+  const vector_type*                   vectors          ,
+  const precision*                     samples          ,
+  precision*                           coefficients     ,
+  const bool                           even_only        = false,
+  const compute_precision_t<precision> regularization   = compute_precision_t<precision>(0))
+{
+  using compute_type = compute_precision_t<precision>;
+
+  auto voxel_count  = dimensions.x * dimensions.y * dimensions.z;
+  auto column_count = matrix_column_count(coefficient_count, even_only);
+#pragma omp parallel for schedule(dynamic)
+  for (auto volume_index = 0; volume_index < int(voxel_count); volume_index++)
+  {
+    std::vector<compute_type> normal_matrix(column_count * column_count), transposed_matrix(column_count * vector_count), solution(column_count);
+    calculate_normal_equations(vector_count, coefficient_count, vectors + static_cast<size_t>(volume_index) * vector_count, even_only, regularization, normal_matrix.data(), transposed_matrix.data());
+    auto factorized = cholesky_factorize(column_count, normal_matrix.data());
+    solve_normal_equations(vector_count, coefficient_count, even_only, factorized, normal_matrix.data(), transposed_matrix.data(),
+      samples      + static_cast<size_t>(volume_index) * vector_count     , solution.data(),
+      coefficients + static_cast<size_t>(volume_index) * coefficient_count);
+  }
+}
+
+// As launch_pairwise_distances, in parallel over the queries, vectorized over the coefficients.
+template<typename precision>
+void pairwise_distances(
+  const unsigned int              query_count      ,
+  const unsigned int              database_count   ,
+  const unsigned int              coefficient_count,
+  const precision*                queries          ,
+  const precision*                database         ,
+  compute_precision_t<precision>* distances        ,
+  const distance_metric           metric           = distance_metric::l2)
+{
+  using compute_type = compute_precision_t<precision>;
+
+#pragma omp parallel for schedule(static)
+  for (auto query_index = 0; query_index < int(query_count); query_index++)
+  {
+    auto query = queries + static_cast<size_t>(query_index) * coefficient_count;
+    for (auto database_index = 0u; database_index < database_count; database_index++)
+    {
+      auto vector = database + static_cast<size_t>(database_index) * coefficient_count;
+      auto value  = compute_type(0);
+      if (metric == distance_metric::l1)
+      {
+#pragma omp simd reduction(+:value)
+        for (auto index = 0u; index < coefficient_count; index++)
+          value += std::abs(convert<compute_type>(vector[index]) - convert<compute_type>(query[index]));
+      }
+      else
+      {
+#pragma omp simd reduction(+:value)
+        for (auto index = 0u; index < coefficient_count; index++)
+        {
+          auto difference = convert<compute_type>(vector[index]) - convert<compute_type>(query[index]);
+          value += difference * difference;
+        }
+        value = std::sqrt(value);
+      }
+      distances[database_index + static_cast<size_t>(database_count) * query_index] = value;
+    }
+  }
+}
+}
+}
+
+#endif
@@ -0,0 +1,565 @@
+#ifndef CUSH_ICOSPHERE_H_
+#define CUSH_ICOSPHERE_H_
+
+#define _USE_MATH_DEFINES
+
+#include <algorithm>
+#ifndef CUSH_CPU_ONLY
+#include <cuda_runtime_api.h>
+#include <device_launch_parameters.h>
+#endif
+#include <map>
+#include <math.h>
+#include <set>
+#include <utility>
+#include <vector>
+
+#ifndef CUSH_CPU_ONLY
+#include <cush/launch.h>
+#endif
+#include <cush/portability.h>
+#include <cush/profile.h>
+#include <cush/spherical_harmonics.h>
+
+// Sampling on a subdivided icosahedron as an alternative to the longitude-latitude grid of sample_sum. The points have
+// nearly equal areas, hence there is neither oversampling nor degenerate triangles at the poles.
+namespace cush
+{
+// Pads the neighbors of the 12 points with only 5 neighbors.
+constexpr unsigned int icosphere_no_neighbor    = 0xFFFFFFFF;
+constexpr unsigned int icosphere_neighbor_count = 6;
+
+// Subdivides each face of the icosahedron into frequency^2 triangles and projects their vertices onto the unit sphere,
+// yielding 10 frequency^2 + 2 directions in the (unused, theta, phi) layout of calculate_matrix, 20 frequency^2
+// triangles, icosphere_neighbor_count neighbors per point and the antipode of each point. The points are identified by
+// their integer barycentric weights on the icosahedron vertices, hence the points shared by faces are merged exactly and
+// the point set is exactly symmetric.
+template<typename vector_type>
+void calculate_icosphere(
+  const unsigned int         frequency ,
+  std::vector<vector_type>&  directions,
+  std::vector<unsigned int>& indices   ,
+  std::vector<unsigned int>& neighbors ,
+  std::vector<unsigned int>& antipodes )
+{
+  using key_type = std::vector<std::pair<unsigned int, unsigned int>>;
+
+  const double golden = (1.0 + sqrt(5.0)) / 2.0;
+  const double vertices[12][3] =
+  {
+    {-1, golden, 0}, { 1, golden, 0}, {-1, -golden, 0}, { 1, -golden, 0},
+    {0, -1, golden}, {0, 1, golden}, {0, -1, -golden}, {0, 1, -golden},
+    {golden, 0, -1}, {golden, 0, 1}, {-golden, 0, -1}, {-golden, 0, 1}
+  };
+  const unsigned int faces[20][3] =
+  {
+    {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+    {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+    {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+    {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+  };
+  unsigned int vertex_antipodes[12];
+  for (auto i = 0u; i < 12; i++)
+    for (auto j = 0u; j < 12; j++)
+      if (vertices[i][0] == -vertices[j][0] && vertices[i][1] == -vertices[j][1] && vertices[i][2] == -vertices[j][2])
+        vertex_antipodes[i] = j;
+
+  auto make_key = [&] (key_type key)
+  {
+    key.erase(std::remove_if(key.begin(), key.end(), [ ] (const std::pair<unsigned int, unsigned int>& entry) { return entry.second == 0; }), key.end());
+    std::sort(key.begin(), key.end());
+    return key;
+  };
+
+  std::map<key_type, unsigned int> points;
+  std::vector<key_type>            keys  ;
+  directions.clear();
+  indices   .clear();
+  for (auto& face : faces)
+  {
+    std::vector<unsigned int> face_points;
+    for (auto i = 0u; i <= frequency; i++)
+      for (auto j = 0u; j <= frequency - i; j++)
+      {
+        auto key       = make_key({{face[0], frequency - i - j}, {face[1], i}, {face[2], j}});
+        auto insertion = points.emplace(key, unsigned(keys.size()));
+        if (insertion.second)
+        {
+          double point[3] = {0.0, 0.0, 0.0};
+          for (auto& entry : key)
+            for (auto k = 0; k < 3; k++)
+              point[k] += entry.second * vertices[entry.first][k];
+
+          vector_type direction;
+          direction.x = 0;
+          direction.y = atan2(point[1], point[0]);
+          direction.z = acos (point[2] / sqrt(point[0] * point[0] + point[1] * point[1] + point[2] * point[2]));
+          if (direction.y < 0)
+            direction.y += 2 * M_PI;
+          directions.push_back(direction);
+          keys      .push_back(key);
+        }
+        face_points.push_back(insertion.first->second);
+      }
+
+    // The points of row i start at i (frequency + 1) - i (i - 1) / 2.
+    auto local = [&] (const unsigned int i, const unsigned int j)
+    {
+      return face_points[i * (frequency + 1) - i * (i - 1) / 2 + j];
+    };
+    for (auto i = 0u; i < frequency; i++)
+      for (auto j = 0u; j < frequency - i; j++)
+      {
+        indices.insert(indices.end(), {local(i, j), local(i + 1, j), local(i, j + 1)});
+        if (i + j + 1 < frequency)
+          indices.insert(indices.end(), {local(i + 1, j), local(i + 1, j + 1), local(i, j + 1)});
+      }
+  }
+
+  std::vector<std::set<unsigned int>> adjacency(directions.size());
+  for (auto i = 0u; i < indices.size(); i += 3)
+    for (auto k = 0u; k < 3; k++)
+    {
+      adjacency[indices[i + k]].insert(indices[i + (k + 1) % 3]);
+      adjacency[indices[i + (k + 1) % 3]].insert(indices[i + k]);
+    }
+  neighbors.assign(directions.size() * icosphere_neighbor_count, icosphere_no_neighbor);
+  for (auto i = 0u; i < adjacency.size(); i++)
+    std::copy(adjacency[i].begin(), adjacency[i].end(), neighbors.begin() + i * icosphere_neighbor_count);
+
+  antipodes.resize(directions.size());
+  for (auto i = 0u; i < keys.size(); i++)
+  {
+    auto key = keys[i];
+    for (auto& entry : key)
+      entry.first = vertex_antipodes[entry.first];
+    antipodes[i] = points.at(make_key(key));
+  }
+}
+
+// The topology of an icosphere, for extract_voxel_maxima.
+template<typename vector_type>
+struct mesh_topology
+{
+  __host__ __device__ unsigned int point_count      () const
+  {
+    return points_size;
+  }
+  template<typename precision>
+  __host__ __device__ void         direction        (const unsigned int offset, precision& theta, precision& phi) const
+  {
+    theta = directions[offset].y;
+    phi   = directions[offset].z;
+  }
+  template<typename function_type>
+  __host__ __device__ void         for_each_neighbor(const unsigned int offset, function_type function) const
+  {
+    for (auto index = 0u; index < icosphere_neighbor_count; index++)
+    {
+      auto neighbor_offset = neighbors[offset * icosphere_neighbor_count + index];
+      if (neighbor_offset != icosphere_no_neighbor)
+        function(neighbor_offset);
+    }
+  }
+  // The antipode is a point of the icosphere, its neighbors are included to discard the rounding-shifted peaks as well.
+  template<typename function_type>
+  __host__ __device__ void         for_each_antipode(const unsigned int offset, function_type function) const
+  {
+    function(antipodes[offset]);
+    for_each_neighbor(antipodes[offset], function);
+  }
+
+  unsigned int        points_size;
+  const vector_type*  directions ;
+  const unsigned int* neighbors  ;
+  const unsigned int* antipodes  ;
+};
+
+#ifndef CUSH_CPU_ONLY
+// Owns the device copies of the directions, triangle indices, neighbors and antipodes of calculate_icosphere.
+// Build once per frequency, pass to sample_sums or extract_maxima.
+template<typename vector_type>
+class icosphere
+{
+public:
+  explicit icosphere  (const unsigned int frequency) : frequency_(frequency)
+  {
+    std::vector<vector_type>  directions;
+    std::vector<unsigned int> indices   ;
+    std::vector<unsigned int> neighbors ;
+    std::vector<unsigned int> antipodes ;
+    calculate_icosphere(frequency_, directions, indices, neighbors, antipodes);
+
+    cudaMalloc(reinterpret_cast<void**>(&directions_), directions.size() * sizeof(vector_type ));
+    cudaMalloc(reinterpret_cast<void**>(&indices_   ), indices   .size() * sizeof(unsigned int));
+    cudaMalloc(reinterpret_cast<void**>(&neighbors_ ), neighbors .size() * sizeof(unsigned int));
+    cudaMalloc(reinterpret_cast<void**>(&antipodes_ ), antipodes .size() * sizeof(unsigned int));
+    cudaMemcpy(directions_, directions.data(), directions.size() * sizeof(vector_type ), cudaMemcpyHostToDevice);
+    cudaMemcpy(indices_   , indices   .data(), indices   .size() * sizeof(unsigned int), cudaMemcpyHostToDevice);
+    cudaMemcpy(neighbors_ , neighbors .data(), neighbors .size() * sizeof(unsigned int), cudaMemcpyHostToDevice);
+    cudaMemcpy(antipodes_ , antipodes .data(), antipodes .size() * sizeof(unsigned int), cudaMemcpyHostToDevice);
+  }
+  icosphere           (const icosphere&  that) = delete ;
+  icosphere           (      icosphere&& temp) : frequency_(temp.frequency_), directions_(temp.directions_), indices_(temp.indices_), neighbors_(temp.neighbors_), antipodes_(temp.antipodes_)
+  {
+    temp.directions_ = nullptr;
+    temp.indices_    = nullptr;
+    temp.neighbors_  = nullptr;
+    temp.antipodes_  = nullptr;
+  }
+ ~icosphere           ()
+  {
+    if (directions_ != nullptr)
+      cudaFree(directions_);
+    if (indices_ != nullptr)
+      cudaFree(indices_);
+    if (neighbors_ != nullptr)
+      cudaFree(neighbors_);
+    if (antipodes_ != nullptr)
+      cudaFree(antipodes_);
+  }
+  icosphere& operator=(const icosphere&  that) = delete ;
+  icosphere& operator=(      icosphere&& temp) = delete ;
+
+  unsigned int               frequency     () const
+  {
+    return frequency_;
+  }
+  unsigned int               point_count   () const
+  {
+    return 10 * frequency_ * frequency_ + 2;
+  }
+  unsigned int               triangle_count() const
+  {
+    return 20 * frequency_ * frequency_;
+  }
+  unsigned int               index_count   () const
+  {
+    return 3 * triangle_count();
+  }
+  const vector_type*         directions    () const
+  {
+    return directions_;
+  }
+  const unsigned int*        indices       () const
+  {
+    return indices_;
+  }
+  const unsigned int*        neighbors     () const
+  {
+    return neighbors_;
+  }
+  const unsigned int*        antipodes     () const
+  {
+    return antipodes_;
+  }
+  mesh_topology<vector_type> topology      () const
+  {
+    return {point_count(), directions_, neighbors_, antipodes_};
+  }
+
+protected:
+  unsigned int  frequency_  = 0;
+  vector_type*  directions_ = nullptr;
+  unsigned int* indices_    = nullptr;
+  unsigned int* neighbors_  = nullptr;
+  unsigned int* antipodes_  = nullptr;
+};
+
+// Call on a point_count 1D grid.
+template<typename vector_type, typename point_type>
+__global__ void sample(
+  const unsigned int l            ,
+  const int          m            ,
+  const unsigned int point_count  ,
+  const vector_type* directions   ,
+  point_type*        output_points)
+{
+  auto point_offset = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (point_offset >= point_count)
+    return;
+
+  auto& point = output_points[point_offset];
+  point.y = directions[point_offset].y;
+  point.z = directions[point_offset].z;
+  point.x = evaluate(l, m, point.y, point.z);
+}
+// Call on a point_count 1D grid.
+template<typename precision, typename vector_type, typename point_type>
+__global__ void sample_sum(
+  const unsigned int coefficient_count,
+  const unsigned int point_count      ,
+  const vector_type* directions       ,
+  const precision*   coefficients     ,
+  point_type*        output_points    )
+{
+  auto point_offset = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (point_offset >= point_count)
+    return;
+
+  auto& point = output_points[point_offset];
+  point.y = directions[point_offset].y;
+  point.z = directions[point_offset].z;
+  point.x = evaluate_sum(maximum_degree(coefficient_count), compute_precision_t<precision>(point.y), compute_precision_t<precision>(point.z), coefficients);
+}
+
+// Samples the points of one voxel on an icosphere with the threads of a block, sum(theta, phi) evaluating the voxel's
+// function, and writes the triangle indices offset by base_index.
+template<typename vector_type, typename point_type, typename sum_type>
+__device__ void sample_mesh_voxel(
+  const unsigned int  point_count   ,
+  const vector_type*  directions    ,
+  const unsigned int  index_count   ,
+  const unsigned int* indices       ,
+  point_type*         output_points ,
+  unsigned int*       output_indices,
+  const unsigned int  base_index    ,
+  const bool          normalize     ,
+  sum_type            sum           )
+{
+  using value_type = decltype(output_points[0].x);
+
+  auto maximum = value_type(0);
+  for (auto point_offset = threadIdx.x; point_offset < point_count; point_offset += blockDim.x)
+  {
+    auto& point = output_points[point_offset];
+    point.y = directions[point_offset].y;
+    point.z = directions[point_offset].z;
+    point.x = sum(point.y, point.z);
+    if (maximum < point.x)
+      maximum = point.x;
+  }
+
+  if (output_indices != nullptr)
+    for (auto index = threadIdx.x; index < index_count; index += blockDim.x)
+      output_indices[index] = base_index + indices[index];
+
+  if (normalize)
+    normalize_voxel(point_count, output_points, maximum);
+}
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel.
+template<typename precision, typename vector_type, typename point_type, coefficient_layout layout = coefficient_layout::aos>
+__global__ void sample_sums(
+  const uint3         dimensions       ,
+  const unsigned int  coefficient_count,
+  const unsigned int  point_count      ,
+  const vector_type*  directions       ,
+  const unsigned int  index_count      ,
+  const unsigned int* indices          ,
+  const precision*    coefficients     ,
+  point_type*         output_points    ,
+  unsigned int*       output_indices   ,
+  const unsigned int  base_index       = 0   ,
+  const bool          normalize        = true)
+{
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
+    return;
+
+  auto voxel = voxel_coefficients<layout>(coefficients, dimensions.x * dimensions.y * dimensions.z, coefficient_count, volume_index);
+  auto max_l = maximum_degree(coefficient_count);
+
+  sample_mesh_voxel(
+    point_count ,
+    directions  ,
+    index_count ,
+    indices     ,
+    output_points  + volume_index * point_count,
+    output_indices != nullptr ? output_indices + volume_index * index_count : nullptr,
+    base_index     + volume_index * point_count,
+    normalize   ,
+    [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+    {
+      return evaluate_sum(max_l, theta, phi, voxel);
+    });
+}
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel.
+template<unsigned int max_l, typename precision, typename vector_type, typename point_type, coefficient_layout layout = coefficient_layout::aos>
+__global__ void sample_sums(
+  const uint3         dimensions       ,
+  const unsigned int  point_count      ,
+  const vector_type*  directions       ,
+  const unsigned int  index_count      ,
+  const unsigned int* indices          ,
+  const precision*    coefficients     ,
+  point_type*         output_points    ,
+  unsigned int*       output_indices   ,
+  const unsigned int  base_index       = 0   ,
+  const bool          normalize        = true)
+{
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
+    return;
+
+  compute_precision_t<precision> voxel[coefficient_count(max_l)];
+  load_coefficients<max_l>(voxel_coefficients<layout>(coefficients, dimensions.x * dimensions.y * dimensions.z, coefficient_count(max_l), volume_index), voxel);
+
+  sample_mesh_voxel(
+    point_count ,
+    directions  ,
+    index_count ,
+    indices     ,
+    output_points  + volume_index * point_count,
+    output_indices != nullptr ? output_indices + volume_index * index_count : nullptr,
+    base_index     + volume_index * point_count,
+    normalize   ,
+    [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+    {
+      return evaluate_sum<max_l>(theta, phi, voxel);
+    });
+}
+
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel, with
+// extract_maxima_shared_size<compute_precision_t<precision>>(topology.point_count()) bytes of dynamic shared memory.
+template<typename precision, typename vector_type, typename maxima_type, coefficient_layout layout = coefficient_layout::aos>
+__global__ void extract_maxima(
+  const uint3                      dimensions       ,
+  const unsigned int               coefficient_count,
+  const precision*                 coefficients     ,
+  const mesh_topology<vector_type> topology         ,
+  const unsigned int               maxima_count     ,
+  maxima_type*                     maxima           ,
+  const bool                       local_maxima     = false,
+  const bool                       antipodal        = false)
+{
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
+    return;
+
+  auto voxel = voxel_coefficients<layout>(coefficients, dimensions.x * dimensions.y * dimensions.z, coefficient_count, volume_index);
+  auto max_l = maximum_degree(coefficient_count);
+
+  extract_voxel_maxima<compute_precision_t<precision>>(
+    topology    ,
+    maxima_count,
+    local_maxima,
+    antipodal   ,
+    maxima + volume_index * maxima_count,
+    [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+    {
+      return evaluate_sum(max_l, theta, phi, voxel);
+    });
+}
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel, with
+// extract_maxima_shared_size<compute_precision_t<precision>>(topology.point_count()) bytes of dynamic shared memory.
+template<unsigned int max_l, typename precision, typename vector_type, typename maxima_type, coefficient_layout layout = coefficient_layout::aos>
+__global__ void extract_maxima(
+  const uint3                      dimensions  ,
+  const precision*                 coefficients,
+  const mesh_topology<vector_type> topology    ,
+  const unsigned int               maxima_count,
+  maxima_type*                     maxima      ,
+  const bool                       local_maxima = false,
+  const bool                       antipodal    = false)
+{
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
+    return;
+
+  compute_precision_t<precision> voxel[coefficient_count(max_l)];
+  load_coefficients<max_l>(voxel_coefficients<layout>(coefficients, dimensions.x * dimensions.y * dimensions.z, coefficient_count(max_l), volume_index), voxel);
+
+  extract_voxel_maxima<compute_precision_t<precision>>(
+    topology    ,
+    maxima_count,
+    local_maxima,
+    antipodal   ,
+    maxima + volume_index * maxima_count,
+    [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+    {
+      return evaluate_sum<max_l>(theta, phi, voxel);
+    });
+}
+
+template<typename precision, typename vector_type, typename point_type, coefficient_layout layout = coefficient_layout::aos>
+void launch_sample_sums(
+  const uint3                   dimensions       ,
+  const unsigned int            coefficient_count,
+  const icosphere<vector_type>& sphere           ,
+  const precision*              coefficients     ,
+  point_type*                   output_points    ,
+  unsigned int*                 output_indices   ,
+  const unsigned int            base_index       = 0   ,
+  const bool                    normalize        = true,
+  cudaStream_t                  stream           = nullptr)
+{
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("icosphere_sample_sums", stream, voxel_count,
+    static_cast<size_t>(voxel_count) * (coefficient_count * sizeof(precision) + sphere.point_count() * sizeof(point_type) + sphere.index_count() * sizeof(unsigned int)));
+  profile_zero_voxels<layout>(profile, voxel_count, coefficient_count, coefficients);
+  auto grid = block_grid(dimensions.x * dimensions.y * dimensions.z);
+  if (!dispatch_max_l(maximum_degree(coefficient_count), [&] (auto degree)
+  {
+    launch_1d(sample_sums<decltype(degree)::value, precision, vector_type, point_type, layout>, grid, 0, stream,
+      dimensions           ,
+      sphere.point_count() ,
+      sphere.directions()  ,
+      sphere.index_count() ,
+      sphere.indices()     ,
+      coefficients         ,
+      output_points        ,
+      output_indices       ,
+      base_index           ,
+      normalize            );
+  }))
+    launch_1d(sample_sums<precision, vector_type, point_type, layout>, grid, 0, stream,
+      dimensions           ,
+      coefficient_count    ,
+      sphere.point_count() ,
+      sphere.directions()  ,
+      sphere.index_count() ,
+      sphere.indices()     ,
+      coefficients         ,
+      output_points        ,
+      output_indices       ,
+      base_index           ,
+      normalize            );
+}
+template<typename precision, typename vector_type, typename maxima_type, coefficient_layout layout = coefficient_layout::aos>
+void launch_extract_maxima(
+  const uint3                   dimensions       ,
+  const unsigned int            coefficient_count,
+  const precision*              coefficients     ,
+  const icosphere<vector_type>& sphere           ,
+  const unsigned int            maxima_count     ,
+  maxima_type*                  maxima           ,
+  const bool                    local_maxima     = false,
+  const bool                    antipodal        = false,
+  cudaStream_t                  stream           = nullptr)
+{
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("icosphere_extract_maxima", stream, voxel_count, static_cast<size_t>(voxel_count) * (coefficient_count * sizeof(precision) + maxima_count * sizeof(maxima_type)));
+  profile_zero_voxels<layout>(profile, voxel_count, coefficient_count, coefficients);
+  auto grid        = block_grid(dimensions.x * dimensions.y * dimensions.z);
+  auto shared_size = extract_maxima_shared_size<compute_precision_t<precision>>(sphere.point_count());
+  if (!dispatch_max_l(maximum_degree(coefficient_count), [&] (auto degree)
+  {
+    launch_1d(extract_maxima<decltype(degree)::value, precision, vector_type, maxima_type, layout>, grid, shared_size, stream,
+      dimensions       ,
+      coefficients     ,
+      sphere.topology(),
+      maxima_count     ,
+      maxima           ,
+      local_maxima     ,
+      antipodal        );
+  }))
+    launch_1d(extract_maxima<precision, vector_type, maxima_type, layout>, grid, shared_size, stream,
+      dimensions       ,
+      coefficient_count,
+      coefficients     ,
+      sphere.topology(),
+      maxima_count     ,
+      maxima           ,
+      local_maxima     ,
+      antipodal        );
+}
+#endif
+}
+
+#endif
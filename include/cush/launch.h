@@ -1,7 +1,17 @@
 #ifndef CUSH_LAUNCH_H_
 #define CUSH_LAUNCH_H_
 
-#include <vector_types.h>
+#include <cstddef>
+#ifndef CUSH_CPU_ONLY
+#include <cuda_runtime.h>
+#endif
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+#include <cush/portability.h>
 
 namespace cush
 {
@@ -41,6 +51,277 @@ __forceinline__ __host__ __device__ dim3     grid_size_3d(dim3     target_dimens
     unsigned((target_dimensions.z + block_size.z - 1) / block_size.z)
   };
 }
+
+__forceinline__ __host__ __device__ unsigned grid_size_1d(unsigned target_dimension , unsigned block_size)
+{
+  return unsigned((target_dimension + block_size - 1) / block_size);
+}
+__forceinline__ __host__ __device__ dim3     grid_size_2d(dim3     target_dimensions, dim3     block_size)
+{
+  return {
+    unsigned((target_dimensions.x + block_size.x - 1) / block_size.x),
+    unsigned((target_dimensions.y + block_size.y - 1) / block_size.y),
+    1u
+  };
+}
+// Shapes a 1D block size into a 2D block of full warps along x.
+__forceinline__ __host__ __device__ dim3     block_shape_2d(unsigned block_size)
+{
+  return {32, block_size > 32 ? block_size / 32 : 1u, 1};
+}
+
+// How the launchers of the library choose the block sizes of their kernels.
+enum class launch_policy
+{
+  fixed    , // block_size_1d() and block_size_2d() for every kernel.
+  occupancy, // The block size of maximum occupancy per kernel, by cudaOccupancyMaxPotentialBlockSize.
+  autotune   // The fastest of autotune_block_sizes per kernel, timed at its first launch per device and problem size.
+};
+// The autotuning candidates, multiples of the warp size as required by the block reductions.
+constexpr unsigned autotune_block_sizes[] = {64, 128, 256, 512, 1024};
+
+inline launch_policy& current_launch_policy()
+{
+  static launch_policy policy = launch_policy::occupancy;
+  return policy;
+}
+// Not thread-safe with respect to concurrent launches.
+inline void           set_launch_policy    (const launch_policy policy)
+{
+  current_launch_policy() = policy;
+}
+
+// The autotunings of the calling thread so far, e.g. for a profile_scope to discard the timing of an autotuned launch.
+inline unsigned long long& autotune_count()
+{
+  static thread_local unsigned long long count = 0;
+  return count;
+}
+
+// The autotuning results are cached per power of two of the problem size (the threads or blocks of a launch), since
+// the fastest block size of a kernel depends on how many waves its grid fills.
+inline unsigned autotune_size_class(size_t problem_size)
+{
+  auto size_class = 0u;
+  while (problem_size > 1)
+  {
+    problem_size >>= 1;
+    size_class++;
+  }
+  return size_class;
+}
+
+template<typename type>
+const void* argument_address(const type&         )
+{
+  return nullptr;
+}
+template<typename type>
+const void* argument_address(type* const& pointer)
+{
+  return pointer;
+}
+// Whether two non-null pointer arguments of a launch are equal, e.g. an in-place call with input == output. The
+// autotuning launches of such a launch would read their own outputs, hence it is never autotuned.
+template<typename... argument_types>
+bool arguments_alias(const argument_types&... arguments)
+{
+  const void* addresses[] = {argument_address(arguments)..., nullptr};
+  for (size_t i = 0; i < sizeof...(arguments); i++)
+    for (size_t j = i + 1; j < sizeof...(arguments); j++)
+      if (addresses[i] != nullptr && addresses[i] == addresses[j])
+        return true;
+  return false;
+}
+
+// The grids of launch_1d, as functions of the block size.
+inline auto thread_grid(const unsigned thread_count)
+{
+  return [=] (const unsigned block_size) { return grid_size_1d(thread_count, block_size); };
+}
+inline auto block_grid (const unsigned block_count )
+{
+  return [=] (const unsigned)            { return block_count; };
+}
+
+#ifndef CUSH_CPU_ONLY
+// The block size of kernel under the current policy, cached per device, kernel, shared memory size, policy and
+// autotune_size_class of problem_size. Falls back to fallback for the fixed policy and whenever the runtime queries fail.
+// The autotuning launches run (a function of the block size) on stream a few times per candidate, hence launches which
+// are not repeatable (e.g. in-place updates, or aliasing inputs and outputs) use the occupancy policy instead. Autotuning
+// synchronizes stream, and is skipped (uncached) while an error of the application is pending, which it leaves pending.
+// The errors of the autotuning launches themselves are cleared, disqualifying their candidates.
+template<typename kernel_type, typename run_type>
+unsigned select_block_size(
+  kernel_type     kernel      ,
+  const size_t    shared_size ,
+  const size_t    problem_size,
+  cudaStream_t    stream      ,
+  const run_type& run         ,
+  const bool      repeatable  = true,
+  const unsigned  fallback    = block_size_1d())
+{
+  auto policy = current_launch_policy();
+  if (policy == launch_policy::autotune && !repeatable)
+    policy = launch_policy::occupancy;
+  if (policy == launch_policy::fixed)
+    return fallback;
+
+  int device = 0;
+  if (cudaGetDevice(&device) != cudaSuccess)
+    return fallback;
+
+  using key_type = std::tuple<int, const void*, size_t, launch_policy, unsigned>;
+  static std::map<key_type, unsigned> cache;
+  static std::mutex                   mutex;
+
+  // The lock is not held while tuning, concurrent first launches tune redundantly and keep the first result.
+  const key_type key(device, reinterpret_cast<const void*>(kernel), shared_size, policy, autotune_size_class(problem_size));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iterator = cache.find(key);
+    if (iterator != cache.end())
+      return iterator->second;
+  }
+
+  auto block_size = fallback;
+  if (policy == launch_policy::occupancy)
+  {
+    int minimum_grid_size, occupancy_block_size;
+    if (cudaOccupancyMaxPotentialBlockSize(&minimum_grid_size, &occupancy_block_size, kernel, shared_size) == cudaSuccess && occupancy_block_size > 0)
+      block_size = unsigned(occupancy_block_size);
+  }
+  else
+  {
+    // The preceding launches on stream complete first, so that their errors are not taken for those of the candidates.
+    if (cudaStreamSynchronize(stream) != cudaSuccess || cudaPeekAtLastError() != cudaSuccess)
+      return fallback;
+    autotune_count()++;
+
+    cudaFuncAttributes attributes;
+    cudaEvent_t        start, stop;
+    if (cudaFuncGetAttributes(&attributes, kernel) == cudaSuccess &&
+        cudaEventCreate      (&start)              == cudaSuccess &&
+        cudaEventCreate      (&stop )              == cudaSuccess)
+    {
+      auto best_time = 0.0F;
+      for (auto candidate : autotune_block_sizes)
+      {
+        if (candidate > unsigned(attributes.maxThreadsPerBlock))
+          break;
+
+        // The first launch includes the module loading and is not timed.
+        run(candidate);
+        cudaEventRecord(start, stream);
+        for (auto repetition = 0; repetition < 3; repetition++)
+          run(candidate);
+        cudaEventRecord(stop , stream);
+        cudaEventSynchronize(stop);
+
+        if (cudaPeekAtLastError() != cudaSuccess)
+        {
+          cudaGetLastError();
+          continue;
+        }
+        auto time = 0.0F;
+        if (cudaEventElapsedTime(&time, start, stop) == cudaSuccess && (best_time == 0.0F || time < best_time))
+        {
+          best_time  = time;
+          block_size = candidate;
+        }
+      }
+      cudaEventDestroy(stop );
+      cudaEventDestroy(start);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return cache.emplace(key, block_size).first->second;
+}
+
+// The dynamic shared memory a kernel may use without opting in.
+constexpr size_t default_shared_size = 48 * 1024;
+
+// Opts kernel in to shared_size bytes of dynamic shared memory beyond default_shared_size, up to the maximum of the
+// current device, so that its launches do not fail silently. Throws std::runtime_error if the device does not provide
+// shared_size bytes (in addition to the static shared memory of the kernel).
+template<typename kernel_type>
+void reserve_shared_memory(
+  kernel_type  kernel     ,
+  const size_t shared_size)
+{
+  if (shared_size <= default_shared_size)
+    return;
+
+  int                device = 0, maximum_size = 0;
+  cudaFuncAttributes attributes;
+  if (cudaGetDevice         (&device)                                                          != cudaSuccess ||
+      cudaDeviceGetAttribute(&maximum_size, cudaDevAttrMaxSharedMemoryPerBlockOptin, device) != cudaSuccess ||
+      cudaFuncGetAttributes (&attributes, kernel)                                             != cudaSuccess)
+    throw std::runtime_error("cush: the shared memory limits of the device could not be queried.");
+  if (shared_size + attributes.sharedSizeBytes > size_t(maximum_size))
+    throw std::runtime_error("cush: a kernel requires " + std::to_string(shared_size + attributes.sharedSizeBytes) +
+      " bytes of shared memory per block, the device provides " + std::to_string(maximum_size) + ".");
+  if (cudaFuncSetAttribute(kernel, cudaFuncAttributeMaxDynamicSharedMemorySize, int(shared_size)) != cudaSuccess)
+    throw std::runtime_error("cush: the dynamic shared memory of a kernel could not be raised to " + std::to_string(shared_size) + " bytes.");
+}
+
+// Launches kernel on grid(block_size) 1D blocks of the block size chosen by the current launch policy, e.g.
+// launch_1d(kernel, thread_grid(count), 0, stream, arguments...) for a count 1D grid and
+// launch_1d(kernel, block_grid(count), shared_size, stream, arguments...) for a block per item. Reserves the shared_size
+// of the kernel (see reserve_shared_memory), i.e. throws instead of failing to launch. Launches of aliasing pointer
+// arguments (see arguments_alias) are not autotuned.
+template<typename kernel_type, typename grid_type, typename... argument_types>
+void launch_1d(
+  kernel_type              kernel     ,
+  const grid_type&         grid       ,
+  const size_t             shared_size,
+  cudaStream_t             stream     ,
+  const argument_types&... arguments  )
+{
+  auto run = [&] (const unsigned block_size)
+  {
+    kernel<<<grid(block_size), block_size, shared_size, stream>>>(arguments...);
+  };
+  reserve_shared_memory(kernel, shared_size);
+  run(select_block_size(kernel, shared_size, grid(1u), stream, run, !arguments_alias(arguments...)));
+}
+// As launch_1d, for kernels whose repeated launches change their outputs, which are never autotuned.
+template<typename kernel_type, typename grid_type, typename... argument_types>
+void launch_1d_in_place(
+  kernel_type              kernel     ,
+  const grid_type&         grid       ,
+  const size_t             shared_size,
+  cudaStream_t             stream     ,
+  const argument_types&... arguments  )
+{
+  auto run = [&] (const unsigned block_size)
+  {
+    kernel<<<grid(block_size), block_size, shared_size, stream>>>(arguments...);
+  };
+  reserve_shared_memory(kernel, shared_size);
+  run(select_block_size(kernel, shared_size, grid(1u), stream, run, false));
+}
+// Launches kernel on a target_dimensions 2D grid of block_shape_2d blocks of the block size chosen by the current
+// launch policy, in place of block_size_2d() whose 1024 threads are often register-limited.
+template<typename kernel_type, typename... argument_types>
+void launch_2d(
+  kernel_type              kernel           ,
+  const dim3               target_dimensions,
+  const size_t             shared_size      ,
+  cudaStream_t             stream           ,
+  const argument_types&... arguments        )
+{
+  auto run = [&] (const unsigned block_size)
+  {
+    auto block_shape = block_shape_2d(block_size);
+    kernel<<<grid_size_2d(target_dimensions, block_shape), block_shape, shared_size, stream>>>(arguments...);
+  };
+  auto fallback = block_size_2d();
+  reserve_shared_memory(kernel, shared_size);
+  run(select_block_size(kernel, shared_size, size_t(target_dimensions.x) * target_dimensions.y, stream, run, !arguments_alias(arguments...), fallback.x * fallback.y));
+}
+#endif
 }
 
 #endif
@@ -0,0 +1,161 @@
+#ifndef CUSH_LAYOUT_H_
+#define CUSH_LAYOUT_H_
+
+#include <cstddef>
+#ifndef CUSH_CPU_ONLY
+#include <cuda_runtime_api.h>
+#include <device_launch_parameters.h>
+#endif
+#include <type_traits>
+#include <utility>
+
+#include <cush/portability.h>
+#ifndef CUSH_CPU_ONLY
+#include <cush/launch.h>
+#endif
+#include <cush/profile.h>
+
+// Storage orders of the coefficients of a volume, i.e. of voxel_count x coefficient_count values. The voxel index itself
+// is linear and not interpreted by the kernels, hence e.g. NIfTI's x-fastest x + dimensions.x * (y + dimensions.y * z)
+// order can be used as is.
+namespace cush
+{
+enum class coefficient_layout
+{
+  aos  , // Voxel-major, i.e. the coefficients of a voxel are contiguous. The layout of the kernels without a layout.
+  soa  , // Coefficient-major, i.e. a coefficient of consecutive voxels is contiguous, so that the loads of threads owning
+         // neighboring voxels coalesce.
+  aosoa  // Tiles of layout_tile_size() voxels, coefficient-major within a tile. Coalesces as soa, while the coefficients
+         // of a voxel (and of a range of tiles) stay within a contiguous range.
+};
+
+__forceinline__ __host__ __device__ constexpr unsigned int layout_tile_size()
+{
+  return 32;
+}
+
+// The number of values of a voxel_count x coefficient_count array, including the padding of the last aosoa tile.
+template<coefficient_layout layout>
+__forceinline__ __host__ __device__ size_t layout_size(
+  const unsigned int voxel_count      ,
+  const unsigned int coefficient_count)
+{
+  return layout == coefficient_layout::aosoa
+    ? static_cast<size_t>((voxel_count + layout_tile_size() - 1) / layout_tile_size()) * layout_tile_size() * coefficient_count
+    : static_cast<size_t>(voxel_count) * coefficient_count;
+}
+template<coefficient_layout layout>
+__forceinline__ __host__ __device__ size_t layout_offset(
+  const unsigned int voxel_count      ,
+  const unsigned int coefficient_count,
+  const unsigned int voxel_index      ,
+  const unsigned int coefficient_index)
+{
+  return
+    layout == coefficient_layout::aos ? static_cast<size_t>(voxel_index      ) * coefficient_count + coefficient_index :
+    layout == coefficient_layout::soa ? static_cast<size_t>(coefficient_index) * voxel_count       + voxel_index       :
+    (static_cast<size_t>(voxel_index / layout_tile_size()) * coefficient_count + coefficient_index) * layout_tile_size() + voxel_index % layout_tile_size();
+}
+// The (voxel index, coefficient index) at an offset, i.e. the inverse of layout_offset. The voxel index of the aosoa
+// padding is beyond voxel_count.
+template<coefficient_layout layout>
+__forceinline__ __host__ __device__ uint2  layout_position(
+  const unsigned int voxel_count      ,
+  const unsigned int coefficient_count,
+  const size_t       offset           )
+{
+  if (layout == coefficient_layout::aos)
+    return {unsigned(offset / coefficient_count), unsigned(offset % coefficient_count)};
+  if (layout == coefficient_layout::soa)
+    return {unsigned(offset % voxel_count), unsigned(offset / voxel_count)};
+
+  auto tile_size   = static_cast<size_t>(layout_tile_size()) * coefficient_count;
+  auto tile_offset = offset % tile_size;
+  return {unsigned(offset / tile_size * layout_tile_size() + tile_offset % layout_tile_size()), unsigned(tile_offset / layout_tile_size())};
+}
+
+// An array of the given stride, e.g. the coefficients of a voxel in any layout.
+template<typename type>
+struct strided_array
+{
+  __forceinline__ __host__ __device__ type& operator[](const size_t index) const
+  {
+    return data[index * stride];
+  }
+
+  type*  data  ;
+  size_t stride;
+};
+// The element type of a pointer or a strided_array.
+template<typename array_type>
+using array_value_t = std::remove_cv_t<std::remove_reference_t<decltype(std::declval<array_type>()[0])>>;
+
+// The coefficients of a voxel: a plain pointer for aos, whose contiguous loads need no stride, else a strided_array.
+template<coefficient_layout layout, typename type>
+using voxel_array_t = std::conditional_t<layout == coefficient_layout::aos, type*, strided_array<type>>;
+
+template<typename type>
+__forceinline__ __host__ __device__ type*               make_voxel_array(type* data, const size_t       , std::true_type )
+{
+  return data;
+}
+template<typename type>
+__forceinline__ __host__ __device__ strided_array<type> make_voxel_array(type* data, const size_t stride, std::false_type)
+{
+  return {data, stride};
+}
+
+template<coefficient_layout layout, typename type>
+__forceinline__ __host__ __device__ voxel_array_t<layout, type> voxel_coefficients(
+  type*              coefficients     ,
+  const unsigned int voxel_count      ,
+  const unsigned int coefficient_count,
+  const unsigned int voxel_index      )
+{
+  return make_voxel_array(
+    coefficients + layout_offset<layout>(voxel_count, coefficient_count, voxel_index, 0),
+    layout == coefficient_layout::soa ? voxel_count : layout_tile_size(),
+    std::integral_constant<bool, layout == coefficient_layout::aos>());
+}
+
+#ifndef CUSH_CPU_ONLY
+// Call on a layout_size<output_layout>(voxel_count, coefficient_count) 1D grid.
+// Consecutive threads write consecutive output values, the padding of an aosoa output is zeroed.
+template<coefficient_layout input_layout, coefficient_layout output_layout, typename precision>
+__global__ void convert_layout(
+  const unsigned int voxel_count      ,
+  const unsigned int coefficient_count,
+  const precision*   input            ,
+  precision*         output           )
+{
+  auto global_index = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+
+  if (global_index >= layout_size<output_layout>(voxel_count, coefficient_count))
+    return;
+
+  auto position = layout_position<output_layout>(voxel_count, coefficient_count, global_index);
+  output[global_index] = position.x < voxel_count
+    ? input[layout_offset<input_layout>(voxel_count, coefficient_count, position.x, position.y)]
+    : precision(0);
+}
+
+// The output must hold layout_size<output_layout>(voxel_count, coefficient_count) values and must not alias the input.
+template<coefficient_layout input_layout, coefficient_layout output_layout, typename precision>
+void launch_convert_layout(
+  const unsigned int voxel_count      ,
+  const unsigned int coefficient_count,
+  const precision*   input            ,
+  precision*         output           ,
+  cudaStream_t       stream           = nullptr)
+{
+  profile_scope profile("convert_layout", stream, voxel_count, (static_cast<size_t>(voxel_count) * coefficient_count + layout_size<output_layout>(voxel_count, coefficient_count)) * sizeof(precision));
+  launch_1d(convert_layout<input_layout, output_layout, precision>, thread_grid(unsigned(layout_size<output_layout>(voxel_count, coefficient_count))), 0, stream,
+    voxel_count      ,
+    coefficient_count,
+    input            ,
+    output           );
+}
+#endif
+}
+
+#endif
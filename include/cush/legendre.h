@@ -1,21 +1,24 @@
 #ifndef CUSH_LEGENDRE_H_
 #define CUSH_LEGENDRE_H_
 
-#include <host_defines.h>
 #include <math.h>
 
 #include <cush/factorial.h>
+#include <cush/math.h>
+#include <cush/portability.h>
+#include <cush/precision.h>
 
 namespace cush
 {
 // Based on the recurrence relations defined in page 10 of
 // "Spherical Harmonic Lighting: The Gritty Details" by Robin Green.
+// P_lm itself grows as (2m - 1)!!, i.e. overflows in float from m = 29. See normalized_associated_legendre instead.
 template<typename precision>
 __host__ __device__ precision associated_legendre(const int l, const int m, const precision& x)
 {
-  precision p_mm(1.0);
+  precision p_mm(1);
   if (l > 0)
-    p_mm = (m % 2 == 0 ? 1 : -1) * double_factorial<precision>(fmax(2.0F * m - 1.0F, 0.0F)) * pow(1 - x * x, m / 2.0);
+    p_mm = (m % 2 == 0 ? 1 : -1) * double_factorial<precision>(m > 0 ? 2 * m - 1 : 0) * math::pow(1 - x * x, precision(m) / 2);
   if (l == m)
     return p_mm;
   
@@ -31,6 +34,34 @@ __host__ __device__ precision associated_legendre(const int l, const int m, cons
   }
   return p_m1m;
 }
+
+// The fully normalized associated Legendre function K_lm P_lm, K_lm = sqrt((2l + 1) (l - m)! / (4 pi (l + m)!)), for
+// 0 <= m <= l, i.e. the Legendre factor of the orthonormal harmonics. The recurrences fold K_lm into their coefficients,
+// P_mm = -sqrt((2m + 1) / 2m) sqrt(1 - x^2) P_(m-1)(m-1) from P_00 = 1 / sqrt(4 pi), P_(m+1)m = sqrt(2m + 3) x P_mm and
+// P_lm = a_lm (x P_(l-1)m - P_(l-2)m / a_(l-1)m) with a_lm = sqrt((4l^2 - 1) / (l^2 - m^2)), hence neither factorials
+// nor P_lm are formed and the values stay bounded by sqrt((2l + 1) / 4 pi) at any degree. Only the sectoral start
+// underflows, at high orders near the poles where the function itself is below the smallest normal of the precision.
+template<typename precision>
+__host__ __device__ precision normalized_associated_legendre(const int l, const int m, const precision& x)
+{
+  const precision y = math::sqrt(precision(1) - x * x);
+
+  precision p_mm = math::rsqrt(precision(4) * pi<precision>());
+  for (auto n = 1; n <= m; n++)
+    p_mm *= -math::sqrt_ratio(precision(2 * n + 1), precision(2 * n)) * y;
+  if (l == m)
+    return p_mm;
+
+  precision p_m1m = math::sqrt(precision(2 * m + 3)) * x * p_mm;
+  for (auto n = m + 2; n <= l; n++)
+  {
+    precision p_lm = math::sqrt_ratio(precision(4 * n * n - 1), precision(n * n - m * m)) *
+                     (x * p_m1m - math::sqrt_ratio(precision((n - 1) * (n - 1) - m * m), precision(4 * (n - 1) * (n - 1) - 1)) * p_mm);
+    p_mm  = p_m1m;
+    p_m1m = p_lm;
+  }
+  return p_m1m;
+}
 }
 
 #endif
@@ -0,0 +1,151 @@
+#ifndef CUSH_MATH_H_
+#define CUSH_MATH_H_
+
+#include <math.h>
+
+#include <cush/portability.h>
+
+// Precision overloads of the elementary functions used by the library, so that float instantiations call the single
+// precision functions instead of being promoted to double by a double argument or literal.
+//
+// Defining CUSH_FAST_MATH replaces the float device functions by the hardware intrinsics. The error bounds below are
+// those of the CUDA C++ Programming Guide (ulp: units in the last place):
+//
+//   function   default     CUSH_FAST_MATH
+//   sqrt       0 ulp       0 ulp
+//   rsqrt      2 ulp       2 ulp
+//   sin, cos   2 ulp       2^-21.41 absolute in [-pi, pi], larger outside
+//   sincos     2 ulp       2^-21.41 absolute in [-pi, pi], larger outside
+//   exp        2 ulp       2 + floor(|1.173 x|) ulp
+//   log        1 ulp       2^-21.41 absolute in [0.5, 2], 3 ulp otherwise
+//   pow        4 ulp       derived from exp2(y log2(x)), i.e. unbounded for large |y log2(x)|
+//   acos       2 ulp       2 ulp
+//   atan2      3 ulp       3 ulp
+//
+// The host and the double functions are unaffected.
+namespace cush
+{
+namespace math
+{
+#if defined(__CUDA_ARCH__) && defined(CUSH_FAST_MATH)
+#define CUSH_FAST_FLOAT(FAST, DEFAULT) FAST
+#else
+#define CUSH_FAST_FLOAT(FAST, DEFAULT) DEFAULT
+#endif
+
+__forceinline__ __host__ __device__ float  sqrt  (const float  x)
+{
+  return ::sqrtf(x);
+}
+__forceinline__ __host__ __device__ double sqrt  (const double x)
+{
+  return ::sqrt (x);
+}
+
+__forceinline__ __host__ __device__ float  rsqrt (const float  x)
+{
+#ifdef __CUDA_ARCH__
+  return ::rsqrtf(x);
+#else
+  return 1.0F / ::sqrtf(x);
+#endif
+}
+__forceinline__ __host__ __device__ double rsqrt (const double x)
+{
+#ifdef __CUDA_ARCH__
+  return ::rsqrt(x);
+#else
+  return 1.0  / ::sqrt (x);
+#endif
+}
+
+// sqrt(numerator / denominator) for a positive numerator, without the division.
+template<typename precision>
+__forceinline__ __host__ __device__ precision sqrt_ratio(const precision numerator, const precision denominator)
+{
+  return numerator * rsqrt(numerator * denominator);
+}
+
+__forceinline__ __host__ __device__ float  sin   (const float  x)
+{
+  return CUSH_FAST_FLOAT(::__sinf(x), ::sinf(x));
+}
+__forceinline__ __host__ __device__ double sin   (const double x)
+{
+  return ::sin (x);
+}
+__forceinline__ __host__ __device__ float  cos   (const float  x)
+{
+  return CUSH_FAST_FLOAT(::__cosf(x), ::cosf(x));
+}
+__forceinline__ __host__ __device__ double cos   (const double x)
+{
+  return ::cos (x);
+}
+
+__forceinline__ __host__ __device__ void   sincos(const float  x, float*  sine, float*  cosine)
+{
+#ifdef __CUDA_ARCH__
+  CUSH_FAST_FLOAT(::__sincosf(x, sine, cosine), ::sincosf(x, sine, cosine));
+#else
+  *sine   = ::sinf(x);
+  *cosine = ::cosf(x);
+#endif
+}
+__forceinline__ __host__ __device__ void   sincos(const double x, double* sine, double* cosine)
+{
+#ifdef __CUDA_ARCH__
+  ::sincos(x, sine, cosine);
+#else
+  *sine   = ::sin (x);
+  *cosine = ::cos (x);
+#endif
+}
+
+__forceinline__ __host__ __device__ float  exp   (const float  x)
+{
+  return CUSH_FAST_FLOAT(::__expf(x), ::expf(x));
+}
+__forceinline__ __host__ __device__ double exp   (const double x)
+{
+  return ::exp (x);
+}
+__forceinline__ __host__ __device__ float  log   (const float  x)
+{
+  return CUSH_FAST_FLOAT(::__logf(x), ::logf(x));
+}
+__forceinline__ __host__ __device__ double log   (const double x)
+{
+  return ::log (x);
+}
+__forceinline__ __host__ __device__ float  pow   (const float  x, const float  y)
+{
+  return CUSH_FAST_FLOAT(::__powf(x, y), ::powf(x, y));
+}
+__forceinline__ __host__ __device__ double pow   (const double x, const double y)
+{
+  return ::pow (x, y);
+}
+
+__forceinline__ __host__ __device__ float  acos  (const float  x)
+{
+  return ::acosf(x);
+}
+__forceinline__ __host__ __device__ double acos  (const double x)
+{
+  return ::acos (x);
+}
+__forceinline__ __host__ __device__ float  atan2 (const float  y, const float  x)
+{
+  return ::atan2f(y, x);
+}
+__forceinline__ __host__ __device__ double atan2 (const double y, const double x)
+{
+  return ::atan2 (y, x);
+}
+
+#undef CUSH_FAST_FLOAT
+}
+}
+
+#endif
@@ -0,0 +1,304 @@
+#ifndef CUSH_PIPELINE_H_
+#define CUSH_PIPELINE_H_
+
+#include <atomic>
+#include <cstring>
+#include <cuda_runtime_api.h>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <vector_types.h>
+
+#include <cush/spherical_harmonics.h>
+#include <cush/workspace.h>
+
+// Out-of-core processing of volumes which do not fit on a single device, by splitting them into slabs of whole z planes
+// and streaming the slabs through all visible devices. The volumes are voxel-major with x fastest, i.e. voxel
+// x + dimensions.x * (y + dimensions.y * z), hence the voxels of a slab are contiguous.
+namespace cush
+{
+// The view of a slab passed to the stages of a slab_executor. The device buffers and the stream belong to the lane,
+// i.e. the (device, stream) pair, processing the slab.
+template<typename input_type, typename output_type>
+struct slab
+{
+  unsigned int      index       ; // The index of the slab along z.
+  unsigned int      voxel_offset; // The linear index of the first voxel of the slab in the volume.
+  uint3             dimensions  ; // The dimensions of the slab, i.e. {dimensions.x, dimensions.y, depth}.
+  int               device      ;
+  unsigned int      lane        ; // In [0, lane_count()), e.g. for indexing per lane plans or scratch memory.
+  cudaStream_t      stream      ;
+  const input_type* input       ; // Device memory, voxel_count x input_size.
+  output_type*      output      ; // Device memory, voxel_count x output_size.
+
+  unsigned int voxel_count() const
+  {
+    return dimensions.x * dimensions.y * dimensions.z;
+  }
+};
+
+// The workspace size of the intermediates of a fit -> product -> sample -> extract_maxima chain on a dimensions volume of
+// max_l coefficients, i.e. the coefficients of the fit and of the product, and the values of a sampling_plan on
+// tessellations. A slab_executor stage allocates these per lane, from a workspace of this size for its slab dimensions.
+template<typename precision>
+size_t pipeline_workspace_size(
+  const uint3        dimensions   ,
+  const unsigned int max_l        ,
+  const uint2        tessellations)
+{
+  auto voxel_count = static_cast<size_t>(dimensions.x) * dimensions.y * dimensions.z;
+  return
+    workspace_size<precision>(voxel_count * coefficient_count(max_l)) * 2 +
+    workspace_size<precision>(voxel_count * tessellations.x * tessellations.y);
+}
+
+// All visible devices.
+inline std::vector<int> visible_devices()
+{
+  auto count = 0;
+  if (cudaGetDeviceCount(&count) != cudaSuccess)
+    count = 0;
+
+  std::vector<int> devices(count);
+  for (auto device = 0; device < count; device++)
+    devices[device] = device;
+  return devices;
+}
+
+// Runs a stage, e.g. a fit, sample, product or extract_maxima, on a host volume of input_size values per voxel, producing
+// output_size values per voxel, slab by slab. The slabs are dealt round-robin to the devices, each driven by a host thread
+// owning streams_per_device lanes. Each lane has pinned host and device input and output buffers of a slab, allocated once
+// on construction, so that while a lane computes, the next lane copies its slab in and the previous lane copies its
+// results out: the host to device copies, the stages and the device to host copies of consecutive slabs overlap.
+//
+// The stage is called as stage(slab) from the thread of the slab's device, with the device current, and must launch its
+// work on slab.stream without synchronizing. Handles such as the cuBLAS handles of fitting_plan or sampling_plan are not
+// shared between devices: construct one plan per device (or per lane) and pass slab.stream to the stream overloads of
+// fit and sample.
+template<typename input_type, typename output_type>
+class slab_executor
+{
+public:
+  using slab_type = slab<input_type, output_type>;
+
+  slab_executor           (
+    const uint3             dimensions        ,
+    const unsigned int      input_size        ,
+    const unsigned int      output_size       ,
+    const unsigned int      slab_depth        ,
+    const std::vector<int>& devices           = visible_devices(),
+    const unsigned int      streams_per_device = 2)
+  : dimensions_(dimensions), input_size_(input_size), output_size_(output_size), slab_depth_(slab_depth), devices_(devices)
+  {
+    if (devices_.empty() || streams_per_device == 0)
+      throw std::runtime_error("cush: a slab_executor requires at least one device and stream.");
+    if (slab_depth_ == 0)
+      throw std::runtime_error("cush: a slab_executor requires a positive slab depth.");
+
+    auto slab_voxels = static_cast<size_t>(dimensions.x) * dimensions.y * slab_depth;
+    for (auto device_slot = 0u; device_slot < devices_.size(); device_slot++)
+    {
+      cudaSetDevice(devices_[device_slot]);
+      for (auto stream_index = 0u; stream_index < streams_per_device; stream_index++)
+      {
+        lane_buffers lane;
+        lane.device_slot = device_slot;
+        cudaStreamCreateWithFlags(&lane.stream, cudaStreamNonBlocking);
+        cudaMallocHost(reinterpret_cast<void**>(&lane.host_input)   , slab_voxels * input_size  * sizeof(input_type ));
+        cudaMallocHost(reinterpret_cast<void**>(&lane.host_output)  , slab_voxels * output_size * sizeof(output_type));
+        cudaMalloc    (reinterpret_cast<void**>(&lane.device_input) , slab_voxels * input_size  * sizeof(input_type ));
+        cudaMalloc    (reinterpret_cast<void**>(&lane.device_output), slab_voxels * output_size * sizeof(output_type));
+        lanes_.push_back(lane);
+      }
+    }
+  }
+  slab_executor           (const slab_executor&  that) = delete ;
+  slab_executor           (      slab_executor&& temp) : dimensions_(temp.dimensions_), input_size_(temp.input_size_), output_size_(temp.output_size_), slab_depth_(temp.slab_depth_), devices_(std::move(temp.devices_)), lanes_(std::move(temp.lanes_))
+  {
+    temp.lanes_.clear();
+  }
+ ~slab_executor           ()
+  {
+    for (auto& lane : lanes_)
+    {
+      cudaSetDevice    (devices_[lane.device_slot]);
+      cudaStreamDestroy(lane.stream       );
+      cudaFree         (lane.device_output);
+      cudaFree         (lane.device_input );
+      cudaFreeHost     (lane.host_output  );
+      cudaFreeHost     (lane.host_input   );
+    }
+  }
+  slab_executor& operator=(const slab_executor&  that) = delete ;
+  slab_executor& operator=(      slab_executor&& temp) = delete ;
+
+  // The input and output are in (pageable) host memory, voxel-major voxel_count x input_size and voxel_count x
+  // output_size. Returns after all slabs are copied out. Rethrows the first exception of a stage or of a lane's stream,
+  // if any, after all lanes are idle: the other devices stop at their next slab, and the output is then incomplete.
+  template<typename stage_type>
+  void                    run       (const input_type* input, output_type* output, const stage_type& stage) const
+  {
+    if (lanes_.empty())
+      throw std::runtime_error("cush: slab_executor::run requires at least one device.");
+
+    std::vector<std::exception_ptr> exceptions(devices_.size());
+    std::atomic<bool>               failed    (false);
+    auto process = [&] (const unsigned int device_slot)
+    {
+      try
+      {
+        run_device(device_slot, input, output, stage, failed);
+      }
+      catch (...)
+      {
+        exceptions[device_slot] = std::current_exception();
+        failed = true;
+      }
+    };
+
+    if (devices_.size() == 1)
+      process(0);
+    else
+    {
+      std::vector<std::thread> threads;
+      for (auto device_slot = 0u; device_slot < devices_.size(); device_slot++)
+        threads.emplace_back(process, device_slot);
+      for (auto& thread : threads)
+        thread.join();
+    }
+
+    for (auto& exception : exceptions)
+      if (exception)
+        std::rethrow_exception(exception);
+  }
+
+  uint3                   dimensions() const
+  {
+    return dimensions_;
+  }
+  unsigned int            slab_count() const
+  {
+    return (dimensions_.z + slab_depth_ - 1) / slab_depth_;
+  }
+  unsigned int            lane_count() const
+  {
+    return unsigned(lanes_.size());
+  }
+  const std::vector<int>& devices   () const
+  {
+    return devices_;
+  }
+
+protected:
+  struct lane_buffers
+  {
+    unsigned int device_slot   = 0;
+    cudaStream_t stream        = nullptr;
+    input_type*  host_input    = nullptr;
+    output_type* host_output   = nullptr;
+    input_type*  device_input  = nullptr;
+    output_type* device_output = nullptr;
+    bool         pending       = false;   // Whether a slab is in flight, to be copied out to pending_slab.
+    slab_type    pending_slab  = {};
+  };
+
+  // Waits for the slab in flight on the lane, if any, and copies its results out of the pinned buffer. Throws if the
+  // work of the slab failed.
+  static void complete(lane_buffers& lane, output_type* output, const unsigned int output_size)
+  {
+    if (!lane.pending)
+      return;
+    lane.pending = false;
+    auto error = cudaStreamSynchronize(lane.stream);
+    if (error != cudaSuccess)
+      throw std::runtime_error(std::string("cush: slab ") + std::to_string(lane.pending_slab.index) + " failed: " + cudaGetErrorString(error));
+    std::memcpy(
+      output + static_cast<size_t>(lane.pending_slab.voxel_offset) * output_size,
+      lane.host_output,
+      static_cast<size_t>(lane.pending_slab.voxel_count()) * output_size * sizeof(output_type));
+  }
+
+  template<typename stage_type>
+  void run_device(const unsigned int device_slot, const input_type* input, output_type* output, const stage_type& stage, const std::atomic<bool>& failed) const
+  {
+    cudaSetDevice(devices_[device_slot]);
+
+    // The lanes of this device. Each thread only touches its own lanes, hence copies suffice.
+    std::vector<lane_buffers> lanes       ;
+    std::vector<unsigned int> lane_indices;
+    for (auto lane_index = 0u; lane_index < lanes_.size(); lane_index++)
+      if (lanes_[lane_index].device_slot == device_slot)
+      {
+        lanes       .push_back(lanes_[lane_index]);
+        lane_indices.push_back(lane_index);
+      }
+
+    try
+    {
+      run_slabs(device_slot, input, output, stage, failed, lanes, lane_indices);
+    }
+    catch (...)
+    {
+      // The copies and stages in flight on the other lanes still use their buffers, and the next run reuses them.
+      for (auto& lane : lanes)
+        cudaStreamSynchronize(lane.stream);
+      throw;
+    }
+  }
+  template<typename stage_type>
+  void run_slabs(
+    const unsigned int               device_slot ,
+    const input_type*                input       ,
+    output_type*                     output      ,
+    const stage_type&                stage       ,
+    const std::atomic<bool>&         failed      ,
+    std::vector<lane_buffers>&       lanes       ,
+    const std::vector<unsigned int>& lane_indices) const
+  {
+    auto next_lane = 0u;
+    for (auto slab_index = device_slot; slab_index < slab_count() && !failed; slab_index += unsigned(devices_.size()))
+    {
+      auto& lane = lanes[next_lane];
+
+      slab_type current;
+      current.index        = slab_index;
+      current.voxel_offset = dimensions_.x * dimensions_.y * slab_index * slab_depth_;
+      current.dimensions   = {dimensions_.x, dimensions_.y, dimensions_.z - slab_index * slab_depth_ < slab_depth_ ? dimensions_.z - slab_index * slab_depth_ : slab_depth_};
+      current.device       = devices_[device_slot];
+      current.lane         = lane_indices[next_lane];
+      current.stream       = lane.stream;
+      current.input        = lane.device_input;
+      current.output       = lane.device_output;
+
+      // Reusing the buffers of the lane requires its previous slab to be complete, while the other lanes keep running.
+      complete(lane, output, output_size_);
+
+      auto input_bytes  = static_cast<size_t>(current.voxel_count()) * input_size_  * sizeof(input_type );
+      auto output_bytes = static_cast<size_t>(current.voxel_count()) * output_size_ * sizeof(output_type);
+      std::memcpy(lane.host_input, input + static_cast<size_t>(current.voxel_offset) * input_size_, input_bytes);
+      cudaMemcpyAsync(lane.device_input, lane.host_input, input_bytes, cudaMemcpyHostToDevice, lane.stream);
+      stage(current);
+      cudaMemcpyAsync(lane.host_output, lane.device_output, output_bytes, cudaMemcpyDeviceToHost, lane.stream);
+
+      lane.pending      = true;
+      lane.pending_slab = current;
+      next_lane         = (next_lane + 1) % lanes.size();
+    }
+
+    for (auto& lane : lanes)
+      complete(lane, output, output_size_);
+  }
+
+  uint3                     dimensions_  = {0, 0, 0};
+  unsigned int              input_size_  = 0;
+  unsigned int              output_size_ = 0;
+  unsigned int              slab_depth_  = 1;
+  std::vector<int>          devices_     ;
+  std::vector<lane_buffers> lanes_       ;
+};
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef CUSH_PORTABILITY_H_
+#define CUSH_PORTABILITY_H_
+
+// The CUDA execution space specifiers and vector types. Defining CUSH_CPU_ONLY (see the cush_cpu target) replaces them
+// by portable definitions, so that the host subset of the library compiles without the CUDA toolkit: factorial.h,
+// choose.h, math.h, precision.h (without the 16-bit types), legendre.h, wigner.h, clebsch_gordan.h, gaunt.h, layout.h,
+// spherical_harmonics.h, icosphere.h (the mesh only), rotation.h, distance.h (the metrics only), launch.h (the grid
+// sizes and policies only), workspace.h (the size queries only) and host.h. Their kernels, launchers and device classes
+// are excluded. The replacement vector types have the size and alignment of the CUDA types, hence the host and device
+// data layouts agree.
+#ifndef CUSH_CPU_ONLY
+
+#include <host_defines.h>
+#include <vector_types.h>
+
+#else
+
+#ifndef __host__
+#define __host__
+#endif
+#ifndef __device__
+#define __device__
+#endif
+#ifndef __constant__
+#define __constant__
+#endif
+#ifndef __forceinline__
+#ifdef _MSC_VER
+#define __forceinline__ __forceinline
+#else
+#define __forceinline__ inline __attribute__((always_inline))
+#endif
+#endif
+
+struct alignas(8)  int2    { int          x, y;       };
+struct             int3    { int          x, y, z;    };
+struct alignas(16) int4    { int          x, y, z, w; };
+struct alignas(8)  uint2   { unsigned int x, y;       };
+struct             uint3   { unsigned int x, y, z;    };
+struct alignas(16) uint4   { unsigned int x, y, z, w; };
+struct alignas(8)  float2  { float        x, y;       };
+struct             float3  { float        x, y, z;    };
+struct alignas(16) float4  { float        x, y, z, w; };
+struct alignas(16) double2 { double       x, y;       };
+struct             double3 { double       x, y, z;    };
+struct alignas(16) double4 { double       x, y, z, w; };
+
+struct dim3
+{
+  constexpr dim3(const unsigned int x = 1, const unsigned int y = 1, const unsigned int z = 1) : x(x), y(y), z(z)
+  {
+  }
+
+  unsigned int x, y, z;
+};
+
+#endif
+
+// Asks nvcc to unroll the following loop. Expands to nothing for other compilers, which would warn on the unknown pragma.
+#ifdef __CUDACC__
+#define CUSH_UNROLL _Pragma("unroll")
+#else
+#define CUSH_UNROLL
+#endif
+
+#endif
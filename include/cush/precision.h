@@ -0,0 +1,139 @@
+#ifndef CUSH_PRECISION_H_
+#define CUSH_PRECISION_H_
+
+#ifndef CUSH_CPU_ONLY
+#include <cuda_bf16.h>
+#include <cuda_fp16.h>
+#endif
+#include <float.h>
+
+#include <cush/portability.h>
+
+// Storage and computation precisions. The coefficients may be stored in __half or __nv_bfloat16 to halve the memory
+// traffic, while the kernels evaluate and accumulate in compute_precision_t, i.e. float for the 16-bit types. The
+// 16-bit types are unavailable under CUSH_CPU_ONLY.
+namespace cush
+{
+template<typename storage_type>
+struct compute_precision
+{
+  using type = storage_type;
+};
+#ifndef CUSH_CPU_ONLY
+template<>
+struct compute_precision<__half>
+{
+  using type = float;
+};
+template<>
+struct compute_precision<__nv_bfloat16>
+{
+  using type = float;
+};
+#endif
+template<typename storage_type>
+using compute_precision_t = typename compute_precision<storage_type>::type;
+
+// Conversions between the storage and computation precisions, through float for the 16-bit types.
+template<typename output_type, typename input_type>
+struct converter
+{
+  __forceinline__ __host__ __device__ static output_type apply(const input_type&    value)
+  {
+    return output_type(value);
+  }
+};
+#ifndef CUSH_CPU_ONLY
+template<typename output_type>
+struct converter<output_type, __half>
+{
+  __forceinline__ __host__ __device__ static output_type apply(const __half&        value)
+  {
+    return output_type(__half2float(value));
+  }
+};
+template<typename output_type>
+struct converter<output_type, __nv_bfloat16>
+{
+  __forceinline__ __host__ __device__ static output_type apply(const __nv_bfloat16& value)
+  {
+    return output_type(__bfloat162float(value));
+  }
+};
+template<typename input_type>
+struct converter<__half, input_type>
+{
+  __forceinline__ __host__ __device__ static __half        apply(const input_type& value)
+  {
+    return __float2half(float(value));
+  }
+};
+template<typename input_type>
+struct converter<__nv_bfloat16, input_type>
+{
+  __forceinline__ __host__ __device__ static __nv_bfloat16 apply(const input_type& value)
+  {
+    return __float2bfloat16(float(value));
+  }
+};
+template<>
+struct converter<__half, __half>
+{
+  __forceinline__ __host__ __device__ static __half        apply(const __half&        value)
+  {
+    return value;
+  }
+};
+template<>
+struct converter<__nv_bfloat16, __nv_bfloat16>
+{
+  __forceinline__ __host__ __device__ static __nv_bfloat16 apply(const __nv_bfloat16& value)
+  {
+    return value;
+  }
+};
+template<>
+struct converter<__half, __nv_bfloat16>
+{
+  __forceinline__ __host__ __device__ static __half        apply(const __nv_bfloat16& value)
+  {
+    return __float2half(__bfloat162float(value));
+  }
+};
+template<>
+struct converter<__nv_bfloat16, __half>
+{
+  __forceinline__ __host__ __device__ static __nv_bfloat16 apply(const __half&        value)
+  {
+    return __float2bfloat16(__half2float(value));
+  }
+};
+#endif
+template<typename output_type, typename input_type>
+__forceinline__ __host__ __device__ output_type convert(const input_type& value)
+{
+  return converter<output_type, input_type>::apply(value);
+}
+
+// Constants in the given precision, so that float kernels do not promote to double.
+template<typename precision>
+__forceinline__ __host__ __device__ constexpr precision pi()
+{
+  return precision(3.14159265358979323846);
+}
+// The machine epsilon of float and double, i.e. the distance from 1 to the next larger value.
+template<typename precision>
+__forceinline__ __host__ __device__ constexpr precision epsilon();
+template<>
+__forceinline__ __host__ __device__ constexpr float     epsilon<float >()
+{
+  return FLT_EPSILON;
+}
+template<>
+__forceinline__ __host__ __device__ constexpr double    epsilon<double>()
+{
+  return DBL_EPSILON;
+}
+}
+
+#endif
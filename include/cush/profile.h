@@ -0,0 +1,371 @@
+#ifndef CUSH_PROFILE_H_
+#define CUSH_PROFILE_H_
+
+#include <algorithm>
+#include <cstddef>
+#ifndef CUSH_CPU_ONLY
+#include <cuda_runtime_api.h>
+#endif
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#if defined(CUSH_PROFILE) && !defined(CUSH_CPU_ONLY)
+#include <nvtx3/nvToolsExt.h>
+#endif
+
+#include <cush/launch.h>
+#include <cush/portability.h>
+
+// Defining CUSH_PROFILE (see the PROFILE option) wraps each host launcher of the library in an NVTX range named after
+// it and times its kernels with CUDA events on its stream, without synchronizing it. The launchers of a volume of
+// coefficients also count the zero voxels of their input (see is_zero), by an additional kernel which runs before the
+// timed kernels. The events and counters are pooled by the report per device, and the completed launches are collected
+// into current_profile_report() as new ones are recorded, and whenever it is read. Launches which autotune a block size
+// (see launch_policy::autotune) are not recorded, as their time is that of the tuning. Launchers which only delegate to
+// other launchers (e.g. the temporary workspace overloads) are not recorded themselves, composite ones (l2_distances,
+// fit_batched) are recorded in addition to the launchers they call. Without CUSH_PROFILE profile_scope is empty, i.e.
+// free.
+namespace cush
+{
+struct profile_entry
+{
+  // The achieved throughput of the bytes the kernels must read and write at least.
+  double gigabytes_per_second() const
+  {
+    return milliseconds > 0.0 ? double(bytes) / (milliseconds * 1e6) : 0.0;
+  }
+
+  std::string name         ;
+  size_t      launches     = 0;
+  double      milliseconds = 0.0;
+  size_t      voxels       = 0; // The database vectors for the distance launchers.
+  size_t      bytes        = 0;
+  size_t      zero_voxels  = 0;
+};
+
+// The per launcher aggregates of the recorded launches. Thread-safe.
+class profile_report
+{
+public:
+#ifndef CUSH_CPU_ONLY
+  // The events and the zero voxel counter of a timed launch on a device, recycled by the report.
+  struct launch_slot
+  {
+    int                 device            ;
+    cudaEvent_t         start             ;
+    cudaEvent_t         stop              ;
+    unsigned long long* device_zero_voxels;
+    unsigned long long* host_zero_voxels  ; // Pinned.
+  };
+#endif
+
+  profile_report           () = default;
+  profile_report           (const profile_report&  that) = delete ;
+  profile_report           (      profile_report&& temp) = delete ;
+ ~profile_report           ()
+  {
+#ifndef CUSH_CPU_ONLY
+    for (auto& launch : pending_)
+      cudaEventSynchronize(launch.slot.stop);
+    // The events and counters are destroyed on their devices.
+    auto current = 0;
+    cudaGetDevice(&current);
+    for (auto& slot : slots_)
+    {
+      cudaSetDevice   (slot.device);
+      cudaEventDestroy(slot.stop  );
+      cudaEventDestroy(slot.start );
+    }
+    for (auto& chunk : chunks_)
+    {
+      cudaSetDevice(chunk.device         );
+      cudaFreeHost (chunk.host_counters  );
+      cudaFree     (chunk.device_counters);
+    }
+    cudaSetDevice(current);
+#endif
+  }
+  profile_report& operator=(const profile_report&  that) = delete ;
+  profile_report& operator=(      profile_report&& temp) = delete ;
+
+  void                       add      (
+    const std::string& name        ,
+    const double       milliseconds,
+    const size_t       voxels      ,
+    const size_t       bytes       ,
+    const size_t       zero_voxels = 0)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    accumulate(name, milliseconds, voxels, bytes, zero_voxels);
+  }
+  // Ordered by name. Waits for the pending launches.
+  std::vector<profile_entry> entries  ()
+  {
+    resolve_all();
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<profile_entry> entries;
+    for (auto& entry : entries_)
+      entries.push_back(entry.second);
+    return entries;
+  }
+  // The entries in the Prometheus text exposition format, labeled by launcher, e.g. for a textfile collector.
+  std::string                prometheus(const std::string& prefix = "cush")
+  {
+    const auto entries = this->entries();
+
+    std::ostringstream stream;
+    const auto metric  = [&] (const char* name, const char* type, const char* help, auto value)
+    {
+      stream << "# HELP " << prefix << "_" << name << " " << help << "\n";
+      stream << "# TYPE " << prefix << "_" << name << " " << type << "\n";
+      for (auto& entry : entries)
+        stream << prefix << "_" << name << "{launcher=\"" << entry.name << "\"} " << value(entry) << "\n";
+    };
+    metric("launches_total"      , "counter", "Recorded launches."                     , [ ] (const profile_entry& entry) { return entry.launches; });
+    metric("seconds_total"       , "counter", "Kernel time in seconds."                , [ ] (const profile_entry& entry) { return entry.milliseconds / 1e3; });
+    metric("voxels_total"        , "counter", "Processed voxels."                      , [ ] (const profile_entry& entry) { return entry.voxels; });
+    metric("bytes_total"         , "counter", "Minimum global memory traffic in bytes.", [ ] (const profile_entry& entry) { return entry.bytes; });
+    metric("zero_voxels_total"   , "counter", "Processed voxels of zero coefficients." , [ ] (const profile_entry& entry) { return entry.zero_voxels; });
+    metric("gigabytes_per_second", "gauge"  , "Achieved throughput in GB/s."           , [ ] (const profile_entry& entry) { return entry.gigabytes_per_second(); });
+    return stream.str();
+  }
+  // Waits for and discards the pending launches.
+  void                       reset    ()
+  {
+    resolve_all();
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+  }
+
+#ifndef CUSH_CPU_ONLY
+  // A slot of the pool of the current device, which grows by slot_chunk_size slots at a time. Its events can only be
+  // recorded on the streams of that device. False if the runtime fails to allocate one.
+  bool                       acquire    (launch_slot& result)
+  {
+    auto device = 0;
+    if (cudaGetDevice(&device) != cudaSuccess)
+      return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& free_slots = free_slots_[device];
+    if (free_slots.empty() && !grow(device))
+      return false;
+    result = free_slots.back();
+    free_slots.pop_back();
+    return true;
+  }
+  // Takes back the slot of a launch, to be read once its stop event completed. A discarded launch is not recorded. The
+  // completed pending launches are resolved, without waiting for the others.
+  void                       add_pending(
+    const char*        name       ,
+    const launch_slot& slot       ,
+    const size_t       voxels     ,
+    const size_t       bytes      ,
+    const bool         zero_voxels,
+    const bool         discard    = false)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back({name, slot, voxels, bytes, zero_voxels, discard});
+    auto ready = std::stable_partition(pending_.begin(), pending_.end(), [ ] (const pending_launch& launch)
+    {
+      return cudaEventQuery(launch.slot.stop) == cudaErrorNotReady;
+    });
+    for (auto iterator = ready; iterator != pending_.end(); ++iterator)
+      resolve(*iterator);
+    pending_.erase(ready, pending_.end());
+  }
+#endif
+
+protected:
+#ifndef CUSH_CPU_ONLY
+  static constexpr unsigned slot_chunk_size = 64;
+
+  struct counter_chunk
+  {
+    int                 device         ;
+    unsigned long long* device_counters;
+    unsigned long long* host_counters  ; // Pinned.
+  };
+  struct pending_launch
+  {
+    const char* name       ;
+    launch_slot slot       ;
+    size_t      voxels     ;
+    size_t      bytes      ;
+    bool        zero_voxels;
+    bool        discard    ;
+  };
+#endif
+
+  void accumulate (const std::string& name, const double milliseconds, const size_t voxels, const size_t bytes, const size_t zero_voxels)
+  {
+    auto& entry = entries_[name];
+    entry.name          = name;
+    entry.launches     ++;
+    entry.milliseconds += milliseconds;
+    entry.voxels       += voxels;
+    entry.bytes        += bytes;
+    entry.zero_voxels  += zero_voxels;
+  }
+  // Waits for the pending launches without holding the lock.
+  void resolve_all()
+  {
+#ifndef CUSH_CPU_ONLY
+    std::vector<pending_launch> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending.swap(pending_);
+    }
+    for (auto& launch : pending)
+      cudaEventSynchronize(launch.slot.stop);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& launch : pending)
+      resolve(launch);
+#endif
+  }
+#ifndef CUSH_CPU_ONLY
+  // Of a completed launch, under the lock.
+  void resolve    (const pending_launch& launch)
+  {
+    if (!launch.discard)
+    {
+      auto milliseconds = 0.0F;
+      if (cudaEventElapsedTime(&milliseconds, launch.slot.start, launch.slot.stop) != cudaSuccess)
+        milliseconds = 0.0F;
+      accumulate(launch.name, milliseconds, launch.voxels, launch.bytes, launch.zero_voxels ? size_t(*launch.slot.host_zero_voxels) : 0);
+    }
+    free_slots_[launch.slot.device].push_back(launch.slot);
+  }
+  // Adds the slots of the current device, which is device.
+  bool grow       (const int device)
+  {
+    unsigned long long* device_counters;
+    unsigned long long* host_counters  ;
+    if (cudaMalloc    (reinterpret_cast<void**>(&device_counters), slot_chunk_size * sizeof(unsigned long long)) != cudaSuccess)
+      return false;
+    if (cudaMallocHost(reinterpret_cast<void**>(&host_counters)  , slot_chunk_size * sizeof(unsigned long long)) != cudaSuccess)
+    {
+      cudaFree(device_counters);
+      return false;
+    }
+    chunks_.push_back({device, device_counters, host_counters});
+
+    auto& free_slots = free_slots_[device];
+    for (auto index = 0u; index < slot_chunk_size; index++)
+    {
+      launch_slot slot {device, nullptr, nullptr, device_counters + index, host_counters + index};
+      if (cudaEventCreate(&slot.start) != cudaSuccess)
+        break;
+      if (cudaEventCreate(&slot.stop ) != cudaSuccess)
+      {
+        cudaEventDestroy(slot.start);
+        break;
+      }
+      slots_    .push_back(slot);
+      free_slots.push_back(slot);
+    }
+    return !free_slots.empty();
+  }
+#endif
+
+  std::mutex                                                          mutex_     ;
+  std::map<std::string, profile_entry>                                entries_   ;
+#ifndef CUSH_CPU_ONLY
+  std::vector<pending_launch>                                         pending_   ;
+  std::vector<launch_slot>                                            slots_     ;
+  std::map<int, std::vector<launch_slot>>                             free_slots_; // By device.
+  std::vector<counter_chunk>                                          chunks_    ;
+#endif
+};
+
+inline profile_report& current_profile_report()
+{
+  static profile_report report;
+  return report;
+}
+
+#ifndef CUSH_CPU_ONLY
+#ifdef CUSH_PROFILE
+// Records the launches on stream within its lifetime (up to stop) as one launch of name into current_profile_report(),
+// within an NVTX range of name, unless they autotuned a block size. The name must be a string literal.
+class profile_scope
+{
+public:
+  profile_scope           (const char* name, cudaStream_t stream, const size_t voxels, const size_t bytes)
+  : name_(name), stream_(stream), voxels_(voxels), bytes_(bytes), autotunings_(autotune_count())
+  {
+    nvtxRangePushA(name_);
+    timed_ = current_profile_report().acquire(slot_);
+    if (timed_)
+      cudaEventRecord(slot_.start, stream_);
+  }
+  profile_scope           (const profile_scope&  that) = delete ;
+  profile_scope           (      profile_scope&& temp) = delete ;
+ ~profile_scope           ()
+  {
+    stop();
+    if (timed_)
+      current_profile_report().add_pending(name_, slot_, voxels_, bytes_, zero_voxels_, autotune_count() != autotunings_);
+    nvtxRangePop();
+  }
+  profile_scope& operator=(const profile_scope&  that) = delete ;
+  profile_scope& operator=(      profile_scope&& temp) = delete ;
+
+  void         stop             ()
+  {
+    if (timed_ && !stopped_)
+      cudaEventRecord(slot_.stop, stream_);
+    stopped_ = true;
+  }
+  // Calls count(counter) to launch the counting of the zero voxels into the zeroed device counter, before and outside
+  // the timed launches, i.e. prior to those of the launcher.
+  template<typename count_type>
+  void         count_zero_voxels(const count_type& count)
+  {
+    if (!timed_ || zero_voxels_)
+      return;
+    cudaMemsetAsync(slot_.device_zero_voxels, 0, sizeof(unsigned long long), stream_);
+    count          (slot_.device_zero_voxels);
+    cudaMemcpyAsync(slot_.host_zero_voxels, slot_.device_zero_voxels, sizeof(unsigned long long), cudaMemcpyDeviceToHost, stream_);
+    cudaEventRecord(slot_.start, stream_);
+    zero_voxels_ = true;
+  }
+  cudaStream_t stream           () const
+  {
+    return stream_;
+  }
+
+protected:
+  const char*                 name_        ;
+  cudaStream_t                stream_      ;
+  size_t                      voxels_      ;
+  size_t                      bytes_       ;
+  unsigned long long          autotunings_ ;
+  profile_report::launch_slot slot_        ;
+  bool                        timed_       = false;
+  bool                        stopped_     = false;
+  bool                        zero_voxels_ = false;
+};
+#else
+class profile_scope
+{
+public:
+  __forceinline__ profile_scope(const char*, cudaStream_t, const size_t, const size_t)
+  {
+  }
+  profile_scope           (const profile_scope&  that) = delete ;
+  profile_scope           (      profile_scope&& temp) = delete ;
+  profile_scope& operator=(const profile_scope&  that) = delete ;
+  profile_scope& operator=(      profile_scope&& temp) = delete ;
+
+  __forceinline__ void stop()
+  {
+  }
+};
+#endif
+#endif
+}
+
+#endif
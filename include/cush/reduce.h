@@ -0,0 +1,73 @@
+#ifndef CUSH_REDUCE_H_
+#define CUSH_REDUCE_H_
+
+#include <device_launch_parameters.h>
+#include <host_defines.h>
+
+// Reductions across the threads of a warp or a block. All threads of the warp or block must call these, and the block size
+// must be a multiple of the warp size.
+namespace cush
+{
+template<typename type>
+struct maximum_operation
+{
+  __forceinline__ __host__ __device__ type operator()(const type& lhs, const type& rhs) const
+  {
+    return lhs < rhs ? rhs : lhs;
+  }
+};
+template<typename type>
+struct minimum_operation
+{
+  __forceinline__ __host__ __device__ type operator()(const type& lhs, const type& rhs) const
+  {
+    return rhs < lhs ? rhs : lhs;
+  }
+};
+template<typename type>
+struct sum_operation
+{
+  __forceinline__ __host__ __device__ type operator()(const type& lhs, const type& rhs) const
+  {
+    return lhs + rhs;
+  }
+};
+
+// The result is valid in lane 0.
+template<typename type, typename operation_type>
+__device__ type warp_reduce (type value, operation_type operation)
+{
+  for (auto offset = warpSize / 2; offset > 0; offset /= 2)
+    value = operation(value, __shfl_down_sync(0xFFFFFFFF, value, offset));
+  return value;
+}
+// The result is valid in all threads.
+template<typename type, typename operation_type>
+__device__ type block_reduce(type value, operation_type operation, const type& identity)
+{
+  __shared__ type warp_values[32];
+
+  auto thread_index = threadIdx.x + blockDim.x * (threadIdx.y + blockDim.y * threadIdx.z);
+  auto lane         = thread_index % warpSize;
+  auto warp         = thread_index / warpSize;
+  auto warp_count   = (blockDim.x * blockDim.y * blockDim.z + warpSize - 1) / warpSize;
+
+  value = warp_reduce(value, operation);
+  if (lane == 0)
+    warp_values[warp] = value;
+  __syncthreads();
+
+  // Every warp reduces the per warp values so that the shuffles stay convergent, only the first warp's result is used.
+  value = warp_reduce(lane < warp_count ? warp_values[lane] : identity, operation);
+  __syncthreads();
+  if (thread_index == 0)
+    warp_values[0] = value;
+  __syncthreads();
+
+  value = warp_values[0];
+  __syncthreads();
+  return value;
+}
+}
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef CUSH_ROTATION_H_
+#define CUSH_ROTATION_H_
+
+#ifndef CUSH_CPU_ONLY
+#include <cuda_runtime_api.h>
+#include <device_launch_parameters.h>
+#endif
+#include <vector>
+
+#ifndef CUSH_CPU_ONLY
+#include <cush/launch.h>
+#endif
+#include <cush/math.h>
+#include <cush/portability.h>
+#include <cush/precision.h>
+#include <cush/profile.h>
+#include <cush/spherical_harmonics.h>
+
+// Rotation of real spherical harmonics expansions. A rotation acts on each degree l separately, by a
+// (2l + 1) x (2l + 1) orthogonal matrix, the real counterpart of the Wigner D-matrix. The blocks are computed from the
+// 3 x 3 rotation matrix by the recurrences of "Rotation Matrices for Real Spherical Harmonics. Direct Determination by
+// Recursion" by Ivanic and Ruedenberg (with the corrections of their 1998 erratum), in O(1) per element from the block of
+// the previous degree. The rotated coefficients of f are those of g(x) = f(R^T x), i.e. f rotated by R.
+namespace cush
+{
+// The blocks are stored consecutively and row-major, element (m, n) of block l at
+// rotation_block_offset(l) + (l + m) * (2l + 1) + (l + n).
+__forceinline__ __host__ __device__ constexpr unsigned int rotation_block_offset(const unsigned int l    )
+{
+  return l * (2 * l - 1) * (2 * l + 1) / 3;
+}
+__forceinline__ __host__ __device__ constexpr unsigned int rotation_matrix_size (const unsigned int max_l)
+{
+  return rotation_block_offset(max_l + 1);
+}
+__forceinline__ __host__ __device__ constexpr unsigned int rotation_matrix_index(const unsigned int l, const int m, const int n)
+{
+  return rotation_block_offset(l) + (int(l) + m) * (2 * l + 1) + (int(l) + n);
+}
+
+// Writes the blocks of degree 0 and 1 of the row-major 3 x 3 rotation matrix. The degree 1 functions are proportional
+// to y, z and x (in the order m = -1, 0, 1).
+template<typename precision>
+__host__ __device__ void calculate_rotation_blocks_01(const precision* rotation, precision* output_matrix)
+{
+  const unsigned int axes[3] = {1, 2, 0};
+  output_matrix[0] = precision(1);
+  for (auto row = 0; row < 3; row++)
+    for (auto column = 0; column < 3; column++)
+      output_matrix[rotation_matrix_index(1, row - 1, column - 1)] = rotation[axes[row] * 3 + axes[column]];
+}
+// Element (m, n) of block l > 1, given the row-major blocks 1 and l - 1 (each stored as in rotation_matrix_index).
+template<typename precision>
+__host__ __device__ precision rotation_element(const unsigned int l, const int m, const int n, const precision* block_1, const precision* previous_block)
+{
+  auto il = int(l);
+  auto r1       = [&] (const int i, const int j)
+  {
+    return block_1       [(1      + i) * 3            + (1      + j)];
+  };
+  auto previous = [&] (const int a, const int b)
+  {
+    return previous_block[(il - 1 + a) * (2 * il - 1) + (il - 1 + b)];
+  };
+  auto p        = [&] (const int i, const int a, const int b)
+  {
+    if (b ==  il)
+      return r1(i, 1) * previous(a,  il - 1) - r1(i, -1) * previous(a, -il + 1);
+    if (b == -il)
+      return r1(i, 1) * previous(a, -il + 1) + r1(i, -1) * previous(a,  il - 1);
+    return r1(i, 0) * previous(a, b);
+  };
+
+  auto absolute_m  = m < 0 ? -m : m;
+  auto denominator = precision(n == il || n == -il ? 2 * il * (2 * il - 1) : (il + n) * (il - n));
+  auto u = math::sqrt(precision((il + m) * (il - m)) / denominator);
+  auto v = math::sqrt(precision((m == 0 ? 2 : 1) * (il + absolute_m - 1) * (il + absolute_m)) / denominator) * (m == 0 ? -1 : 1) / 2;
+  auto w = m == 0 ? precision(0) : -math::sqrt(precision((il - absolute_m - 1) * (il - absolute_m)) / denominator) / 2;
+
+  precision value(0);
+  if (u != precision(0))
+    value += u * p(0, m, n);
+  if (v != precision(0))
+  {
+    if      (m == 0)
+      value += v * (p(1, 1, n) + p(-1, -1, n));
+    else if (m >  0)
+      value += v * (p(1, m - 1, n) * (m ==  1 ? math::sqrt(precision(2)) : precision(1)) - (m ==  1 ? precision(0) : p(-1, -m + 1, n)));
+    else
+      value += v * ((m == -1 ? precision(0) : p(1, m + 1, n)) + p(-1, -m - 1, n) * (m == -1 ? math::sqrt(precision(2)) : precision(1)));
+  }
+  if (w != precision(0))
+  {
+    if (m > 0)
+      value += w * (p(1, m + 1, n) + p(-1, -m - 1, n));
+    else
+      value += w * (p(1, m - 1, n) - p(-1, -m + 1, n));
+  }
+  return value;
+}
+// Element (m, n) of block l > 1, given the blocks 1 and l - 1 of matrix.
+template<typename precision>
+__host__ __device__ precision rotation_element(const unsigned int l, const int m, const int n, const precision* matrix)
+{
+  return rotation_element(l, m, n, matrix + rotation_block_offset(1), matrix + rotation_block_offset(l - 1));
+}
+// The recurrences hold for the real harmonics without the Condon-Shortley phase, whereas those of evaluate include it,
+// i.e. differ by (-1)^m. Converts element (m, n) of a block between the two.
+template<typename precision>
+__forceinline__ __host__ __device__ precision condon_shortley_element(const int m, const int n, const precision& value)
+{
+  return (m + n) & 1 ? -value : value;
+}
+// Writes the rotation_matrix_size(max_l) elements of the blocks of degree 0 to max_l of the row-major 3 x 3 rotation.
+template<typename precision>
+__host__ __device__ void calculate_rotation_matrix(
+  const unsigned int max_l        ,
+  const precision*   rotation     ,
+  precision*         output_matrix)
+{
+  calculate_rotation_blocks_01(rotation, output_matrix);
+  for (auto l = 2u; l <= max_l; l++)
+    for (auto m = -int(l); m <= int(l); m++)
+      for (auto n = -int(l); n <= int(l); n++)
+        output_matrix[rotation_matrix_index(l, m, n)] = rotation_element(l, m, n, output_matrix);
+  for (auto l = 1u; l <= max_l; l++)
+    for (auto m = -int(l); m <= int(l); m++)
+      for (auto n = -int(l); n <= int(l); n++)
+        output_matrix[rotation_matrix_index(l, m, n)] = condon_shortley_element(m, n, output_matrix[rotation_matrix_index(l, m, n)]);
+}
+// Coefficient index of the rotation of the coefficients by the matrix of calculate_rotation_matrix, in O(max_l).
+template<typename precision, typename coefficient_type>
+__host__ __device__ precision rotate_coefficient(
+  const unsigned int      index       ,
+  const precision*        matrix      ,
+  const coefficient_type* coefficients)
+{
+  auto lm = coefficient_lm(index);
+  precision value(0);
+  for (auto n = -lm.x; n <= lm.x; n++)
+    value += matrix[rotation_matrix_index(lm.x, lm.y, n)] * convert<precision>(coefficients[coefficient_index(lm.x, n)]);
+  return value;
+}
+// Rotates all coefficient_count coefficients, in O(max_l^3). The output must not alias the coefficients.
+template<typename precision, typename coefficient_type>
+__host__ __device__ void rotate(
+  const unsigned int      coefficient_count  ,
+  const precision*        matrix             ,
+  const coefficient_type* coefficients       ,
+  coefficient_type*       output_coefficients)
+{
+  for (auto index = 0u; index < coefficient_count; index++)
+    output_coefficients[index] = convert<coefficient_type>(rotate_coefficient(index, matrix, coefficients));
+}
+
+// Bytes of dynamic shared memory required per block by rotate_voxels, i.e. the blocks 0 and 1 and two blocks of the
+// maximum degree, O(max_l^2) rather than the O(max_l^3) of the whole matrix, e.g. 60 KB rather than 318 KB for double
+// at max_l = 30. Beyond default_shared_size the launch opts in to more (see reserve_shared_memory).
+template<typename precision>
+__host__ __device__ unsigned int rotate_voxels_shared_size(const unsigned int coefficient_count)
+{
+  auto width = 2 * maximum_degree(coefficient_count) + 1;
+  return (rotation_matrix_size(1) + 2 * width * width) * sizeof(compute_precision_t<precision>);
+}
+#ifndef CUSH_CPU_ONLY
+// Call on a dimensions.x * dimensions.y * dimensions.z * coefficient_count 1D grid.
+// Rotates every voxel by the same matrix of calculate_rotation_matrix.
+template<typename precision>
+__global__ void rotate(
+  const uint3                            dimensions         ,
+  const unsigned int                     coefficient_count  ,
+  const compute_precision_t<precision>*  matrix             ,
+  const precision*                       coefficients       ,
+  precision*                             output_coefficients)
+{
+  auto global_index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (global_index >= dimensions.x * dimensions.y * dimensions.z * coefficient_count)
+    return;
+
+  auto index               = global_index % coefficient_count;
+  auto coefficients_offset = global_index - index;
+  output_coefficients[global_index] = convert<precision>(rotate_coefficient(index, matrix, coefficients + coefficients_offset));
+}
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel, with
+// rotate_voxels_shared_size<precision>(coefficient_count) bytes of dynamic shared memory.
+// Rotates each voxel by its own row-major 3 x 3 rotation (9 per voxel). The threads of a block compute the elements of
+// each degree's block in parallel into shared memory, then the rotated coefficients of that degree. Since each block
+// only depends on the blocks 1 and l - 1, the blocks beyond 1 alternate between two buffers.
+template<typename precision>
+__global__ void rotate_voxels(
+  const uint3                            dimensions         ,
+  const unsigned int                     coefficient_count  ,
+  const compute_precision_t<precision>*  rotations          ,
+  const precision*                       coefficients       ,
+  precision*                             output_coefficients)
+{
+  using compute_type = compute_precision_t<precision>;
+
+  extern __shared__ unsigned char rotate_voxels_memory[];
+
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
+    return;
+
+  auto max_l   = maximum_degree(coefficient_count);
+  auto width   = 2 * max_l + 1;
+  auto matrix  = reinterpret_cast<compute_type*>(rotate_voxels_memory);
+  auto buffers = matrix + rotation_matrix_size(1);
+  if (threadIdx.x == 0)
+    calculate_rotation_blocks_01(rotations + static_cast<size_t>(volume_index) * 9, matrix);
+  __syncthreads();
+
+  auto voxel_coefficients = coefficients        + static_cast<size_t>(volume_index) * coefficient_count;
+  auto voxel_output       = output_coefficients + static_cast<size_t>(volume_index) * coefficient_count;
+  auto previous           = matrix + rotation_block_offset(1);
+  for (auto l = 0u; l <= max_l; l++)
+  {
+    auto size  = 2 * l + 1;
+    auto block = l < 2 ? matrix + rotation_block_offset(l) : buffers + (l % 2) * width * width;
+    if (l >= 2)
+    {
+      // The buffer of block l - 2 is free, all threads have rotated degree l - 2 before the barrier of block l - 1.
+      for (auto element = threadIdx.x; element < size * size; element += blockDim.x)
+        block[element] = rotation_element(l, int(element / size) - int(l), int(element % size) - int(l), matrix + rotation_block_offset(1), previous);
+      __syncthreads();
+    }
+
+    for (auto row = threadIdx.x; row < size; row += blockDim.x)
+    {
+      auto m = int(row) - int(l);
+      if (coefficient_index(l, m) >= coefficient_count)
+        continue;
+      compute_type value(0);
+      for (auto n = -int(l); n <= int(l); n++)
+        value += condon_shortley_element(m, n, block[row * size + (int(l) + n)]) * convert<compute_type>(voxel_coefficients[coefficient_index(l, n)]);
+      voxel_output[coefficient_index(l, m)] = convert<precision>(value);
+    }
+    previous = block;
+  }
+}
+
+// The matrix of a single rotation in device memory, for rotate.
+template<typename precision>
+class rotation_table
+{
+public:
+  // The rotation is row-major 3 x 3, in host memory.
+  rotation_table           (const unsigned int max_l, const precision* rotation) : max_l_(max_l)
+  {
+    std::vector<precision> matrix(size());
+    calculate_rotation_matrix(max_l_, rotation, matrix.data());
+
+    cudaMalloc(reinterpret_cast<void**>(&matrix_), size() * sizeof(precision));
+    cudaMemcpy(matrix_, matrix.data(), size() * sizeof(precision), cudaMemcpyHostToDevice);
+  }
+  rotation_table           (const rotation_table&  that) = delete ;
+  rotation_table           (      rotation_table&& temp) : max_l_(temp.max_l_), matrix_(temp.matrix_)
+  {
+    temp.matrix_ = nullptr;
+  }
+ ~rotation_table           ()
+  {
+    if (matrix_ != nullptr)
+      cudaFree(matrix_);
+  }
+  rotation_table& operator=(const rotation_table&  that) = delete ;
+  rotation_table& operator=(      rotation_table&& temp) = delete ;
+
+  unsigned int     max_l            () const
+  {
+    return max_l_;
+  }
+  unsigned int     coefficient_count() const
+  {
+    return (max_l_ + 1) * (max_l_ + 1);
+  }
+  unsigned int     size             () const
+  {
+    return rotation_matrix_size(max_l_);
+  }
+  const precision* matrix           () const
+  {
+    return matrix_;
+  }
+
+protected:
+  unsigned int max_l_  = 0;
+  precision*   matrix_ = nullptr;
+};
+
+template<typename precision>
+void launch_rotate(
+  const uint3                                           dimensions         ,
+  const rotation_table<compute_precision_t<precision>>& table              ,
+  const precision*                                      coefficients       ,
+  precision*                                            output_coefficients,
+  cudaStream_t                                          stream             = nullptr)
+{
+  using kernel_type = void (*)(uint3, unsigned int, const compute_precision_t<precision>*, const precision*, precision*);
+
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("rotate", stream, voxel_count, 2 * static_cast<size_t>(voxel_count) * table.coefficient_count() * sizeof(precision));
+  profile_zero_voxels(profile, voxel_count, table.coefficient_count(), coefficients);
+
+  launch_1d(static_cast<kernel_type>(rotate<precision>), thread_grid(dimensions.x * dimensions.y * dimensions.z * table.coefficient_count()), 0, stream,
+    dimensions               ,
+    table.coefficient_count(),
+    table.matrix           (),
+    coefficients             ,
+    output_coefficients      );
+}
+template<typename precision>
+void launch_rotate_voxels(
+  const uint3                           dimensions         ,
+  const unsigned int                    coefficient_count  ,
+  const compute_precision_t<precision>* rotations          ,
+  const precision*                      coefficients       ,
+  precision*                            output_coefficients,
+  cudaStream_t                          stream             = nullptr)
+{
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("rotate_voxels", stream, voxel_count, static_cast<size_t>(voxel_count) * (2 * coefficient_count * sizeof(precision) + 9 * sizeof(compute_precision_t<precision>)));
+  profile_zero_voxels(profile, voxel_count, coefficient_count, coefficients);
+  launch_1d(rotate_voxels<precision>, block_grid(dimensions.x * dimensions.y * dimensions.z), rotate_voxels_shared_size<precision>(coefficient_count), stream,
+    dimensions         ,
+    coefficient_count  ,
+    rotations          ,
+    coefficients       ,
+    output_coefficients);
+}
+#endif
+}
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef CUSH_SAMPLING_H_
+#define CUSH_SAMPLING_H_
+
+#define _USE_MATH_DEFINES
+
+#include <cublas_v2.h>
+#include <cuda_runtime_api.h>
+#include <device_launch_parameters.h>
+#include <math.h>
+#include <vector_types.h>
+
+#include <cush/blas.h>
+#include <cush/launch.h>
+#include <cush/reduce.h>
+#include <cush/spherical_harmonics.h>
+
+// Sampling of many voxels on a fixed tessellation by a GEMM of their coefficients and a cached basis matrix.
+namespace cush
+{
+// Call on a tessellations.x x tessellations.y 2D grid.
+// Writes the row of each point of the sample_sum tessellation into the column-major points_size x coefficient_count
+// basis matrix, and its six indices into output_indices.
+template<typename precision>
+__global__ void calculate_sampling_basis(
+  const uint2        tessellations    ,
+  const unsigned int coefficient_count,
+  precision*         output_basis     ,
+  unsigned int*      output_indices   )
+{
+  auto longitude = blockIdx.x * blockDim.x + threadIdx.x;
+  auto latitude  = blockIdx.y * blockDim.y + threadIdx.y;
+
+  if (longitude >= tessellations.x ||
+      latitude  >= tessellations.y )
+    return;
+
+  auto point_offset = latitude + longitude * tessellations.y;
+  auto direction    = double3 {0.0, 2 * M_PI * longitude / tessellations.x, M_PI * latitude / (tessellations.y - 1)};
+  calculate_matrix_row(point_offset, tessellations.x * tessellations.y, coefficient_count, direction, output_basis, false, matrix_layout::column_major);
+  sample_indices(tessellations, longitude, latitude, output_indices);
+}
+// Call on a voxel_count * index_count 1D grid.
+// Repeats the index_count indices of a single voxel for voxel_count voxels, offsetting each by points_size per voxel.
+template<typename index_type>
+__global__ void offset_indices(
+  const unsigned int  voxel_count   ,
+  const unsigned int  index_count   ,
+  const unsigned int  points_size   ,
+  const index_type*   input_indices ,
+  index_type*         output_indices,
+  const index_type    base_index    = 0)
+{
+  auto global_index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (global_index >= voxel_count * index_count)
+    return;
+
+  auto voxel_index = global_index / index_count;
+  output_indices[global_index] = base_index + voxel_index * points_size + input_indices[global_index % index_count];
+}
+// Call on a voxel_count 1D grid of 1D blocks, i.e. a block per voxel.
+// Divides the voxel-major voxel_count x points_size values by their per voxel maximum.
+template<typename precision>
+__global__ void normalize_values(
+  const unsigned int voxel_count,
+  const unsigned int points_size,
+  precision*         values     )
+{
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= voxel_count)
+    return;
+
+  auto voxel_values = values + volume_index * points_size;
+  auto maximum      = precision(0);
+  for (auto point_offset = threadIdx.x; point_offset < points_size; point_offset += blockDim.x)
+    if (maximum < voxel_values[point_offset])
+      maximum = voxel_values[point_offset];
+
+  maximum = block_reduce(maximum, maximum_operation<precision>(), precision(0));
+  for (auto point_offset = threadIdx.x; point_offset < points_size; point_offset += blockDim.x)
+    voxel_values[point_offset] /= maximum;
+}
+
+// Samples all voxels on a single tessellation. The points_size x coefficient_count basis matrix and the indices are
+// computed once on construction, after which sampling a volume is one GEMM of the basis matrix and the coefficients,
+// i.e. bandwidth-bound rather than bound by the evaluation of the basis functions at every point of every voxel.
+// The points are ordered as in sample_sum, i.e. the direction of point offset o is
+// (2 pi (o / tessellations.y) / tessellations.x, pi (o % tessellations.y) / (tessellations.y - 1)).
+template<typename precision>
+class sampling_plan
+{
+public:
+  sampling_plan           (
+    const uint2        tessellations    ,
+    const unsigned int coefficient_count,
+    cudaStream_t       stream           = nullptr)
+  : tessellations_(tessellations), coefficient_count_(coefficient_count), stream_(stream)
+  {
+    cublasCreate    (&cublas_);
+    cublasSetStream ( cublas_, stream);
+
+    cudaMalloc(reinterpret_cast<void**>(&basis_)  , points_size() * coefficient_count * sizeof(precision));
+    cudaMalloc(reinterpret_cast<void**>(&indices_), index_count()                     * sizeof(unsigned int));
+
+    launch_2d(calculate_sampling_basis<precision>, dim3(tessellations.x, tessellations.y), 0, stream,
+      tessellations    ,
+      coefficient_count,
+      basis_           ,
+      indices_         );
+  }
+  sampling_plan           (const sampling_plan&  that) = delete ;
+  sampling_plan           (      sampling_plan&& temp) : tessellations_(temp.tessellations_), coefficient_count_(temp.coefficient_count_), basis_(temp.basis_), indices_(temp.indices_), cublas_(temp.cublas_), stream_(temp.stream_)
+  {
+    temp.basis_   = nullptr;
+    temp.indices_ = nullptr;
+    temp.cublas_  = nullptr;
+  }
+ ~sampling_plan           ()
+  {
+    if (basis_ != nullptr)
+      cudaFree(basis_);
+    if (indices_ != nullptr)
+      cudaFree(indices_);
+    if (cublas_ != nullptr)
+      cublasDestroy(cublas_);
+  }
+  sampling_plan& operator=(const sampling_plan&  that) = delete ;
+  sampling_plan& operator=(      sampling_plan&& temp) = delete ;
+
+  // The coefficients are voxel_count x coefficient_count and the values voxel_count x points_size, voxel-major.
+  void                sample           (const unsigned int voxel_count, const precision* coefficients, precision* values, const bool normalize = false) const
+  {
+    const precision alpha(1), beta(0);
+    gemm(cublas_, CUBLAS_OP_N, CUBLAS_OP_N, points_size(), voxel_count, coefficient_count_,
+      &alpha, basis_, points_size(), coefficients, coefficient_count_, &beta, values, points_size());
+    if (normalize)
+      launch_1d(normalize_values<precision>, block_grid(voxel_count), 0, stream_, voxel_count, points_size(), values);
+  }
+  void                sample           (const uint3        dimensions , const precision* coefficients, precision* values, const bool normalize = false) const
+  {
+    sample(dimensions.x * dimensions.y * dimensions.z, coefficients, values, normalize);
+  }
+  // As sample, on stream instead of the stream of construction, e.g. for the streams of a slab_executor.
+  void                sample           (const unsigned int voxel_count, const precision* coefficients, precision* values, const bool normalize, cudaStream_t stream) const
+  {
+    const precision alpha(1), beta(0);
+    cudaStream_t plan_stream;
+    cublasGetStream(cublas_, &plan_stream);
+    cublasSetStream(cublas_, stream);
+    gemm(cublas_, CUBLAS_OP_N, CUBLAS_OP_N, points_size(), voxel_count, coefficient_count_,
+      &alpha, basis_, points_size(), coefficients, coefficient_count_, &beta, values, points_size());
+    cublasSetStream(cublas_, plan_stream);
+    if (normalize)
+      launch_1d(normalize_values<precision>, block_grid(voxel_count), 0, stream, voxel_count, points_size(), values);
+  }
+  // Writes the voxel_count * index_count() indices of voxel_count voxels, as sample_sums would with base_index.
+  void                expand_indices   (const unsigned int voxel_count, unsigned int* output_indices, const unsigned int base_index = 0) const
+  {
+    launch_1d(offset_indices<unsigned int>, thread_grid(voxel_count * index_count()), 0, stream_,
+      voxel_count, index_count(), points_size(), indices_, output_indices, base_index);
+  }
+
+  uint2               tessellations    () const
+  {
+    return tessellations_;
+  }
+  unsigned int        coefficient_count() const
+  {
+    return coefficient_count_;
+  }
+  unsigned int        points_size      () const
+  {
+    return tessellations_.x * tessellations_.y;
+  }
+  unsigned int        index_count      () const
+  {
+    return 6 * points_size();
+  }
+  // Column-major points_size x coefficient_count.
+  const precision*    basis            () const
+  {
+    return basis_;
+  }
+  // The index_count indices of a single voxel.
+  const unsigned int* indices          () const
+  {
+    return indices_;
+  }
+
+protected:
+  uint2          tessellations_     = {0, 0};
+  unsigned int   coefficient_count_ = 0;
+  precision*     basis_             = nullptr;
+  unsigned int*  indices_           = nullptr;
+  cublasHandle_t cublas_            = nullptr;
+  cudaStream_t   stream_            = nullptr;
+};
+}
+
+#endif
@@ -3,16 +3,28 @@
 
 #define _USE_MATH_DEFINES
 
+#ifndef CUSH_CPU_ONLY
 #include <cuda_runtime_api.h>
 #include <device_launch_parameters.h>
+#endif
 #include <math.h>
-#include <vector_types.h>
-#include <thrust/sort.h>
+#include <type_traits>
 
 #include <cush/clebsch_gordan.h>
 #include <cush/factorial.h>
+#include <cush/gaunt.h>
+#ifndef CUSH_CPU_ONLY
 #include <cush/launch.h>
+#endif
+#include <cush/layout.h>
 #include <cush/legendre.h>
+#include <cush/math.h>
+#include <cush/portability.h>
+#include <cush/precision.h>
+#include <cush/profile.h>
+#ifndef CUSH_CPU_ONLY
+#include <cush/reduce.h>
+#endif
 
 // Based on "Spherical Harmonic Lighting: The Gritty Details" by Robin Green.
 namespace cush
@@ -21,11 +33,11 @@ __forceinline__ __host__ __device__ unsigned int maximum_degree   (const unsigne
 {
   return unsigned(sqrtf(float(coefficient_count)) - 1);
 }
-__forceinline__ __host__ __device__ unsigned int coefficient_count(const unsigned int max_l)
+__forceinline__ __host__ __device__ constexpr unsigned int coefficient_count(const unsigned int max_l)
 {
   return (max_l + 1) * (max_l + 1);
 }
-__forceinline__ __host__ __device__ unsigned int coefficient_index(const unsigned int l, const int m)
+__forceinline__ __host__ __device__ constexpr unsigned int coefficient_index(const unsigned int l, const int m)
 {
   return l * (l + 1) + m;
 }
@@ -37,6 +49,45 @@ __forceinline__ __host__ __device__ int2         coefficient_lm   (const unsigne
   return lm;
 }
 
+// Calls function(std::integral_constant<unsigned int, max_l>()) if max_l is one of the degrees with fixed degree
+// specializations, in which loops over the coefficients are unrolled and per thread coefficients stay in registers.
+// Returns false otherwise, in which case the caller falls back to the runtime degree variant.
+template<typename function_type>
+__host__ __device__ bool dispatch_max_l(const unsigned int max_l, function_type function)
+{
+  switch (max_l)
+  {
+    case 2: function(std::integral_constant<unsigned int, 2>()); return true;
+    case 4: function(std::integral_constant<unsigned int, 4>()); return true;
+    case 6: function(std::integral_constant<unsigned int, 6>()); return true;
+    case 8: function(std::integral_constant<unsigned int, 8>()); return true;
+    default: return false;
+  }
+}
+// A degree known at compile time, which the fixed degree variants pass as max_l to for_each_harmonic and
+// for_each_harmonic_derivatives, so that their loops have constant bounds and unroll fully.
+template<unsigned int max_l>
+struct fixed_degree
+{
+  __forceinline__ __host__ __device__ constexpr operator unsigned int() const
+  {
+    return max_l;
+  }
+};
+// Copies the coefficient_count(max_l) coefficients of an array (see evaluate_sum) into output in their compute precision.
+// A local output array stays in registers as long as it is only indexed by constants, i.e. by the fixed degree variants,
+// hence the fixed degree kernels which evaluate a voxel at many points read its coefficients from memory once.
+template<unsigned int max_l, typename coefficients_type>
+__forceinline__ __host__ __device__ void load_coefficients(
+  const coefficients_type                                 coefficients,
+  compute_precision_t<array_value_t<coefficients_type>>*  output      )
+{
+  CUSH_UNROLL
+  for (auto index = 0u; index < coefficient_count(max_l); index++)
+    output[index] = convert<compute_precision_t<array_value_t<coefficients_type>>>(coefficients[index]);
+}
+
+// O(l) per basis function, through normalized_associated_legendre, hence accurate at any degree.
 template<typename precision>
 __host__ __device__ precision evaluate(
   const unsigned int l    ,
@@ -44,13 +95,12 @@ __host__ __device__ precision evaluate(
   const precision&   theta,
   const precision&   phi  )
 {
-  precision kml = sqrt((2.0 * l + 1) * factorial<precision>(l - abs(m)) / 
-                       (4.0 * M_PI   * factorial<precision>(l + abs(m))));
+  precision p_lm = normalized_associated_legendre(int(l), abs(m), math::cos(phi));
   if (m > 0)
-    return sqrt(2.0) * kml * cos( m * theta) * associated_legendre(l,  m, cos(phi));
+    return math::sqrt(precision(2)) * p_lm * math::cos(precision( m) * theta);
   if (m < 0)
-    return sqrt(2.0) * kml * sin(-m * theta) * associated_legendre(l, -m, cos(phi));
-  return kml * associated_legendre(l, 0, cos(phi));
+    return math::sqrt(precision(2)) * p_lm * math::sin(precision(-m) * theta);
+  return p_lm;
 }
 template<typename precision>
 __host__ __device__ precision evaluate(
@@ -62,104 +112,476 @@ __host__ __device__ precision evaluate(
   return evaluate(lm.x, lm.y, theta, phi);
 }
 
-// Not used internally as the two for loops can also be further parallelized.
+// Calls function(index, value) for every basis function up to max_l in a single pass over (theta, phi), in O(max_l^2).
+// Uses the recurrences of the normalized associated Legendre polynomials K_lm P_lm, which fold the normalization into the
+// recurrence coefficients, and the Chebyshev recurrences for cos(m theta) and sin(m theta). The max_l is an unsigned int,
+// or a fixed_degree whose loops unroll into a straight sequence of constant indices.
+template<typename precision, typename degree_type, typename function_type>
+__forceinline__ __host__ __device__ void for_each_harmonic(
+  const degree_type  max_l   ,
+  const precision&   theta   ,
+  const precision&   phi     ,
+  function_type      function)
+{
+  const precision x         = math::cos (phi);
+  const precision y         = math::sqrt(precision(1) - x * x);
+  const precision sqrt_2    = math::sqrt(precision(2));
+  precision cos_theta, sin_theta;
+  math::sincos(theta, &sin_theta, &cos_theta);
+
+  precision p_mm  = math::rsqrt(precision(4) * pi<precision>());
+  precision cos_m = 1, cos_m1 = cos_theta;
+  precision sin_m = 0, sin_m1 = -sin_theta;
+  CUSH_UNROLL
+  for (int m = 0; m <= int(max_l); m++)
+  {
+    if (m > 0)
+    {
+      p_mm *= -math::sqrt_ratio(precision(2 * m + 1), precision(2 * m)) * y;
+
+      auto cos_m2 = cos_m1, sin_m2 = sin_m1;
+      cos_m1 = cos_m;
+      sin_m1 = sin_m;
+      cos_m  = 2 * cos_theta * cos_m1 - cos_m2;
+      sin_m  = 2 * cos_theta * sin_m1 - sin_m2;
+    }
+
+    precision p_l2m(0), p_l1m(0), p_lm(p_mm);
+    CUSH_UNROLL
+    for (int l = m; l <= int(max_l); l++)
+    {
+      if (l == m + 1)
+        p_lm = math::sqrt(precision(2 * m + 3)) * x * p_l1m;
+      else if (l > m + 1)
+        p_lm = math::sqrt_ratio(precision(4 * l * l - 1), precision(l * l - m * m)) * 
+               (x * p_l1m - math::sqrt_ratio(precision((l - 1) * (l - 1) - m * m), precision(4 * (l - 1) * (l - 1) - 1)) * p_l2m);
+
+      if (m == 0)
+        function(coefficient_index(l, 0), p_lm);
+      else
+      {
+        function(coefficient_index(l,  m), sqrt_2 * p_lm * cos_m);
+        function(coefficient_index(l, -m), sqrt_2 * p_lm * sin_m);
+      }
+
+      p_l2m = p_l1m;
+      p_l1m = p_lm ;
+    }
+  }
+}
+// Fills output[index * stride] with every basis function up to max_l at (theta, phi).
 template<typename precision>
+__host__ __device__ void evaluate_all(
+  const unsigned int max_l ,
+  const precision&   theta ,
+  const precision&   phi   ,
+  precision*         output,
+  const unsigned int stride = 1)
+{
+  for_each_harmonic(max_l, theta, phi, [&] (const unsigned int index, const precision& value)
+  {
+    output[index * stride] = value;
+  });
+}
+// Fixed degree variant, with the constant loop bounds of fixed_degree. The indices passed to function are constants.
+template<unsigned int max_l, typename precision, typename function_type>
+__forceinline__ __host__ __device__ void for_each_harmonic(
+  const precision&   theta   ,
+  const precision&   phi     ,
+  function_type      function)
+{
+  for_each_harmonic(fixed_degree<max_l>(), theta, phi, function);
+}
+template<typename precision, unsigned int max_l>
+__host__ __device__ void evaluate_all(
+  const precision&   theta ,
+  const precision&   phi   ,
+  precision*         output)
+{
+  for_each_harmonic<max_l>(theta, phi, [&] (const unsigned int index, const precision& value)
+  {
+    output[index] = value;
+  });
+}
+
+// First and second partial derivatives of a function on the sphere with respect to theta (azimuth) and phi (polar).
+template<typename precision>
+struct harmonic_derivatives
+{
+  precision value      ;
+  precision theta      ;
+  precision phi        ;
+  precision theta_theta;
+  precision theta_phi  ;
+  precision phi_phi    ;
+};
+
+// Calls function(index, derivatives) for every basis function up to max_l in a single pass over (theta, phi), in O(max_l^2).
+// The phi derivatives of the normalized associated Legendre polynomials follow from
+// sin(phi) dP_lm / dphi = l cos(phi) P_lm - sqrt((2l + 1) (l^2 - m^2) / (2l - 1)) P_(l-1)m and the Legendre differential
+// equation, hence these are singular at the poles and phi should be kept away from 0 and pi. The max_l is an unsigned int
+// or a fixed_degree, as for for_each_harmonic.
+template<typename precision, typename degree_type, typename function_type>
+__forceinline__ __host__ __device__ void for_each_harmonic_derivatives(
+  const degree_type  max_l   ,
+  const precision&   theta   ,
+  const precision&   phi     ,
+  function_type      function)
+{
+  precision x, y, cos_theta, sin_theta;
+  math::sincos(phi  , &y        , &x        );
+  math::sincos(theta, &sin_theta, &cos_theta);
+  const precision cot_phi   = x / y;
+  const precision sqrt_2    = math::sqrt(precision(2));
+
+  precision p_mm  = math::rsqrt(precision(4) * pi<precision>());
+  precision cos_m = 1, cos_m1 = cos_theta;
+  precision sin_m = 0, sin_m1 = -sin_theta;
+  CUSH_UNROLL
+  for (int m = 0; m <= int(max_l); m++)
+  {
+    if (m > 0)
+    {
+      p_mm *= -math::sqrt_ratio(precision(2 * m + 1), precision(2 * m)) * y;
+
+      auto cos_m2 = cos_m1, sin_m2 = sin_m1;
+      cos_m1 = cos_m;
+      sin_m1 = sin_m;
+      cos_m  = 2 * cos_theta * cos_m1 - cos_m2;
+      sin_m  = 2 * cos_theta * sin_m1 - sin_m2;
+    }
+
+    precision p_l2m(0), p_l1m(0), p_lm(p_mm);
+    CUSH_UNROLL
+    for (int l = m; l <= int(max_l); l++)
+    {
+      if (l == m + 1)
+        p_lm = math::sqrt(precision(2 * m + 3)) * x * p_l1m;
+      else if (l > m + 1)
+        p_lm = math::sqrt_ratio(precision(4 * l * l - 1), precision(l * l - m * m)) * 
+               (x * p_l1m - math::sqrt_ratio(precision((l - 1) * (l - 1) - m * m), precision(4 * (l - 1) * (l - 1) - 1)) * p_l2m);
+
+      precision dp_lm  = (l * x * p_lm - (l > m ? math::sqrt_ratio(precision((2 * l + 1) * (l * l - m * m)), precision(2 * l - 1)) * p_l1m : precision(0))) / y;
+      precision ddp_lm = -cot_phi * dp_lm - (precision(l * (l + 1)) - precision(m * m) / (y * y)) * p_lm;
+
+      if (m == 0)
+        function(coefficient_index(l, 0), harmonic_derivatives<precision> {p_lm, 0, dp_lm, 0, 0, ddp_lm});
+      else
+      {
+        auto cos_lm = sqrt_2 * cos_m, sin_lm = sqrt_2 * sin_m;
+        function(coefficient_index(l,  m), harmonic_derivatives<precision> {
+          p_lm * cos_lm, -m * p_lm * sin_lm, dp_lm * cos_lm, -m * m * p_lm * cos_lm, -m * dp_lm * sin_lm, ddp_lm * cos_lm});
+        function(coefficient_index(l, -m), harmonic_derivatives<precision> {
+          p_lm * sin_lm,  m * p_lm * cos_lm, dp_lm * sin_lm, -m * m * p_lm * sin_lm,  m * dp_lm * cos_lm, ddp_lm * sin_lm});
+      }
+
+      p_l2m = p_l1m;
+      p_l1m = p_lm ;
+    }
+  }
+}
+template<typename precision, typename degree_type, typename coefficients_type>
+__host__ __device__ harmonic_derivatives<precision> evaluate_sum_derivatives(
+  const degree_type       max_l       ,
+  const precision&        theta       ,
+  const precision&        phi         ,
+  const coefficients_type coefficients)
+{
+  harmonic_derivatives<precision> sum {0, 0, 0, 0, 0, 0};
+  for_each_harmonic_derivatives(max_l, theta, phi, [&] (const unsigned int index, const harmonic_derivatives<precision>& derivatives)
+  {
+    auto coefficient = convert<precision>(coefficients[index]);
+    sum.value       += derivatives.value       * coefficient;
+    sum.theta       += derivatives.theta       * coefficient;
+    sum.phi         += derivatives.phi         * coefficient;
+    sum.theta_theta += derivatives.theta_theta * coefficient;
+    sum.theta_phi   += derivatives.theta_phi   * coefficient;
+    sum.phi_phi     += derivatives.phi_phi     * coefficient;
+  });
+  return sum;
+}
+template<unsigned int max_l, typename precision, typename coefficients_type>
+__host__ __device__ harmonic_derivatives<precision> evaluate_sum_derivatives(
+  const precision&        theta       ,
+  const precision&        phi         ,
+  const coefficients_type coefficients)
+{
+  return evaluate_sum_derivatives(fixed_degree<max_l>(), theta, phi, coefficients);
+}
+
+// The coefficients are an array, i.e. a pointer or a strided_array (see layout.h), and may be stored in a lower precision
+// (see compute_precision), the sum is accumulated in precision.
+template<typename precision, typename coefficients_type>
 __host__ __device__ precision evaluate_sum(
-  const unsigned int max_l       ,
-  const precision&   theta       ,
-  const precision&   phi         ,
-  const precision*   coefficients)
+  const unsigned int      max_l       ,
+  const precision&        theta       ,
+  const precision&        phi         ,
+  const coefficients_type coefficients)
 {
-  precision sum = 0.0;
-  for (int l = 0; l <= max_l; l++)
-    for (int m = -l; m <= l; m++)
-      sum += evaluate(l, m, theta, phi) * coefficients[coefficient_index(l, m)];
+  precision sum(0);
+  for_each_harmonic(max_l, theta, phi, [&] (const unsigned int index, const precision& value)
+  {
+    sum += value * convert<precision>(coefficients[index]);
+  });
+  return sum;
+}
+template<unsigned int max_l, typename precision, typename coefficients_type>
+__host__ __device__ precision evaluate_sum(
+  const precision&        theta       ,
+  const precision&        phi         ,
+  const coefficients_type coefficients)
+{
+  precision sum(0);
+  for_each_harmonic<max_l>(theta, phi, [&] (const unsigned int index, const precision& value)
+  {
+    sum += value * convert<precision>(coefficients[index]);
+  });
   return sum;
 }
 
-template<typename precision>
-__host__ __device__ precision is_zero(
-  const unsigned int coefficient_count,
-  const precision*   coefficients )
+// The coefficients are a pointer or a strided_array (see layout.h).
+template<typename coefficients_type>
+__host__ __device__ bool is_zero(
+  const unsigned int      coefficient_count,
+  const coefficients_type coefficients     )
 {
-  for (auto index = 0; index < coefficient_count; index++)
-    if (coefficients[index] != precision(0))
+  for (auto index = 0u; index < coefficient_count; index++)
+    if (convert<compute_precision_t<array_value_t<coefficients_type>>>(coefficients[index]) != 0)
       return false;
   return true;
 }
 
+// The distances are accumulated in compute_precision_t<precision>.
 template<typename precision>
-__host__ __device__ precision l1_distance(
+__host__ __device__ compute_precision_t<precision> l1_distance(
   const unsigned int coefficient_count,
   const precision*   lhs_coefficients ,
   const precision*   rhs_coefficients )
 {
-  precision value = 0;
-  for (auto index = 0; index < coefficient_count; index++)
-    value += abs(lhs_coefficients[index] - rhs_coefficients[index]);
+  using compute_type = compute_precision_t<precision>;
+
+  compute_type value(0);
+  for (auto index = 0u; index < coefficient_count; index++)
+    value += abs(convert<compute_type>(lhs_coefficients[index]) - convert<compute_type>(rhs_coefficients[index]));
+  return value;
+}
+template<unsigned int max_l, typename precision>
+__host__ __device__ compute_precision_t<precision> l1_distance(
+  const precision*   lhs_coefficients ,
+  const precision*   rhs_coefficients )
+{
+  using compute_type = compute_precision_t<precision>;
+
+  compute_type value(0);
+CUSH_UNROLL
+  for (auto index = 0u; index < coefficient_count(max_l); index++)
+    value += abs(convert<compute_type>(lhs_coefficients[index]) - convert<compute_type>(rhs_coefficients[index]));
   return value;
 }
 
 // Based on "Rotation Invariant Spherical Harmonic Representation of 3D Shape Descriptors" by Kazhdan et al.
 template<typename precision>
-__host__ __device__ precision l2_distance(
+__host__ __device__ compute_precision_t<precision> l2_distance(
   const unsigned int coefficient_count,
   const precision*   lhs_coefficients ,
   const precision*   rhs_coefficients )
 {
-  precision value = 0;
-  for (auto index = 0; index < coefficient_count; index++)
-    value += pow(lhs_coefficients[index] - rhs_coefficients[index], 2);
-  return sqrt(value);
+  using compute_type = compute_precision_t<precision>;
+
+  compute_type value(0);
+  for (auto index = 0u; index < coefficient_count; index++)
+  {
+    auto difference = convert<compute_type>(lhs_coefficients[index]) - convert<compute_type>(rhs_coefficients[index]);
+    value += difference * difference;
+  }
+  return math::sqrt(value);
+}
+template<unsigned int max_l, typename precision>
+__host__ __device__ compute_precision_t<precision> l2_distance(
+  const precision*   lhs_coefficients ,
+  const precision*   rhs_coefficients )
+{
+  using compute_type = compute_precision_t<precision>;
+
+  compute_type value(0);
+CUSH_UNROLL
+  for (auto index = 0u; index < coefficient_count(max_l); index++)
+  {
+    auto difference = convert<compute_type>(lhs_coefficients[index]) - convert<compute_type>(rhs_coefficients[index]);
+    value += difference * difference;
+  }
+  return math::sqrt(value);
+}
+
+// Also based on Kazhdan et al. The norm of the degree l component ||f_l|| = sqrt(sum_m c_lm^2) is invariant to rotations,
+// since the rotations act orthogonally on the 2l + 1 coefficients of each degree. Comparing the max_l + 1 norms of two
+// functions with l2_distance therefore compares them up to rotation, without searching over rotations.
+template<typename precision>
+__host__ __device__ compute_precision_t<precision> degree_energy(
+  const unsigned int l           ,
+  const precision*   coefficients)
+{
+  using compute_type = compute_precision_t<precision>;
+
+  compute_type value(0);
+  for (auto m = -int(l); m <= int(l); m++)
+  {
+    auto coefficient = convert<compute_type>(coefficients[coefficient_index(l, m)]);
+    value += coefficient * coefficient;
+  }
+  return math::sqrt(value);
+}
+// Writes ||f_l|| for l = 0..max_l to output_descriptor.
+template<typename precision>
+__host__ __device__ void energy_descriptor(
+  const unsigned int max_l            ,
+  const precision*   coefficients     ,
+  precision*         output_descriptor)
+{
+  for (auto l = 0u; l <= max_l; l++)
+    output_descriptor[l] = convert<precision>(degree_energy(l, coefficients));
+}
+template<unsigned int max_l, typename precision>
+__host__ __device__ void energy_descriptor(
+  const precision*   coefficients     ,
+  precision*         output_descriptor)
+{
+CUSH_UNROLL
+  for (auto l = 0u; l <= max_l; l++)
+    output_descriptor[l] = convert<precision>(degree_energy(l, coefficients));
+}
+
+// Based on the Funk-Hecke theorem: the convolution of f with a zonal (i.e. axially symmetric about z) kernel h scales the
+// coefficients of degree l by sqrt(4 pi / (2l + 1)) h_l0. Writes these max_l + 1 scales given the max_l + 1 zonal
+// coefficients h_l0 of the kernel, for convolve_zonal.
+template<typename precision>
+__host__ __device__ void zonal_convolution_scales(
+  const unsigned int max_l             ,
+  const precision*   zonal_coefficients,
+  precision*         output_scales     )
+{
+  for (auto l = 0u; l <= max_l; l++)
+    output_scales[l] = math::sqrt(precision(4) * pi<precision>() / precision(2 * l + 1)) * zonal_coefficients[l];
 }
 
-// Call on a vector_count x coefficient_count(max_l) 2D grid.
+enum class matrix_layout
+{
+  column_major, // Element (vector, column) at vector + vector_count * column, as expected by cuBLAS and cuSOLVER.
+  row_major     // Element (vector, column) at vector * column_count + column.
+};
+
+// The even degree only matrices compact the columns of the even degrees, i.e. they have (max_l + 1)(max_l + 2) / 2
+// columns for an even max_l, ordered by coefficient index.
+__forceinline__ __host__ __device__ constexpr unsigned int even_coefficient_count(const unsigned int max_l)
+{
+  return (max_l / 2 + 1) * (2 * (max_l / 2) + 1);
+}
+__forceinline__ __host__ __device__ constexpr unsigned int even_coefficient_index(const unsigned int l, const int m)
+{
+  return l * (l + 1) / 2 + m;
+}
+__forceinline__ __host__ __device__ unsigned int matrix_column_count(const unsigned int coefficient_count, const bool even_only)
+{
+  return even_only ? even_coefficient_count(maximum_degree(coefficient_count)) : coefficient_count;
+}
+
+// Writes the row of the vector_index'th vector of the vector_count x matrix_column_count(...) matrix.
+template<typename vector_type, typename precision>
+__host__ __device__ void calculate_matrix_row(
+  const unsigned int  vector_index     ,
+  const unsigned int  vector_count     ,
+  const unsigned int  coefficient_count,
+  const vector_type&  vector           ,
+  precision*          output_matrix    ,
+  const bool          even_only        ,
+  const matrix_layout layout           )
+{
+  auto column_count  = matrix_column_count(coefficient_count, even_only);
+  auto row_stride    = layout == matrix_layout::column_major ? 1u           : column_count;
+  auto column_stride = layout == matrix_layout::column_major ? vector_count : 1u          ;
+  auto row           = output_matrix + vector_index * row_stride;
+
+  for_each_harmonic(maximum_degree(coefficient_count), precision(vector.y), precision(vector.z), 
+  [&] (const unsigned int coefficient_index, const precision& value)
+  {
+    if (!even_only)
+    {
+      row[coefficient_index * column_stride] = value;
+      return;
+    }
+
+    auto lm = coefficient_lm(coefficient_index);
+    if (lm.x % 2 == 0)
+      row[even_coefficient_index(lm.x, lm.y) * column_stride] = value;
+  });
+}
+#ifndef CUSH_CPU_ONLY
+// Call on a vector_count 1D grid. Writes each element of the vector_count x matrix_column_count(...) matrix exactly once.
 template<typename vector_type, typename precision>
 __global__ void calculate_matrix(
-  const unsigned int vector_count     ,
-  const unsigned int coefficient_count,
-  const vector_type* vectors          , 
-  precision*         output_matrix    ,
-  bool               even_only        = true)
+  const unsigned int  vector_count     ,
+  const unsigned int  coefficient_count,
+  const vector_type*  vectors          , 
+  precision*          output_matrix    ,
+  const bool          even_only        = false,
+  const matrix_layout layout           = matrix_layout::column_major)
 {
-  auto vector_index      = blockIdx.x * blockDim.x + threadIdx.x;
-  auto coefficient_index = blockIdx.y * blockDim.y + threadIdx.y;
+  auto vector_index = blockIdx.x * blockDim.x + threadIdx.x;
   
-  if (vector_index      >= vector_count     || 
-      coefficient_index >= coefficient_count)
+  if (vector_index >= vector_count)
     return;
 
-  if(!even_only || coefficient_index % 2 == 0)
-    atomicAdd(
-      &output_matrix[vector_index + vector_count * coefficient_index], 
-      evaluate(coefficient_index, vectors[vector_index].y, vectors[vector_index].z));
+  calculate_matrix_row(vector_index, vector_count, coefficient_count, vectors[vector_index], output_matrix, even_only, layout);
 }
-// Call on a dimensions.x x dimensions.y x dimensions.z 3D grid.
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel.
 template<typename vector_type, typename precision>
 __global__ void calculate_matrices(
-  const uint3        dimensions       ,
-  const unsigned int vector_count     , 
-  const unsigned int coefficient_count,
-  const vector_type* vectors          ,
-  precision*         output_matrices  )
+  const uint3         dimensions       ,
+  const unsigned int  vector_count     , 
+  const unsigned int  coefficient_count,
+  const vector_type*  vectors          ,
+  precision*          output_matrices  ,
+  const bool          even_only        = false,
+  const matrix_layout layout           = matrix_layout::column_major)
 {
-  auto x = blockIdx.x * blockDim.x + threadIdx.x;
-  auto y = blockIdx.y * blockDim.y + threadIdx.y;
-  auto z = blockIdx.z * blockDim.z + threadIdx.z;
-  
-  if (x >= dimensions.x || y >= dimensions.y || z >= dimensions.z)
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
     return;
   
-  auto vectors_offset = vector_count  * (z + dimensions.z * (y + dimensions.y * x));
-  auto matrix_offset  = vectors_offset * coefficient_count;
+  auto vectors_offset = vector_count   * volume_index;
+  auto matrix_offset  = vectors_offset * matrix_column_count(coefficient_count, even_only);
   
-  calculate_matrix<<<grid_size_2d(dim3(vector_count, coefficient_count)), block_size_2d()>>>(
-    vector_count     , 
-    coefficient_count, 
-    vectors         + vectors_offset, 
-    output_matrices + matrix_offset );
+  for (auto vector_index = threadIdx.x; vector_index < vector_count; vector_index += blockDim.x)
+    calculate_matrix_row(
+      vector_index     ,
+      vector_count     , 
+      coefficient_count, 
+      vectors[vectors_offset + vector_index], 
+      output_matrices + matrix_offset,
+      even_only        ,
+      layout           );
+}
+#endif
+
+// Writes the two triangles spanned by the grid point (longitude, latitude) and its successors.
+__forceinline__ __host__ __device__ void sample_indices(
+  const uint2        tessellations ,
+  const unsigned int longitude     ,
+  const unsigned int latitude      ,
+  unsigned int*      output_indices,
+  const unsigned int base_index    = 0)
+{
+  auto index_offset = 6 * (latitude + longitude * tessellations.y);
+  output_indices[index_offset    ] = base_index +  longitude                        * tessellations.y +  latitude,
+  output_indices[index_offset + 1] = base_index +  longitude                        * tessellations.y + (latitude + 1) % tessellations.y,
+  output_indices[index_offset + 2] = base_index + (longitude + 1) % tessellations.x * tessellations.y + (latitude + 1) % tessellations.y,
+  output_indices[index_offset + 3] = base_index +  longitude                        * tessellations.y +  latitude,
+  output_indices[index_offset + 4] = base_index + (longitude + 1) % tessellations.x * tessellations.y + (latitude + 1) % tessellations.y,
+  output_indices[index_offset + 5] = base_index + (longitude + 1) % tessellations.x * tessellations.y +  latitude;
 }
 
+#ifndef CUSH_CPU_ONLY
 // Call on a tessellations.x x tessellations.y 2D grid.
 template<typename point_type>
 __global__ void sample(
@@ -176,22 +598,14 @@ __global__ void sample(
       latitude  >= tessellations.y )
     return;
   
-  auto point_offset = latitude + longitude * tessellations.y;
-  auto index_offset = 6 * point_offset;
-
-  auto& point = output_points[point_offset];
-  point.y = 2 * M_PI * longitude /  tessellations.x;
-  point.z =     M_PI * latitude  / (tessellations.y - 1);
+  auto& point = output_points[latitude + longitude * tessellations.y];
+  point.y = 2 * pi<decltype(point.y)>() * longitude /  tessellations.x;
+  point.z =     pi<decltype(point.z)>() * latitude  / (tessellations.y - 1);
   point.x = evaluate(l, m, point.y, point.z);
 
-  output_indices[index_offset    ] =  longitude                        * tessellations.y +  latitude,
-  output_indices[index_offset + 1] =  longitude                        * tessellations.y + (latitude + 1) % tessellations.y,
-  output_indices[index_offset + 2] = (longitude + 1) % tessellations.x * tessellations.y + (latitude + 1) % tessellations.y,
-  output_indices[index_offset + 3] =  longitude                        * tessellations.y +  latitude,
-  output_indices[index_offset + 4] = (longitude + 1) % tessellations.x * tessellations.y + (latitude + 1) % tessellations.y,
-  output_indices[index_offset + 5] = (longitude + 1) % tessellations.x * tessellations.y +  latitude;
+  sample_indices(tessellations, longitude, latitude, output_indices);
 }
-// Call on a tessellations.x x tessellations.y x coefficient_count(max_l) 3D grid.
+// Call on a tessellations.x x tessellations.y 2D grid.
 template<typename precision, typename point_type>
 __global__ void sample_sum(
   const unsigned int coefficient_count   ,
@@ -201,38 +615,123 @@ __global__ void sample_sum(
   unsigned int*      output_indices      = nullptr,
   const unsigned int base_index          = 0      )
 {
-  auto longitude         = blockIdx.x * blockDim.x + threadIdx.x;
-  auto latitude          = blockIdx.y * blockDim.y + threadIdx.y;
-  auto coefficient_index = blockIdx.z * blockDim.z + threadIdx.z;
+  auto longitude = blockIdx.x * blockDim.x + threadIdx.x;
+  auto latitude  = blockIdx.y * blockDim.y + threadIdx.y;
   
-  if (longitude         >= tessellations.x  ||
-      latitude          >= tessellations.y  ||
-      coefficient_index >= coefficient_count)
+  if (longitude >= tessellations.x ||
+      latitude  >= tessellations.y )
     return;
 
   auto  point_offset = latitude + longitude * tessellations.y;
   auto& point        = output_points[point_offset];
+  
+  using compute_type = compute_precision_t<precision>;
 
-  if (coefficient_index == 0)
-    point.x = 0;
+  point.y = 2 * pi<compute_type>() * longitude /  tessellations.x;
+  point.z =     pi<compute_type>() * latitude  / (tessellations.y - 1);
+  point.x = evaluate_sum(maximum_degree(coefficient_count), compute_type(point.y), compute_type(point.z), coefficients);
+
+  if (output_indices != nullptr)
+    sample_indices(tessellations, longitude, latitude, output_indices, base_index);
+}
+// Call on a tessellations.x x tessellations.y 2D grid.
+template<unsigned int max_l, typename precision, typename point_type>
+__global__ void sample_sum(
+  const uint2        tessellations       ,
+  const precision*   coefficients        ,
+  point_type*        output_points       ,
+  unsigned int*      output_indices      = nullptr,
+  const unsigned int base_index          = 0      )
+{
+  auto longitude = blockIdx.x * blockDim.x + threadIdx.x;
+  auto latitude  = blockIdx.y * blockDim.y + threadIdx.y;
   
-  point.y = 2 * M_PI * longitude /  tessellations.x;
-  point.z =     M_PI * latitude  / (tessellations.y - 1);
-  atomicAdd(&point.x, evaluate(coefficient_index, point.y, point.z) * coefficients[coefficient_index]);
+  if (longitude >= tessellations.x ||
+      latitude  >= tessellations.y )
+    return;
 
-  if (output_indices != nullptr && coefficient_index == 0)
+  auto  point_offset = latitude + longitude * tessellations.y;
+  auto& point        = output_points[point_offset];
+  
+  using compute_type = compute_precision_t<precision>;
+
+  point.y = 2 * pi<compute_type>() * longitude /  tessellations.x;
+  point.z =     pi<compute_type>() * latitude  / (tessellations.y - 1);
+  point.x = evaluate_sum<max_l>(compute_type(point.y), compute_type(point.z), coefficients);
+
+  if (output_indices != nullptr)
+    sample_indices(tessellations, longitude, latitude, output_indices, base_index);
+}
+// Divides the points of one voxel by the block wide maximum of the per thread maxima. Each thread divides the points it
+// sampled itself, hence no synchronization is needed before. Call with all threads of the block.
+template<typename point_type, typename value_type>
+__device__ void normalize_voxel(
+  const unsigned int points_size  ,
+  point_type*        output_points,
+  value_type         maximum      )
+{
+  maximum = block_reduce(maximum, maximum_operation<value_type>(), value_type(0));
+  for (auto point_offset = threadIdx.x; point_offset < points_size; point_offset += blockDim.x)
+    output_points[point_offset].x /= maximum;
+}
+// Samples the points of one voxel with the threads of a block, sum(theta, phi) evaluating the voxel's function.
+// If normalize, the maximum is accumulated while sampling, so that the points are only revisited once for the division.
+template<typename point_type, typename sum_type>
+__device__ void sample_voxel(
+  const uint2        tessellations ,
+  point_type*        output_points ,
+  unsigned int*      output_indices,
+  const unsigned int base_index    ,
+  const bool         normalize     ,
+  sum_type           sum           )
+{
+  using value_type = decltype(output_points[0].x);
+
+  auto points_size = tessellations.x * tessellations.y;
+  auto maximum     = value_type(0);
+  for (auto point_offset = threadIdx.x; point_offset < points_size; point_offset += blockDim.x)
   {
-    auto index_offset = 6 * point_offset;
-    output_indices[index_offset    ] = base_index +  longitude                        * tessellations.y +  latitude,
-    output_indices[index_offset + 1] = base_index +  longitude                        * tessellations.y + (latitude + 1) % tessellations.y,
-    output_indices[index_offset + 2] = base_index + (longitude + 1) % tessellations.x * tessellations.y + (latitude + 1) % tessellations.y,
-    output_indices[index_offset + 3] = base_index +  longitude                        * tessellations.y +  latitude,
-    output_indices[index_offset + 4] = base_index + (longitude + 1) % tessellations.x * tessellations.y + (latitude + 1) % tessellations.y,
-    output_indices[index_offset + 5] = base_index + (longitude + 1) % tessellations.x * tessellations.y +  latitude;
+    auto  longitude = point_offset / tessellations.y;
+    auto  latitude  = point_offset % tessellations.y;
+    auto& point     = output_points[point_offset];
+    point.y = 2 * pi<value_type>() * longitude /  tessellations.x;
+    point.z =     pi<value_type>() * latitude  / (tessellations.y - 1);
+    point.x = sum(point.y, point.z);
+    if (maximum < point.x)
+      maximum = point.x;
+
+    if (output_indices != nullptr)
+      sample_indices(tessellations, longitude, latitude, output_indices, base_index);
   }
+
+  if (normalize)
+    normalize_voxel(points_size, output_points, maximum);
 }
-// Call on a dimensions.x x dimensions.y x dimensions.z 3D grid.
-template<typename precision, typename point_type>
+// Call on a voxel_count 1D grid of 1D blocks, i.e. a block per voxel.
+// Normalizes points which were sampled without normalization, e.g. by another pass, with a parallel reduction per voxel.
+template<typename point_type>
+__global__ void normalize_samples(
+  const unsigned int voxel_count  ,
+  const unsigned int points_size  ,
+  point_type*        output_points)
+{
+  using value_type = decltype(output_points[0].x);
+
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= voxel_count)
+    return;
+
+  auto points  = output_points + volume_index * points_size;
+  auto maximum = value_type(0);
+  for (auto point_offset = threadIdx.x; point_offset < points_size; point_offset += blockDim.x)
+    if (maximum < points[point_offset].x)
+      maximum = points[point_offset].x;
+
+  normalize_voxel(points_size, points, maximum);
+}
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel.
+template<typename precision, typename point_type, coefficient_layout layout = coefficient_layout::aos>
 __global__ void sample_sums(
   const uint3        dimensions         ,
   const unsigned int coefficient_count  ,
@@ -243,43 +742,215 @@ __global__ void sample_sums(
   const unsigned int base_index         = 0   ,
   const bool         normalize          = true)
 {
-  auto x = blockIdx.x * blockDim.x + threadIdx.x;
-  auto y = blockIdx.y * blockDim.y + threadIdx.y;
-  auto z = blockIdx.z * blockDim.z + threadIdx.z;
-  
-  if (x >= dimensions.x || 
-      y >= dimensions.y || 
-      z >= dimensions.z )
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
     return;
   
-  auto volume_index        = z + dimensions.z * (y + dimensions.y * x);
-  auto coefficients_offset = volume_index * coefficient_count;
-  auto points_size         = tessellations.x * tessellations.y;
-  auto points_offset       = volume_index * points_size;
-  auto indices_offset      = 6 * points_offset;
+  auto voxel         = voxel_coefficients<layout>(coefficients, dimensions.x * dimensions.y * dimensions.z, coefficient_count, volume_index);
+  auto points_offset = volume_index * tessellations.x * tessellations.y;
+  auto max_l         = maximum_degree(coefficient_count);
 
-  sample_sum<<<grid_size_3d(dim3(tessellations.x, tessellations.y, coefficient_count)), block_size_3d()>>>(
-    coefficient_count,
-    tessellations    ,
-    coefficients   + coefficients_offset, 
-    output_points  + points_offset      ,
-    output_indices + indices_offset     ,
-    base_index     + points_offset      );
+  sample_voxel(
+    tessellations,
+    output_points  + points_offset,
+    output_indices != nullptr ? output_indices + 6 * points_offset : nullptr,
+    base_index     + points_offset,
+    normalize    ,
+    [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+    {
+      return evaluate_sum(max_l, theta, phi, voxel);
+    });
+}
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel.
+template<unsigned int max_l, typename precision, typename point_type, coefficient_layout layout = coefficient_layout::aos>
+__global__ void sample_sums(
+  const uint3        dimensions         ,
+  const uint2        tessellations      ,
+  const precision*   coefficients       ,
+  point_type*        output_points      ,
+  unsigned int*      output_indices     ,
+  const unsigned int base_index         = 0   ,
+  const bool         normalize          = true)
+{
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
+    return;
   
-  cudaDeviceSynchronize();
+  compute_precision_t<precision> voxel[coefficient_count(max_l)];
+  load_coefficients<max_l>(voxel_coefficients<layout>(coefficients, dimensions.x * dimensions.y * dimensions.z, coefficient_count(max_l), volume_index), voxel);
+  auto points_offset = volume_index * tessellations.x * tessellations.y;
 
-  if (normalize)
+  sample_voxel(
+    tessellations,
+    output_points  + points_offset,
+    output_indices != nullptr ? output_indices + 6 * points_offset : nullptr,
+    base_index     + points_offset,
+    normalize    ,
+    [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+    {
+      return evaluate_sum<max_l>(theta, phi, voxel);
+    });
+}
+#endif
+// The topology of the tessellations.x x tessellations.y longitude-latitude grid of sample_sum, for extract_voxel_maxima.
+struct grid_topology
+{
+  __host__ __device__ unsigned int point_count      () const
+  {
+    return tessellations.x * tessellations.y;
+  }
+  template<typename precision>
+  __host__ __device__ void         direction        (const unsigned int offset, precision& theta, precision& phi) const
+  {
+    theta = 2 * pi<precision>() * (offset / tessellations.y) /  tessellations.x;
+    phi   =     pi<precision>() * (offset % tessellations.y) / (tessellations.y - 1);
+  }
+  // Calls function(neighbor_offset) for the four longitude and latitude neighbors (two or three at the poles).
+  template<typename function_type>
+  __host__ __device__ void         for_each_neighbor(const unsigned int offset, function_type function) const
   {
-    auto maxima = 0.0;
-    for (auto i = 0; i < points_size; i++)
-      if (maxima < output_points[points_offset + i].x)
-        maxima = output_points[points_offset + i].x;
-    for (auto i = 0; i < points_size; i++)
-      output_points[points_offset + i].x = output_points[points_offset + i].x / maxima;
+    auto longitude = offset / tessellations.y;
+    auto latitude  = offset % tessellations.y;
+    function(((longitude + 1                  ) % tessellations.x) * tessellations.y + latitude);
+    function(((longitude + tessellations.x - 1) % tessellations.x) * tessellations.y + latitude);
+    if (latitude > 0)
+      function(offset - 1);
+    if (latitude < tessellations.y - 1)
+      function(offset + 1);
   }
+  // Calls function(antipode_offset) for the points around the antipode. The antipode lies on the grid only for even
+  // longitude tessellations, hence its neighbors are included. All points of a pole coincide, hence a pole includes its row.
+  template<typename function_type>
+  __host__ __device__ void         for_each_antipode(const unsigned int offset, function_type function) const
+  {
+    auto longitude         = offset / tessellations.y;
+    auto antipode_latitude = tessellations.y - 1 - offset % tessellations.y;
+    auto antipode_offset   = ((longitude + tessellations.x / 2) % tessellations.x) * tessellations.y + antipode_latitude;
+    if (antipode_latitude == 0 || antipode_latitude == tessellations.y - 1)
+      for (auto pole_longitude = 0u; pole_longitude < tessellations.x; pole_longitude++)
+        function(pole_longitude * tessellations.y + antipode_latitude);
+    else
+    {
+      function(antipode_offset);
+      for_each_neighbor(antipode_offset, function);
+    }
+  }
+
+  uint2 tessellations;
+};
+
+// Bytes of dynamic shared memory required per block by extract_maxima: a value and a candidate flag per point. Beyond
+// default_shared_size (e.g. 256 x 128 float or 128 x 64 double tessellations) the launchers opt in up to the maximum of
+// the device and throw std::runtime_error beyond it, see reserve_shared_memory.
+template<typename precision>
+__host__ __device__ unsigned int extract_maxima_shared_size(const unsigned int point_count  )
+{
+  return point_count * (sizeof(precision) + sizeof(bool));
 }
-// Call on a dimensions.x x dimensions.y x dimensions.z 3D grid.
-template<typename precision, typename vector_type>
+template<typename precision>
+__host__ __device__ unsigned int extract_maxima_shared_size(const uint2        tessellations)
+{
+  return extract_maxima_shared_size<precision>(tessellations.x * tessellations.y);
+}
+#ifndef CUSH_CPU_ONLY
+// Selects the maxima_count largest samples of one voxel with the threads of a block, sum(theta, phi) evaluating the voxel's
+// function at the points of the topology (e.g. grid_topology). The samples are kept in dynamic shared memory (see
+// extract_maxima_shared_size) and each maximum is selected by a block reduction, hence neither a device heap allocation
+// nor a sort is needed. If local_maxima, only the samples larger than their neighbors are considered, which avoids
+// returning the samples clustered around the largest peak. If antipodal, the samples around the antipode of each selected
+// maximum are discarded, since the even degree functions are symmetric. The maxima are written as (value, theta, phi),
+// the remainder is zeroed if there are fewer candidates. Returns the number of maxima found.
+template<typename precision, typename topology_type, typename vector_type, typename sum_type>
+__device__ unsigned int extract_voxel_maxima(
+  const topology_type& topology     ,
+  const unsigned int   maxima_count ,
+  const bool           local_maxima ,
+  const bool           antipodal    ,
+  vector_type*         output_maxima,
+  sum_type             sum          )
+{
+  extern __shared__ unsigned char extract_maxima_memory[];
+
+  auto points_size = topology.point_count();
+  auto values      = reinterpret_cast<precision*>(extract_maxima_memory);
+  auto candidates  = reinterpret_cast<bool*>     (values + points_size);
+
+  for (auto point_offset = threadIdx.x; point_offset < points_size; point_offset += blockDim.x)
+  {
+    precision theta, phi;
+    topology.direction(point_offset, theta, phi);
+    values[point_offset] = sum(theta, phi);
+  }
+  __syncthreads();
+
+  for (auto point_offset = threadIdx.x; point_offset < points_size; point_offset += blockDim.x)
+  {
+    auto candidate = true;
+    // Ties are broken by offset, so that plateaus (e.g. the poles) yield a single maximum.
+    if (local_maxima)
+      topology.for_each_neighbor(point_offset, [&] (const unsigned int neighbor_offset)
+      {
+        candidate = candidate && 
+          (values[point_offset] >  values[neighbor_offset] ||
+          (values[point_offset] == values[neighbor_offset] && point_offset < neighbor_offset));
+      });
+    candidates[point_offset] = candidate;
+  }
+  __syncthreads();
+
+  for (auto maxima_index = 0u; maxima_index < maxima_count; maxima_index++)
+  {
+    auto value  = precision(-INFINITY);
+    auto offset = points_size;
+    for (auto point_offset = threadIdx.x; point_offset < points_size; point_offset += blockDim.x)
+    {
+      if (candidates[point_offset] && value < values[point_offset])
+      {
+        value  = values[point_offset];
+        offset = point_offset;
+      }
+    }
+
+    auto maximum = block_reduce(value, maximum_operation<precision>(), precision(-INFINITY));
+    offset       = block_reduce(value == maximum ? offset : points_size, minimum_operation<unsigned int>(), points_size);
+
+    if (offset == points_size)
+    {
+      for (auto index = maxima_index + threadIdx.x; index < maxima_count; index += blockDim.x)
+      {
+        auto& maxima = output_maxima[index];
+        maxima.x = 0;
+        maxima.y = 0;
+        maxima.z = 0;
+      }
+      return maxima_index;
+    }
+
+    if (threadIdx.x == 0)
+    {
+      precision theta, phi;
+      topology.direction(offset, theta, phi);
+      auto& maxima = output_maxima[maxima_index];
+      maxima.x = maximum;
+      maxima.y = theta  ;
+      maxima.z = phi    ;
+      candidates[offset] = false;
+
+      if (antipodal)
+        topology.for_each_antipode(offset, [&] (const unsigned int antipode_offset)
+        {
+          candidates[antipode_offset] = false;
+        });
+    }
+    __syncthreads();
+  }
+  return maxima_count;
+}
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel, with
+// extract_maxima_shared_size<compute_precision_t<precision>>(tessellations) bytes of dynamic shared memory.
+template<typename precision, typename vector_type, coefficient_layout layout = coefficient_layout::aos>
 __global__ void extract_maxima(
   // Input data parameters.
   const uint3        dimensions       ,
@@ -289,94 +960,682 @@ __global__ void extract_maxima(
   const uint2        tessellations    ,
   const unsigned int maxima_count     ,
   // Output data parameters.
-  vector_type*       maxima           )
+  vector_type*       maxima           ,
+  // Peak selection parameters.
+  const bool         local_maxima     = false,
+  const bool         antipodal        = false)
 {
-  auto x = blockIdx.x * blockDim.x + threadIdx.x;
-  auto y = blockIdx.y * blockDim.y + threadIdx.y;
-  auto z = blockIdx.z * blockDim.z + threadIdx.z;
-  
-  if (x >= dimensions.x || 
-      y >= dimensions.y || 
-      z >= dimensions.z )
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
     return;
-  
-  auto volume_index        = z + dimensions.z * (y + dimensions.y * x);
-  auto coefficients_offset = volume_index * coefficient_count;
-  auto points_size         = tessellations.x * tessellations.y;
-
-  float3* points;
-  cudaMalloc(reinterpret_cast<void**>(&points), points_size * sizeof(float3));
-
-  sample_sum<<<grid_size_3d(dim3(tessellations.x, tessellations.y, coefficient_count)), block_size_3d()>>>(
-    coefficient_count                 ,
-    tessellations                     ,
-    coefficients + coefficients_offset,
-    points                            );
-  cudaDeviceSynchronize();
-
-  thrust::sort(thrust::seq, points, points + points_size, 
-  [&] (const float3& lhs, const float3& rhs)
+
+  auto voxel = voxel_coefficients<layout>(coefficients, dimensions.x * dimensions.y * dimensions.z, coefficient_count, volume_index);
+  auto max_l = maximum_degree(coefficient_count);
+
+  extract_voxel_maxima<compute_precision_t<precision>>(
+    grid_topology {tessellations},
+    maxima_count ,
+    local_maxima ,
+    antipodal    ,
+    maxima + volume_index * maxima_count,
+    [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+    {
+      return evaluate_sum(max_l, theta, phi, voxel);
+    });
+}
+// Call on a dimensions.x * dimensions.y * dimensions.z 1D grid of 1D blocks, i.e. a block per voxel, with
+// extract_maxima_shared_size<compute_precision_t<precision>>(tessellations) bytes of dynamic shared memory.
+template<unsigned int max_l, typename precision, typename vector_type, coefficient_layout layout = coefficient_layout::aos>
+__global__ void extract_maxima(
+  // Input data parameters.
+  const uint3        dimensions       ,
+  const precision*   coefficients     ,
+  // Peak extraction parameters.
+  const uint2        tessellations    ,
+  const unsigned int maxima_count     ,
+  // Output data parameters.
+  vector_type*       maxima           ,
+  // Peak selection parameters.
+  const bool         local_maxima     = false,
+  const bool         antipodal        = false)
+{
+  auto volume_index = blockIdx.x;
+
+  if (volume_index >= dimensions.x * dimensions.y * dimensions.z)
+    return;
+
+  compute_precision_t<precision> voxel[coefficient_count(max_l)];
+  load_coefficients<max_l>(voxel_coefficients<layout>(coefficients, dimensions.x * dimensions.y * dimensions.z, coefficient_count(max_l), volume_index), voxel);
+
+  extract_voxel_maxima<compute_precision_t<precision>>(
+    grid_topology {tessellations},
+    maxima_count ,
+    local_maxima ,
+    antipodal    ,
+    maxima + volume_index * maxima_count,
+    [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+    {
+      return evaluate_sum<max_l>(theta, phi, voxel);
+    });
+}
+#endif
+
+// Refines a (value, theta, phi) maximum by Newton steps on the sphere, derivatives(theta, phi) evaluating the function's
+// harmonic_derivatives. The steps use the covariant gradient and Hessian in the orthonormal (phi, theta) tangent frame and
+// move along great circles, hence peaks at or across the poles are reached as well. Steps are limited to maximum_step
+// radians (e.g. the sampling distance of the seed), fall back to gradient ascent where the Hessian is not negative
+// definite, and are halved whenever they decrease the value.
+template<typename precision, typename vector_type, typename derivatives_type>
+__host__ __device__ void refine_maximum(
+  vector_type&       maximum     ,
+  const unsigned int iterations  ,
+  precision          maximum_step,
+  const precision    tolerance   ,
+  derivatives_type   derivatives )
+{
+  // The derivatives are singular at the poles, hence they are evaluated this far away from them.
+  const precision pole_distance = precision(1e-4);
+
+  precision theta = maximum.y, previous_theta = maximum.y;
+  precision phi   = maximum.z, previous_phi   = maximum.z;
+  auto      current = derivatives(theta, fmin(fmax(phi, pole_distance), pi<precision>() - pole_distance));
+  for (auto iteration = 0u; iteration < iterations; iteration++)
   {
-    return lhs.x > rhs.x;
+    auto clamped_phi = fmin(fmax(phi, pole_distance), pi<precision>() - pole_distance);
+    precision sin_phi, cos_phi;
+    math::sincos(clamped_phi, &sin_phi, &cos_phi);
+
+    auto gradient_phi   = current.phi;
+    auto gradient_theta = current.theta / sin_phi;
+    auto hessian_pp     = current.phi_phi;
+    auto hessian_pt     = (current.theta_phi - cos_phi / sin_phi * current.theta) / sin_phi;
+    auto hessian_tt     =  current.theta_theta / (sin_phi * sin_phi) + cos_phi / sin_phi * current.phi;
+    auto determinant    = hessian_pp * hessian_tt - hessian_pt * hessian_pt;
+
+    precision step_phi, step_theta;
+    if (hessian_pp < 0 && determinant > 0)
+    {
+      step_phi   = -( hessian_tt * gradient_phi - hessian_pt * gradient_theta) / determinant;
+      step_theta = -(-hessian_pt * gradient_phi + hessian_pp * gradient_theta) / determinant;
+    }
+    else
+    {
+      step_phi   = gradient_phi  ;
+      step_theta = gradient_theta;
+    }
+
+    auto length = math::sqrt(step_phi * step_phi + step_theta * step_theta);
+    if (length < tolerance)
+      break;
+    if (length > maximum_step)
+    {
+      step_phi   *= maximum_step / length;
+      step_theta *= maximum_step / length;
+      length      = maximum_step;
+    }
+
+    // Move along the great circle through the tangent direction step_phi e_phi + step_theta e_theta.
+    precision cos_theta, sin_theta, cos_step, sin_step;
+    math::sincos(theta , &sin_theta, &cos_theta);
+    math::sincos(length, &sin_step , &cos_step );
+    sin_step /= length;
+    auto point_x   = cos_step * sin_phi * cos_theta + sin_step * (step_phi * cos_phi * cos_theta - step_theta * sin_theta);
+    auto point_y   = cos_step * sin_phi * sin_theta + sin_step * (step_phi * cos_phi * sin_theta + step_theta * cos_theta);
+    auto point_z   = cos_step * cos_phi             - sin_step *  step_phi * sin_phi;
+
+    previous_theta = theta;
+    previous_phi   = phi  ;
+    theta          = math::atan2(point_y, point_x);
+    phi            = math::acos (fmin(fmax(point_z, precision(-1)), precision(1)));
+    if (theta < 0)
+      theta += 2 * pi<precision>();
+
+    auto next = derivatives(theta, fmin(fmax(phi, pole_distance), pi<precision>() - pole_distance));
+    if (next.value < current.value)
+    {
+      theta         = previous_theta;
+      phi           = previous_phi  ;
+      maximum_step  = length / 2;
+      continue;
+    }
+    current = next;
+  }
+
+  maximum.x = current.value;
+  maximum.y = theta;
+  maximum.z = phi  ;
+}
+#ifndef CUSH_CPU_ONLY
+// Call on a voxel_count * maxima_count 1D grid, i.e. a thread per maximum.
+// Refines the (value, theta, phi) maxima of e.g. extract_maxima in place. Zeroed maxima (missing candidates) are skipped.
+template<typename precision, typename vector_type>
+__global__ void refine_maxima(
+  const unsigned int voxel_count      ,
+  const unsigned int coefficient_count,
+  const precision*   coefficients     ,
+  const unsigned int maxima_count     ,
+  vector_type*       maxima           ,
+  const unsigned int iterations       = 8,
+  const compute_precision_t<precision> maximum_step = compute_precision_t<precision>(0.1 ),
+  const compute_precision_t<precision> tolerance    = compute_precision_t<precision>(1e-6))
+{
+  auto index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (index >= voxel_count * maxima_count)
+    return;
+
+  auto& maximum = maxima[index];
+  if (maximum.x == 0 && maximum.y == 0 && maximum.z == 0)
+    return;
+
+  auto max_l               = maximum_degree(coefficient_count);
+  auto coefficients_offset = (index / maxima_count) * coefficient_count;
+  refine_maximum(maximum, iterations, maximum_step, tolerance, [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+  {
+    return evaluate_sum_derivatives(max_l, theta, phi, coefficients + coefficients_offset);
   });
+}
+// Call on a voxel_count * maxima_count 1D grid, i.e. a thread per maximum.
+template<unsigned int max_l, typename precision, typename vector_type>
+__global__ void refine_maxima(
+  const unsigned int voxel_count      ,
+  const precision*   coefficients     ,
+  const unsigned int maxima_count     ,
+  vector_type*       maxima           ,
+  const unsigned int iterations       = 8,
+  const compute_precision_t<precision> maximum_step = compute_precision_t<precision>(0.1 ),
+  const compute_precision_t<precision> tolerance    = compute_precision_t<precision>(1e-6))
+{
+  auto index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (index >= voxel_count * maxima_count)
+    return;
 
-  for(auto i = 0; i < maxima_count; i++)
-    maxima[volume_index * maxima_count + i] = points[i];
+  auto& maximum = maxima[index];
+  if (maximum.x == 0 && maximum.y == 0 && maximum.z == 0)
+    return;
 
-  cudaFree(points);
+  compute_precision_t<precision> voxel[coefficient_count(max_l)];
+  load_coefficients<max_l>(coefficients + (index / maxima_count) * coefficient_count(max_l), voxel);
+  refine_maximum(maximum, iterations, maximum_step, tolerance, [&] (const compute_precision_t<precision>& theta, const compute_precision_t<precision>& phi)
+  {
+    return evaluate_sum_derivatives<max_l>(theta, phi, voxel);
+  });
 }
+#endif
 
-// Call on a coefficient_count x coefficient_count x coefficient_count 3D grid.
 // Based on Modern Quantum Mechanics 2nd Edition page 216 by Jun John Sakurai.
-template<typename precision, typename atomics_precision = float>
-__global__ void product(
+// The coefficients are arrays (see evaluate_sum), the products are accumulated in compute_precision_t of their type.
+// Computes each coupling on the fly by two clebsch_gordan, see the overload below for reading them from a table.
+template<typename coefficients_type>
+__host__ __device__ compute_precision_t<array_value_t<coefficients_type>> product_coefficient(
+  const unsigned int      coefficient_count,
+  const unsigned int      out_index        ,
+  const coefficients_type lhs_coefficients ,
+  const coefficients_type rhs_coefficients )
+{
+  using compute_type = compute_precision_t<array_value_t<coefficients_type>>;
+
+  auto out_lm = coefficient_lm(out_index);
+  auto sum    = compute_type(0);
+  for_each_gaunt_coupling<compute_type>(maximum_degree(coefficient_count), out_lm.x, out_lm.y, 
+  [&] (const unsigned int lhs_index, const unsigned int rhs_index, const compute_type& value)
+  {
+    sum += value * convert<compute_type>(lhs_coefficients[lhs_index]) * convert<compute_type>(rhs_coefficients[rhs_index]);
+  });
+  return sum;
+}
+// See gaunt_table for building the offsets and entries once per max_l.
+template<typename compute_type, typename coefficients_type>
+__host__ __device__ compute_type product_coefficient(
+  const unsigned int                 out_index        ,
+  const unsigned int*                offsets          ,
+  const gaunt_entry<compute_type>*   entries          ,
+  const coefficients_type            lhs_coefficients ,
+  const coefficients_type            rhs_coefficients )
+{
+  auto sum = compute_type(0);
+  for (auto entry_index = offsets[out_index]; entry_index < offsets[out_index + 1]; entry_index++)
+  {
+    const auto& entry = entries[entry_index];
+    sum += entry.value * convert<compute_type>(lhs_coefficients[entry.lhs_index]) * convert<compute_type>(rhs_coefficients[entry.rhs_index]);
+  }
+  return sum;
+}
+
+#ifndef CUSH_CPU_ONLY
+// Call on a coefficient_count 1D grid. Each thread owns one output coefficient and overwrites it. The fallback of product
+// without a gaunt_table, which computes the couplings on the fly.
+template<typename precision>
+__global__ void product_on_the_fly(
   const unsigned int coefficient_count,
   const precision*   lhs_coefficients ,
   const precision*   rhs_coefficients ,
-  atomics_precision* out_coefficients )
+  precision*         out_coefficients )
 {
-  auto lhs_index = blockIdx.x * blockDim.x + threadIdx.x;
-  auto rhs_index = blockIdx.y * blockDim.y + threadIdx.y;
-  auto out_index = blockIdx.z * blockDim.z + threadIdx.z;
+  auto out_index = blockIdx.x * blockDim.x + threadIdx.x;
   
-  if (lhs_index >= coefficient_count ||
-      rhs_index >= coefficient_count ||
-      out_index >= coefficient_count)
+  if (out_index >= coefficient_count)
     return;
 
-  auto lhs_lm   = coefficient_lm(lhs_index);
-  auto rhs_lm   = coefficient_lm(rhs_index);
-  auto out_lm   = coefficient_lm(out_index);
-  auto cg1      = clebsch_gordan<atomics_precision>(lhs_lm.x, rhs_lm.x, out_lm.x, 0, 0, 0);
-  auto cg2      = clebsch_gordan<atomics_precision>(lhs_lm.x, rhs_lm.x, out_lm.x, lhs_lm.y, rhs_lm.y, out_lm.y);
-  auto coupling = sqrt((2 * lhs_lm.x + 1) * (2 * rhs_lm.x + 1) / (4 * M_PI * (2 * out_lm.x + 1))) * cg1 * cg2;
+  out_coefficients[out_index] = convert<precision>(product_coefficient(coefficient_count, out_index, lhs_coefficients, rhs_coefficients));
+}
+// Call on a layout_size<layout>(dimensions.x * dimensions.y * dimensions.z, coefficient_count) 1D grid.
+// Consecutive threads own consecutive output values: in the aos layout consecutive coefficients of a voxel, in the soa
+// and aosoa layouts the same coefficient of neighboring voxels, whose loads coalesce and whose couplings are uniform.
+// The fallback of product_voxels without a gaunt_table, which computes the couplings on the fly.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+__global__ void product_voxels_on_the_fly(
+  const uint3        dimensions       ,
+  const unsigned int coefficient_count,
+  const precision*   lhs_coefficients ,
+  const precision*   rhs_coefficients ,
+  precision*         out_coefficients )
+{
+  auto global_index = blockIdx.x * blockDim.x + threadIdx.x;
+  auto voxel_count  = dimensions.x * dimensions.y * dimensions.z;
+
+  if (global_index >= layout_size<layout>(voxel_count, coefficient_count))
+    return;
+
+  auto position = layout_position<layout>(voxel_count, coefficient_count, global_index);
+  if  (position.x >= voxel_count)
+    return;
 
-  atomicAdd(&out_coefficients[out_index], atomics_precision(coupling * lhs_coefficients[lhs_index] * rhs_coefficients[rhs_index]));
+  out_coefficients[global_index] = convert<precision>(product_coefficient(
+    coefficient_count,
+    position.y       ,
+    voxel_coefficients<layout>(lhs_coefficients, voxel_count, coefficient_count, position.x),
+    voxel_coefficients<layout>(rhs_coefficients, voxel_count, coefficient_count, position.x)));
 }
-// Call on a dimensions.x x dimensions.y x dimensions.z 3D grid.
-template<typename precision, typename atomics_precision = float>
+
+// Call on a coefficient_count 1D grid. See gaunt_table for building the offsets and entries once per max_l.
+template<typename precision>
 __global__ void product(
+  const unsigned int                                   coefficient_count,
+  const unsigned int*                                  offsets          ,
+  const gaunt_entry<compute_precision_t<precision>>*   entries          ,
+  const precision*                                     lhs_coefficients ,
+  const precision*                                     rhs_coefficients ,
+  precision*                                           out_coefficients )
+{
+  auto out_index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (out_index >= coefficient_count)
+    return;
+
+  out_coefficients[out_index] = convert<precision>(product_coefficient(out_index, offsets, entries, lhs_coefficients, rhs_coefficients));
+}
+// Call on a layout_size<layout>(dimensions.x * dimensions.y * dimensions.z, coefficient_count) 1D grid.
+// Consecutive threads own consecutive output values, as in product_voxels_on_the_fly. Formerly the volume overload of
+// product on a dimensions 3D grid. It is renamed rather than overloaded, so that launches of the former 3D grid fail to
+// compile instead of computing a fraction of the voxels.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+__global__ void product_voxels(
+  const uint3                                          dimensions       ,
+  const unsigned int                                   coefficient_count,
+  const unsigned int*                                  offsets          ,
+  const gaunt_entry<compute_precision_t<precision>>*   entries          ,
+  const precision*                                     lhs_coefficients ,
+  const precision*                                     rhs_coefficients ,
+  precision*                                           out_coefficients )
+{
+  auto global_index = blockIdx.x * blockDim.x + threadIdx.x;
+  auto voxel_count  = dimensions.x * dimensions.y * dimensions.z;
+
+  if (global_index >= layout_size<layout>(voxel_count, coefficient_count))
+    return;
+
+  auto position = layout_position<layout>(voxel_count, coefficient_count, global_index);
+  if  (position.x >= voxel_count)
+    return;
+
+  out_coefficients[global_index] = convert<precision>(product_coefficient(
+    position.y,
+    offsets   ,
+    entries   ,
+    voxel_coefficients<layout>(lhs_coefficients, voxel_count, coefficient_count, position.x),
+    voxel_coefficients<layout>(rhs_coefficients, voxel_count, coefficient_count, position.x)));
+}
+
+// Call on a dimensions.x * dimensions.y * dimensions.z * coefficient_count 1D grid.
+// Convolves each voxel with a zonal kernel, given its maximum_degree(coefficient_count) + 1 per degree scales (see
+// zonal_convolution_scales). Unlike the product, this is diagonal in the coefficients, i.e. O(coefficient_count) per voxel.
+template<typename precision>
+__global__ void convolve_zonal(
+  const uint3                           dimensions         ,
+  const unsigned int                    coefficient_count  ,
+  const precision*                      coefficients       ,
+  const compute_precision_t<precision>* scales             ,
+  precision*                            output_coefficients)
+{
+  auto global_index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (global_index >= dimensions.x * dimensions.y * dimensions.z * coefficient_count)
+    return;
+
+  output_coefficients[global_index] = convert<precision>(
+    scales[coefficient_lm(global_index % coefficient_count).x] * convert<compute_precision_t<precision>>(coefficients[global_index]));
+}
+// Call on a dimensions.x * dimensions.y * dimensions.z * (maximum_degree(coefficient_count) + 1) 1D grid.
+// Writes the energy_descriptor of each voxel to the voxel-major descriptors, maximum_degree(coefficient_count) + 1 per voxel.
+template<typename precision>
+__global__ void calculate_descriptors(
+  const uint3        dimensions       ,
+  const unsigned int coefficient_count,
+  const precision*   coefficients     ,
+  precision*         descriptors      )
+{
+  auto global_index = blockIdx.x * blockDim.x + threadIdx.x;
+  auto degree_count = maximum_degree(coefficient_count) + 1;
+
+  if (global_index >= dimensions.x * dimensions.y * dimensions.z * degree_count)
+    return;
+
+  auto l           = global_index % degree_count;
+  auto voxel_index = global_index / degree_count;
+  descriptors[global_index] = convert<precision>(degree_energy(l, coefficients + voxel_index * coefficient_count));
+}
+// Call on a voxel_count 1D grid. Adds the number of voxels whose coefficients are all zero (see is_zero) to count.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+__global__ void count_zero_voxels(
+  const unsigned int  voxel_count      ,
+  const unsigned int  coefficient_count,
+  const precision*    coefficients     ,
+  unsigned long long* count            )
+{
+  auto voxel_index = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (voxel_index >= voxel_count)
+    return;
+
+  if (is_zero(coefficient_count, voxel_coefficients<layout>(coefficients, voxel_count, coefficient_count, voxel_index)))
+    atomicAdd(count, 1ull);
+}
+
+// Records the zero voxels of the input of a profiled launcher (see profile.h), by a kernel which runs before and outside
+// its timed kernels, i.e. call it right after the profile_scope. Free without CUSH_PROFILE.
+template<coefficient_layout layout = coefficient_layout::aos, typename precision>
+void profile_zero_voxels(
+  profile_scope&     scope            ,
+  const unsigned int voxel_count      ,
+  const unsigned int coefficient_count,
+  const precision*   coefficients     )
+{
+#ifdef CUSH_PROFILE
+  scope.count_zero_voxels([&] (unsigned long long* count)
+  {
+    launch_1d_in_place(count_zero_voxels<precision, layout>, thread_grid(voxel_count), 0, scope.stream(),
+      voxel_count      ,
+      coefficient_count,
+      coefficients     ,
+      count            );
+  });
+#endif
+}
+
+// Host-side launchers for the whole volume in a single grid. The volume launchers take the layout of the coefficients
+// (see layout.h) as their last template argument, aos by default.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void launch_product(
+  const uint3                                         dimensions       ,
+  const gaunt_table<compute_precision_t<precision>>&  table            ,
+  const precision*                                    lhs_coefficients ,
+  const precision*                                    rhs_coefficients ,
+  precision*                                          out_coefficients ,
+  cudaStream_t                                        stream           = nullptr)
+{
+  using kernel_type = void (*)(uint3, unsigned int, const unsigned int*, const gaunt_entry<compute_precision_t<precision>>*, const precision*, const precision*, precision*);
+
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("product", stream, voxel_count, 3 * static_cast<size_t>(voxel_count) * table.coefficient_count() * sizeof(precision));
+  profile_zero_voxels<layout>(profile, voxel_count, table.coefficient_count(), lhs_coefficients);
+  launch_1d(static_cast<kernel_type>(product_voxels<precision, layout>), thread_grid(unsigned(layout_size<layout>(voxel_count, table.coefficient_count()))), 0, stream,
+    dimensions               ,
+    table.coefficient_count(),
+    table.offsets          (),
+    table.entries          (),
+    lhs_coefficients         ,
+    rhs_coefficients         ,
+    out_coefficients         );
+}
+// Reads the couplings from the cached_gaunt_table of maximum_degree(coefficient_count) on the current device, which the
+// first launch of each degree and precision builds synchronously.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void launch_product(
+  const uint3        dimensions       ,
+  const unsigned int coefficient_count,
+  const precision*   lhs_coefficients ,
+  const precision*   rhs_coefficients ,
+  precision*         out_coefficients ,
+  cudaStream_t       stream           = nullptr)
+{
+  launch_product<precision, layout>(dimensions, cached_gaunt_table<compute_precision_t<precision>>(maximum_degree(coefficient_count)),
+    lhs_coefficients, rhs_coefficients, out_coefficients, stream);
+}
+// The fallback of launch_product without a gaunt_table, which computes the couplings on the fly, i.e. O(max_l^2) per
+// coupling instead of a table read. E.g. for degrees whose table does not fit into device memory.
+template<typename precision, coefficient_layout layout = coefficient_layout::aos>
+void launch_product_on_the_fly(
   const uint3        dimensions       ,
   const unsigned int coefficient_count,
   const precision*   lhs_coefficients ,
   const precision*   rhs_coefficients ,
-  atomics_precision* out_coefficients )
+  precision*         out_coefficients ,
+  cudaStream_t       stream           = nullptr)
 {
-  auto x = blockIdx.x * blockDim.x + threadIdx.x;
-  auto y = blockIdx.y * blockDim.y + threadIdx.y;
-  auto z = blockIdx.z * blockDim.z + threadIdx.z;
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("product_on_the_fly", stream, voxel_count, 3 * static_cast<size_t>(voxel_count) * coefficient_count * sizeof(precision));
+  profile_zero_voxels<layout>(profile, voxel_count, coefficient_count, lhs_coefficients);
+  launch_1d(product_voxels_on_the_fly<precision, layout>, thread_grid(unsigned(layout_size<layout>(voxel_count, coefficient_count))), 0, stream,
+    dimensions       ,
+    coefficient_count,
+    lhs_coefficients ,
+    rhs_coefficients ,
+    out_coefficients );
+}
 
-  if (x >= dimensions.x || y >= dimensions.y || z >= dimensions.z)
-    return;
+template<typename precision>
+void launch_convolve_zonal(
+  const uint3                           dimensions         ,
+  const unsigned int                    coefficient_count  ,
+  const precision*                      coefficients       ,
+  const compute_precision_t<precision>* scales             ,
+  precision*                            output_coefficients,
+  cudaStream_t                          stream             = nullptr)
+{
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("convolve_zonal", stream, voxel_count, 2 * static_cast<size_t>(voxel_count) * coefficient_count * sizeof(precision));
+  profile_zero_voxels(profile, voxel_count, coefficient_count, coefficients);
+  launch_1d(convolve_zonal<precision>, thread_grid(dimensions.x * dimensions.y * dimensions.z * coefficient_count), 0, stream,
+    dimensions         ,
+    coefficient_count  ,
+    coefficients       ,
+    scales             ,
+    output_coefficients);
+}
+template<typename precision>
+void launch_calculate_descriptors(
+  const uint3        dimensions       ,
+  const unsigned int coefficient_count,
+  const precision*   coefficients     ,
+  precision*         descriptors      ,
+  cudaStream_t       stream           = nullptr)
+{
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("calculate_descriptors", stream, voxel_count, static_cast<size_t>(voxel_count) * (coefficient_count + maximum_degree(coefficient_count) + 1) * sizeof(precision));
+  profile_zero_voxels(profile, voxel_count, coefficient_count, coefficients);
+  launch_1d(calculate_descriptors<precision>, thread_grid(dimensions.x * dimensions.y * dimensions.z * (maximum_degree(coefficient_count) + 1)), 0, stream,
+    dimensions       ,
+    coefficient_count,
+    coefficients     ,
+    descriptors      );
+}
 
-  auto coefficients_offset = coefficient_count * (z + dimensions.z * (y + dimensions.y * x));
-  
-  product<<<grid_size_3d(dim3(coefficient_count, coefficient_count, coefficient_count)), block_size_3d()>>>(
+template<typename vector_type, typename precision>
+void launch_calculate_matrices(
+  const uint3         dimensions       ,
+  const unsigned int  vector_count     , 
+  const unsigned int  coefficient_count,
+  const vector_type*  vectors          ,
+  precision*          output_matrices  ,
+  const bool          even_only        = false,
+  const matrix_layout layout           = matrix_layout::column_major,
+  cudaStream_t        stream           = nullptr)
+{
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("calculate_matrices", stream, voxel_count, static_cast<size_t>(voxel_count) * vector_count * (sizeof(vector_type) + matrix_column_count(coefficient_count, even_only) * sizeof(precision)));
+  launch_1d(calculate_matrices<vector_type, precision>, block_grid(dimensions.x * dimensions.y * dimensions.z), 0, stream,
+    dimensions       ,
+    vector_count     ,
     coefficient_count,
-    lhs_coefficients + coefficients_offset,
-    rhs_coefficients + coefficients_offset,
-    out_coefficients + coefficients_offset);
+    vectors          ,
+    output_matrices  ,
+    even_only        ,
+    layout           );
+}
+template<typename point_type>
+void launch_normalize_samples(
+  const unsigned int voxel_count  ,
+  const unsigned int points_size  ,
+  point_type*        output_points,
+  cudaStream_t       stream       = nullptr)
+{
+  profile_scope profile("normalize_samples", stream, voxel_count, 2 * static_cast<size_t>(voxel_count) * points_size * sizeof(point_type));
+  launch_1d(normalize_samples<point_type>, block_grid(voxel_count), 0, stream, voxel_count, points_size, output_points);
+}
+template<typename precision, typename point_type, coefficient_layout layout = coefficient_layout::aos>
+void launch_sample_sums(
+  const uint3        dimensions       ,
+  const unsigned int coefficient_count,
+  const uint2        tessellations    ,
+  const precision*   coefficients     ,
+  point_type*        output_points    ,
+  unsigned int*      output_indices   ,
+  const unsigned int base_index       = 0   ,
+  const bool         normalize        = true,
+  cudaStream_t       stream           = nullptr)
+{
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("sample_sums", stream, voxel_count,
+    static_cast<size_t>(voxel_count) * (coefficient_count * sizeof(precision) + static_cast<size_t>(tessellations.x) * tessellations.y * (sizeof(point_type) + 6 * sizeof(unsigned int))));
+  profile_zero_voxels<layout>(profile, voxel_count, coefficient_count, coefficients);
+  auto grid = block_grid(dimensions.x * dimensions.y * dimensions.z);
+  if (!dispatch_max_l(maximum_degree(coefficient_count), [&] (auto degree)
+  {
+    launch_1d(sample_sums<decltype(degree)::value, precision, point_type, layout>, grid, 0, stream,
+      dimensions    ,
+      tessellations ,
+      coefficients  ,
+      output_points ,
+      output_indices,
+      base_index    ,
+      normalize     );
+  }))
+    launch_1d(sample_sums<precision, point_type, layout>, grid, 0, stream,
+      dimensions       ,
+      coefficient_count,
+      tessellations    ,
+      coefficients     ,
+      output_points    ,
+      output_indices   ,
+      base_index       ,
+      normalize        );
 }
+template<typename precision, typename vector_type, coefficient_layout layout = coefficient_layout::aos>
+void launch_extract_maxima(
+  const uint3        dimensions       ,
+  const unsigned int coefficient_count,
+  const precision*   coefficients     ,
+  const uint2        tessellations    ,
+  const unsigned int maxima_count     ,
+  vector_type*       maxima           ,
+  const bool         local_maxima     = false,
+  const bool         antipodal        = false,
+  cudaStream_t       stream           = nullptr)
+{
+  const auto voxel_count = dimensions.x * dimensions.y * dimensions.z;
+  profile_scope profile("extract_maxima", stream, voxel_count, static_cast<size_t>(voxel_count) * (coefficient_count * sizeof(precision) + maxima_count * sizeof(vector_type)));
+  profile_zero_voxels<layout>(profile, voxel_count, coefficient_count, coefficients);
+  auto grid        = block_grid(dimensions.x * dimensions.y * dimensions.z);
+  auto shared_size = extract_maxima_shared_size<compute_precision_t<precision>>(tessellations);
+  if (!dispatch_max_l(maximum_degree(coefficient_count), [&] (auto degree)
+  {
+    launch_1d(extract_maxima<decltype(degree)::value, precision, vector_type, layout>, grid, shared_size, stream,
+      dimensions   ,
+      coefficients ,
+      tessellations,
+      maxima_count ,
+      maxima       ,
+      local_maxima ,
+      antipodal    );
+  }))
+    launch_1d(extract_maxima<precision, vector_type, layout>, grid, shared_size, stream,
+      dimensions       ,
+      coefficient_count,
+      coefficients     ,
+      tessellations    ,
+      maxima_count     ,
+      maxima           ,
+      local_maxima     ,
+      antipodal        );
+}
+template<typename precision, typename vector_type>
+void launch_refine_maxima(
+  const unsigned int voxel_count      ,
+  const unsigned int coefficient_count,
+  const precision*   coefficients     ,
+  const unsigned int maxima_count     ,
+  vector_type*       maxima           ,
+  const unsigned int iterations       = 8,
+  const compute_precision_t<precision> maximum_step = compute_precision_t<precision>(0.1 ),
+  const compute_precision_t<precision> tolerance    = compute_precision_t<precision>(1e-6),
+  cudaStream_t       stream           = nullptr)
+{
+  profile_scope profile("refine_maxima", stream, voxel_count, static_cast<size_t>(voxel_count) * (coefficient_count * sizeof(precision) + 2 * maxima_count * sizeof(vector_type)));
+  profile_zero_voxels(profile, voxel_count, coefficient_count, coefficients);
+  auto grid = thread_grid(voxel_count * maxima_count);
+  if (!dispatch_max_l(maximum_degree(coefficient_count), [&] (auto degree)
+  {
+    launch_1d_in_place(refine_maxima<decltype(degree)::value, precision, vector_type>, grid, 0, stream,
+      voxel_count  ,
+      coefficients ,
+      maxima_count ,
+      maxima       ,
+      iterations   ,
+      maximum_step ,
+      tolerance    );
+  }))
+    launch_1d_in_place(refine_maxima<precision, vector_type>, grid, 0, stream,
+      voxel_count      ,
+      coefficient_count,
+      coefficients     ,
+      maxima_count     ,
+      maxima           ,
+      iterations       ,
+      maximum_step     ,
+      tolerance        );
+}
+// Seeds the local maxima on a coarse tessellations grid and refines them with Newton steps of at most the grid spacing.
+template<typename precision, typename vector_type>
+void launch_extract_refined_maxima(
+  const uint3        dimensions       ,
+  const unsigned int coefficient_count,
+  const precision*   coefficients     ,
+  const uint2        tessellations    ,
+  const unsigned int maxima_count     ,
+  vector_type*       maxima           ,
+  const bool         antipodal        = false,
+  const unsigned int iterations       = 8,
+  const compute_precision_t<precision> tolerance = compute_precision_t<precision>(1e-6),
+  cudaStream_t       stream           = nullptr)
+{
+  auto maximum_step = compute_precision_t<precision>(fmax(2 * M_PI / tessellations.x, M_PI / (tessellations.y - 1)));
+  launch_extract_maxima(dimensions, coefficient_count, coefficients, tessellations, maxima_count, maxima, true, antipodal, stream);
+  launch_refine_maxima (dimensions.x * dimensions.y * dimensions.z, coefficient_count, coefficients, maxima_count, maxima, iterations, maximum_step, tolerance, stream);
+}
+#endif
 }
 
 #endif
@@ -1,14 +1,237 @@
 #ifndef CUSH_WIGNER_H_
 #define CUSH_WIGNER_H_
 
-#include <host_defines.h>
 #include <math.h>
 
 #include <cush/choose.h>
+#include <cush/math.h>
+#include <cush/portability.h>
+
+// Symbols whose largest degree exceeds CUSH_WIGNER_RECURSION_DEGREE are computed by wigner_3j_recursive, since the
+// alternating sum of the Racah formula cancels at high degrees: its float error exceeds 1e-5 at degree 20 and 1e-1 at
+// degree 64, and its double error 1e-9 at degree 64, whereas the recursion stays at the rounding error.
+#ifndef CUSH_WIGNER_RECURSION_DEGREE
+#define CUSH_WIGNER_RECURSION_DEGREE 10
+#endif
 
 namespace cush
 {
+// The coefficients of the three-term recurrence in l3 of "Exact recursive evaluation of 3j- and 6j-coefficients for
+// quantum-mechanical coupling problems" by Schulten and Gordon, with j = l3 and m3 = -m1 - m2:
+//   j A(j + 1) f(j + 1) + B(j) f(j) + (j + 1) A(j) f(j - 1) = 0,
+//   A(j) = sqrt((j^2 - (l1 - l2)^2) ((l1 + l2 + 1)^2 - j^2) (j^2 - m3^2)),
+//   B(j) = -(2j + 1) ((l1 (l1 + 1) - l2 (l2 + 1)) m3 - j (j + 1) (m2 - m1)).
+// Input is in half-integer units, the factors are formed from integers so that they do not cancel.
+template<typename precision>
+__forceinline__ __host__ __device__ precision wigner_3j_recurrence_a(int two_l1, int two_l2, int two_l3, int two_m3)
+{
+  return math::sqrt(
+    precision((two_l3 - two_l1 + two_l2) * (two_l3 + two_l1 - two_l2)) *
+    precision((two_l1 + two_l2 + 2 - two_l3) * (two_l1 + two_l2 + 2 + two_l3)) *
+    precision((two_l3 - two_m3) * (two_l3 + two_m3))) / precision(8);
+}
+template<typename precision>
+__forceinline__ __host__ __device__ precision wigner_3j_recurrence_b(int two_l1, int two_l2, int two_l3, int two_m1, int two_m2, int two_m3)
+{
+  return -precision(two_l3 + 1) * (
+    precision(two_l1 * (two_l1 + 2) - two_l2 * (two_l2 + 2)) * precision(two_m3) - 
+    precision(two_l3 * (two_l3 + 2)) * precision(two_m2 - two_m1)) / precision(8);
+}
+// f(l3 + 1) from f = f(l3) and lower = f(l3 - 1), for l3 below the largest valid l3.
+template<typename precision>
+__forceinline__ __host__ __device__ precision wigner_3j_upward  (int two_l1, int two_l2, int two_l3, int two_m1, int two_m2, const precision f, const precision lower)
+{
+  const auto two_m3 = -two_m1 - two_m2;
+  // The limit of B(j) / j for j -> 0, where A(0) = 0 and l1 = l2.
+  if (two_l3 == 0)
+    return precision(two_m1 - two_m2) / 2 * f / wigner_3j_recurrence_a<precision>(two_l1, two_l2, 2, two_m3);
+  const precision j(precision(two_l3) / 2);
+  return -(wigner_3j_recurrence_b<precision>(two_l1, two_l2, two_l3, two_m1, two_m2, two_m3) * f + 
+          (j + 1) * wigner_3j_recurrence_a<precision>(two_l1, two_l2, two_l3, two_m3) * lower) / 
+          (j * wigner_3j_recurrence_a<precision>(two_l1, two_l2, two_l3 + 2, two_m3));
+}
+// f(l3 - 1) from f = f(l3) and upper = f(l3 + 1), for l3 above the smallest valid l3.
+template<typename precision>
+__forceinline__ __host__ __device__ precision wigner_3j_downward(int two_l1, int two_l2, int two_l3, int two_m1, int two_m2, const precision f, const precision upper)
+{
+  const auto two_m3 = -two_m1 - two_m2;
+  const precision j(precision(two_l3) / 2);
+  return -(wigner_3j_recurrence_b<precision>(two_l1, two_l2, two_l3, two_m1, two_m2, two_m3) * f + 
+          j * wigner_3j_recurrence_a<precision>(two_l1, two_l2, two_l3 + 2, two_m3) * upper) / 
+          ((j + 1) * wigner_3j_recurrence_a<precision>(two_l1, two_l2, two_l3, two_m3));
+}
+
+// The smallest l3 and the number of l3 of the valid (l1 l2 l3 m1 m2 -m1-m2), i.e. l3 = range_begin, range_begin + 1, ...,
+// l1 + l2. The size is 0 if m1 or m2 are invalid. Input and output are in half-integer units!
+__forceinline__ __host__ __device__ int wigner_3j_range_begin(int two_l1, int two_l2, int two_m1, int two_m2)
+{
+  return abs(two_l1 - two_l2) > abs(two_m1 + two_m2) ? abs(two_l1 - two_l2) : abs(two_m1 + two_m2);
+}
+__forceinline__ __host__ __device__ int wigner_3j_range_size (int two_l1, int two_l2, int two_m1, int two_m2)
+{
+  if (two_l1 < 0 || two_l2 < 0 || abs(two_m1) > two_l1 || abs(two_m2) > two_l2 || ((two_l1 + two_m1) & 1) || ((two_l2 + two_m2) & 1))
+    return 0;
+  return (two_l1 + two_l2 - wigner_3j_range_begin(two_l1, two_l2, two_m1, two_m2)) / 2 + 1;
+}
+
+// Based on "Exact recursive evaluation of 3j- and 6j-coefficients for quantum-mechanical coupling problems" by Schulten
+// and Gordon. Input is in half-integer units! Recurses upwards from the smallest valid l3 while the values increase, i.e.
+// out of the classically forbidden region, and downwards from the largest within the classical region, where both are
+// stable. The two solutions are matched at the maximum reached upwards, normalized by sum (2 l3 + 1) f(l3)^2 = 1 and
+// signed by the sign (-1)^(l1 - l2 - m3) of f(l1 + l2). O(l1 + l2) with constant memory, accurate to high degrees.
+// See wigner_3j_range for all l3 at once.
+template<typename precision>
+__host__ __device__ precision wigner_3j_recursive(int two_l1, int two_l2, int two_l3,
+                                                  int two_m1, int two_m2, int two_m3)
+{
+  if (two_l1 < 0                    ||
+      two_l2 < 0                    ||
+      two_l3 < 0                    ||
+      two_l2 < abs(two_l1 - two_l3) || 
+      two_l2 > two_l1 + two_l3      || 
+      ((two_l1 + two_l2 + two_l3) & 1) || 
+      (abs(two_m1) > two_l1            || 
+       abs(two_m2) > two_l2            || 
+       abs(two_m3) > two_l3            || 
+      ((two_l1 + two_m1) & 1)          || 
+      ((two_l2 + two_m2) & 1)          || 
+      ((two_l3 + two_m3) & 1)          || 
+      two_m1 + two_m2 + two_m3      != 0))
+    return precision(0);
+
+  const auto two_min = wigner_3j_range_begin(two_l1, two_l2, two_m1, two_m2);
+  const auto two_max = two_l1 + two_l2;
+  const auto sign    = ((two_l1 - two_l2 - two_m3) / 2) & 1 ? precision(-1) : precision(1);
+  if (two_min == two_max)
+    return sign * math::rsqrt(precision(two_max + 1));
+
+  // The unnormalized solutions are rescaled whenever they exceed the bound, so that their squares do not overflow.
+  const precision bound(1e10), inverse_bound(1e-10);
+
+  precision lower(0), f(1), forward_norm(two_min + 1), forward_value(two_l3 == two_min ? 1 : 0);
+  auto two_mid = two_min;
+  while (two_mid < two_max)
+  {
+    const auto next = wigner_3j_upward(two_l1, two_l2, two_mid, two_m1, two_m2, f, lower);
+    if (abs(next) < abs(f))
+      break;
+
+    lower    = f;
+    f        = next;
+    two_mid += 2;
+    forward_norm += precision(two_mid + 1) * f * f;
+    if (two_mid == two_l3)
+      forward_value = f;
+    if (abs(f) > bound)
+    {
+      lower         *= inverse_bound;
+      f             *= inverse_bound;
+      forward_value *= inverse_bound;
+      forward_norm  *= inverse_bound * inverse_bound;
+    }
+  }
+  if (two_mid == two_max)
+    return (f < 0 ? -sign : sign) * forward_value * math::rsqrt(forward_norm);
+
+  precision upper(0), g(1), backward_norm(two_max + 1), backward_value(two_l3 == two_max ? 1 : 0);
+  for (auto two_j = two_max; two_j > two_mid; two_j -= 2)
+  {
+    const auto next = wigner_3j_downward(two_l1, two_l2, two_j, two_m1, two_m2, g, upper);
+    upper = g;
+    g     = next;
+    if (two_j - 2 > two_mid)
+      backward_norm += precision(two_j - 1) * g * g;
+    if (two_j - 2 == two_l3)
+      backward_value = g;
+    if (abs(g) > bound)
+    {
+      upper          *= inverse_bound;
+      g              *= inverse_bound;
+      backward_value *= inverse_bound;
+      backward_norm  *= inverse_bound * inverse_bound;
+    }
+  }
+
+  // g(l1 + l2) stays positive through the rescaling, hence f(l1 + l2) has the sign of the scale.
+  const auto scale = f / g;
+  const auto value = two_l3 <= two_mid ? forward_value : scale * backward_value;
+  return (scale < 0 ? -sign : sign) * value * math::rsqrt(forward_norm + scale * scale * backward_norm);
+}
+// Writes (l1 l2 l3 m1 m2 -m1-m2) for all wigner_3j_range_size(...) valid l3 from wigner_3j_range_begin(...) to l1 + l2
+// into output and returns their count, by the recursion of wigner_3j_recursive in O(l1 + l2) instead of O(l1 + l2) per
+// symbol. Input is in half-integer units! The recursion is sequential in l3, hence parallelize over (l1, l2, m1, m2),
+// e.g. with a thread per m1.
+template<typename precision>
+__host__ __device__ int wigner_3j_range(int two_l1, int two_l2, int two_m1, int two_m2, precision* output)
+{
+  const auto size = wigner_3j_range_size(two_l1, two_l2, two_m1, two_m2);
+  if (size == 0)
+    return 0;
+
+  const auto two_min = wigner_3j_range_begin(two_l1, two_l2, two_m1, two_m2);
+  const auto two_max = two_l1 + two_l2;
+  const auto sign    = ((two_l1 - two_l2 + two_m1 + two_m2) / 2) & 1 ? precision(-1) : precision(1);
+
+  // The unnormalized solutions are rescaled whenever they exceed the bound, so that their squares do not overflow.
+  const precision bound(1e10), inverse_bound(1e-10);
+
+  output[0] = precision(1);
+  precision norm(two_min + 1);
+  auto mid = 0;
+  while (mid + 1 < size)
+  {
+    const auto next = wigner_3j_upward(two_l1, two_l2, two_min + 2 * mid, two_m1, two_m2, output[mid], mid > 0 ? output[mid - 1] : precision(0));
+    if (abs(next) < abs(output[mid]))
+      break;
+
+    output[++mid] = next;
+    norm += precision(two_min + 2 * mid + 1) * next * next;
+    if (abs(next) > bound)
+    {
+      for (auto index = 0; index <= mid; index++)
+        output[index] *= inverse_bound;
+      norm *= inverse_bound * inverse_bound;
+    }
+  }
+
+  if (mid + 1 < size)
+  {
+    precision upper(0), g(1), backward_norm(two_max + 1);
+    output[size - 1] = g;
+    for (auto index = size - 1; index > mid; index--)
+    {
+      const auto next = wigner_3j_downward(two_l1, two_l2, two_min + 2 * index, two_m1, two_m2, g, upper);
+      upper = g;
+      g     = next;
+      if (index - 1 == mid)
+        break;
+
+      output[index - 1] = g;
+      backward_norm += precision(two_min + 2 * index - 1) * g * g;
+      if (abs(g) > bound)
+      {
+        for (auto upper_index = index - 1; upper_index < size; upper_index++)
+          output[upper_index] *= inverse_bound;
+        upper         *= inverse_bound;
+        g             *= inverse_bound;
+        backward_norm *= inverse_bound * inverse_bound;
+      }
+    }
+
+    const auto scale = output[mid] / g;
+    for (auto index = mid + 1; index < size; index++)
+      output[index] *= scale;
+    norm += scale * scale * backward_norm;
+  }
+
+  const auto normalization = (output[size - 1] < 0 ? -sign : sign) * math::rsqrt(norm);
+  for (auto index = 0; index < size; index++)
+    output[index] *= normalization;
+  return size;
+}
+
 // Based on GNU Scientific Library's implementation. Input is in half-integer units!
+// Beyond CUSH_WIGNER_RECURSION_DEGREE, see wigner_3j_recursive.
 template<typename precision>
 __host__ __device__ precision wigner_3j(int two_l1, int two_l2, int two_l3,
                                         int two_m1, int two_m2, int two_m3)
@@ -18,16 +241,21 @@ __host__ __device__ precision wigner_3j(int two_l1, int two_l2, int two_l3,
       two_l3 < 0                    ||
       two_l2 < abs(two_l1 - two_l3) || 
       two_l2 > two_l1 + two_l3      || 
-      two_l1 + two_l2 + two_l3 & 1  || 
-      (abs(two_m1) > two_l1         || 
-       abs(two_m2) > two_l2         || 
-       abs(two_m3) > two_l3         || 
-      two_l1 + two_m1 & 1           || 
-      two_l2 + two_m2 & 1           || 
-      two_l3 + two_m3 & 1           || 
+      ((two_l1 + two_l2 + two_l3) & 1) || 
+      (abs(two_m1) > two_l1            || 
+       abs(two_m2) > two_l2            || 
+       abs(two_m3) > two_l3            || 
+      ((two_l1 + two_m1) & 1)          || 
+      ((two_l2 + two_m2) & 1)          || 
+      ((two_l3 + two_m3) & 1)          || 
       two_m1 + two_m2 + two_m3      != 0))
     return precision(0);
 
+  if (two_l1 > 2 * CUSH_WIGNER_RECURSION_DEGREE ||
+      two_l2 > 2 * CUSH_WIGNER_RECURSION_DEGREE ||
+      two_l3 > 2 * CUSH_WIGNER_RECURSION_DEGREE)
+    return wigner_3j_recursive<precision>(two_l1, two_l2, two_l3, two_m1, two_m2, two_m3);
+
   // Special case for (ja jb jc 0 0 0) = 0 when ja + jb + jc is odd.
   if (two_m1 == 0 && two_m2 == 0 && two_m3 == 0 && (two_l1 + two_l2 + two_l3) % 4 == 2)
     return precision(0);
@@ -42,25 +270,27 @@ __host__ __device__ precision wigner_3j(int two_l1, int two_l2, int two_l3,
   auto lpm2  = ( two_l2 + two_m2) / 2;
   auto lpm3  = ( two_l3 + two_m3) / 2;
   auto lsum  = ( two_l1 + two_l2 + two_l3) / 2;
-  int  kmin  = fmax(fmax(0.0f                   , lpm2 - lmm3), lmm1 - lpm3);
-  int  kmax  = fmin(fmin(static_cast<float>(lc3), lmm1       ), lpm2       );
+  auto kmin  = lpm2 - lmm3 > lmm1 - lpm3 ? lpm2 - lmm3 : lmm1 - lpm3;
+  auto kmax  = lmm1        < lpm2        ? lmm1        : lpm2       ;
+  kmin       = kmin < 0   ? 0   : kmin;
+  kmax       = kmax > lc3 ? lc3 : kmax;
   auto sign  = kmin - lpm1 + lmm2 & 1 ? -1 : 1;
 
-  auto bcn1  = ln_choose(two_l1  , lc3 );
-  auto bcn2  = ln_choose(two_l2  , lc3 );
-  auto bcd1  = ln_choose(lsum + 1, lc3 );
-  auto bcd2  = ln_choose(two_l1  , lmm1);
-  auto bcd3  = ln_choose(two_l2  , lmm2);
-  auto bcd4  = ln_choose(two_l3  , lpm3);
-  auto lnorm = 0.5 * (bcn1 + bcn2 - bcd1 - bcd2 - bcd3 - bcd4 - log(two_l3 + 1.0));
+  auto bcn1  = ln_choose<precision>(two_l1  , lc3 );
+  auto bcn2  = ln_choose<precision>(two_l2  , lc3 );
+  auto bcd1  = ln_choose<precision>(lsum + 1, lc3 );
+  auto bcd2  = ln_choose<precision>(two_l1  , lmm1);
+  auto bcd3  = ln_choose<precision>(two_l2  , lmm2);
+  auto bcd4  = ln_choose<precision>(two_l3  , lpm3);
+  auto lnorm = (bcn1 + bcn2 - bcd1 - bcd2 - bcd3 - bcd4 - math::log(precision(two_l3 + 1))) / 2;
 
   precision sum_pos(0), sum_neg(0);
   for (auto k = kmin; k <= kmax; k++)
   {
-    auto bc1  = ln_choose(lc3,        k);
-    auto bc2  = ln_choose(lc2, lmm1 - k);
-    auto bc3  = ln_choose(lc1, lpm2 - k);
-    auto term = exp(bc1 + bc2 + bc3 + lnorm);
+    auto bc1  = ln_choose<precision>(lc3,        k);
+    auto bc2  = ln_choose<precision>(lc2, lmm1 - k);
+    auto bc3  = ln_choose<precision>(lc1, lpm2 - k);
+    auto term = math::exp(bc1 + bc2 + bc3 + lnorm);
     sign < 0 ? (sum_neg += term) : (sum_pos += term);
     sign = -sign;
   }
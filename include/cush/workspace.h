@@ -0,0 +1,142 @@
+#ifndef CUSH_WORKSPACE_H_
+#define CUSH_WORKSPACE_H_
+
+#include <cstddef>
+#include <cstdint>
+#ifndef CUSH_CPU_ONLY
+#include <cuda_runtime_api.h>
+#endif
+#include <new>
+#include <stdexcept>
+
+#include <cush/portability.h>
+
+// Stream-ordered scratch memory. A workspace reserves a single block of device memory from the stream-ordered pool of
+// the current device, out of which the launchers taking a workspace carve their temporaries by bumping an offset. A
+// launcher releases its temporaries on return, without synchronizing: the next launch on the same stream is ordered
+// after the kernels which used them. Sizing the workspace by the *_workspace_size queries at startup hence avoids any
+// allocation in the steady state of a pipeline. With CUSH_CPU_ONLY, only the size queries are available.
+namespace cush
+{
+// The alignment of the allocations of a workspace, which suffices for the vectorized accesses of cuBLAS and cuSOLVER.
+__forceinline__ __host__ __device__ constexpr size_t workspace_alignment()
+{
+  return 256;
+}
+__forceinline__ __host__ __device__ constexpr size_t workspace_aligned_size(const size_t size)
+{
+  return (size + workspace_alignment() - 1) / workspace_alignment() * workspace_alignment();
+}
+// The workspace size of count elements of type.
+template<typename type>
+__forceinline__ __host__ __device__ constexpr size_t workspace_size(const size_t count)
+{
+  return workspace_aligned_size(count * sizeof(type));
+}
+
+#ifndef CUSH_CPU_ONLY
+// Raises the release threshold of the default pool of the current device to threshold, so that the pool retains the
+// memory of destroyed workspaces for the next ones instead of returning it to the system at each synchronization. The
+// threshold is process-wide, hence left to the application.
+inline cudaError_t retain_pool_memory(const uint64_t threshold = UINT64_MAX)
+{
+  int           device;
+  cudaMemPool_t pool  ;
+  auto          value = threshold;
+  auto          error = cudaGetDevice(&device);
+  if (error == cudaSuccess)
+    error = cudaDeviceGetDefaultMemPool(&pool, device);
+  if (error == cudaSuccess)
+    error = cudaMemPoolSetAttribute    (pool, cudaMemPoolAttrReleaseThreshold, &value);
+  return error;
+}
+
+class workspace
+{
+public:
+  // Throws std::bad_alloc if the allocation fails. See retain_pool_memory for reusing the memory of earlier workspaces.
+  explicit workspace           (const size_t capacity, cudaStream_t stream = nullptr)
+  : capacity_(workspace_aligned_size(capacity)), stream_(stream)
+  {
+    if (capacity_ > 0 && cudaMallocAsync(&memory_, capacity_, stream_) != cudaSuccess)
+      throw std::bad_alloc();
+  }
+  workspace           (const workspace&  that) = delete ;
+  workspace           (      workspace&& temp) : capacity_(temp.capacity_), used_(temp.used_), memory_(temp.memory_), stream_(temp.stream_)
+  {
+    temp.memory_ = nullptr;
+  }
+ ~workspace           ()
+  {
+    if (memory_ != nullptr)
+      cudaFreeAsync(memory_, stream_);
+  }
+  workspace& operator=(const workspace&  that) = delete ;
+  workspace& operator=(      workspace&& temp) = delete ;
+
+  // Throws std::length_error if the remaining capacity does not suffice, i.e. if the workspace was sized too small.
+  template<typename type>
+  type*        allocate(const size_t count)
+  {
+    auto size = workspace_size<type>(count);
+    if (used_ + size > capacity_)
+      throw std::length_error("cush: workspace capacity exceeded");
+
+    auto pointer = reinterpret_cast<type*>(static_cast<char*>(memory_) + used_);
+    used_ += size;
+    return pointer;
+  }
+  // Releases all allocations since the mark.
+  void         release (const size_t mark)
+  {
+    used_ = mark;
+  }
+  size_t       mark    () const
+  {
+    return used_;
+  }
+
+  size_t       capacity() const
+  {
+    return capacity_;
+  }
+  size_t       used    () const
+  {
+    return used_;
+  }
+  cudaStream_t stream  () const
+  {
+    return stream_;
+  }
+
+protected:
+  size_t       capacity_ = 0;
+  size_t       used_     = 0;
+  void*        memory_   = nullptr;
+  cudaStream_t stream_   = nullptr;
+};
+
+// Releases the allocations made from a workspace during its lifetime.
+class workspace_scope
+{
+public:
+  explicit workspace_scope           (workspace& workspace) : workspace_(workspace), mark_(workspace.mark())
+  {
+  }
+  workspace_scope           (const workspace_scope&  that) = delete ;
+  workspace_scope           (      workspace_scope&& temp) = delete ;
+ ~workspace_scope           ()
+  {
+    workspace_.release(mark_);
+  }
+  workspace_scope& operator=(const workspace_scope&  that) = delete ;
+  workspace_scope& operator=(      workspace_scope&& temp) = delete ;
+
+protected:
+  workspace& workspace_;
+  size_t     mark_     ;
+};
+#endif
+}
+
+#endif
@@ -0,0 +1,133 @@
+#include "catch.hpp"
+
+#ifndef CUSH_CPU_ONLY
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <cush/deconvolution.h>
+
+namespace
+{
+template<typename type>
+type*             to_device(const std::vector<type>& values)
+{
+  type* pointer;
+  cudaMalloc(reinterpret_cast<void**>(&pointer), values.size() * sizeof(type));
+  cudaMemcpy(pointer, values.data(), values.size() * sizeof(type), cudaMemcpyHostToDevice);
+  return pointer;
+}
+template<typename type>
+std::vector<type> to_host  (const type* pointer, const size_t size)
+{
+  std::vector<type> values(size);
+  cudaMemcpy(values.data(), pointer, size * sizeof(type), cudaMemcpyDeviceToHost);
+  return values;
+}
+
+// Well spread (unused, theta, phi) directions on a spiral.
+std::vector<double3> directions(const unsigned int count)
+{
+  std::vector<double3> vectors(count);
+  for (auto index = 0u; index < count; index++)
+    vectors[index] = double3 {1.0, 2.399963 * index, std::acos(1.0 - 2.0 * (index + 0.5) / count)};
+  return vectors;
+}
+double               angle     (const double theta_1, const double phi_1, const double theta_2, const double phi_2)
+{
+  auto cosine = std::sin(phi_1) * std::sin(phi_2) * std::cos(theta_1 - theta_2) + std::cos(phi_1) * std::cos(phi_2);
+  return std::acos(std::min(std::abs(cosine), 1.0)); // Antipodally symmetric.
+}
+}
+
+TEST_CASE("Constrained spherical deconvolution resolves two crossing fibers.", "[deconvolution]") {
+  const unsigned int max_l = 8, vector_count = 60, coefficient_count = 81, constraint_count = 300;
+  const double       fibers[2][2] = {{0.3, 0.9}, {1.9, 1.2}}; // (theta, phi)
+
+  // A zonal response, and the signal of a fiber orientation distribution of two truncated delta functions.
+  double zonal[max_l + 1], response[max_l + 1];
+  for (auto l = 0u; l <= max_l; l++)
+    zonal[l] = l % 2 == 0 ? std::exp(-0.1 * l * l) : 0.0;
+  cush::zonal_convolution_scales(max_l, zonal, response);
+
+  std::vector<double> distribution(coefficient_count, 0.0);
+  for (auto index = 0u; index < coefficient_count; index++)
+    if (cush::coefficient_lm(index).x % 2 == 0)
+      for (auto& fiber : fibers)
+        distribution[index] += cush::evaluate<double>(index, fiber[0], fiber[1]);
+
+  auto vectors = directions(vector_count), constraint_vectors = directions(constraint_count);
+  std::vector<double> samples(vector_count, 0.0);
+  for (auto vector = 0u; vector < vector_count; vector++)
+    for (auto index = 0u; index < coefficient_count; index++)
+      samples[vector] += response[cush::coefficient_lm(index).x] * distribution[index] * cush::evaluate<double>(index, vectors[vector].y, vectors[vector].z);
+
+  auto device_vectors     = to_device(vectors);
+  auto device_constraints = to_device(constraint_vectors);
+  auto device_samples     = to_device(samples);
+  auto device_output      = to_device(std::vector<double>(coefficient_count));
+
+  cush::deconvolution_plan<double> plan(vector_count, coefficient_count, device_vectors, response, constraint_count, device_constraints);
+  const auto solve = [&] (const unsigned int iterations, unsigned int& performed)
+  {
+    performed = plan.solve(1u, device_samples, device_output, iterations);
+    return to_host(device_output, coefficient_count);
+  };
+  const auto amplitudes = [&] (const std::vector<double>& coefficients)
+  {
+    std::vector<double> values(constraint_count);
+    for (auto point = 0u; point < constraint_count; point++)
+      values[point] = cush::evaluate_sum(max_l, constraint_vectors[point].y, constraint_vectors[point].z, coefficients.data());
+    return values;
+  };
+
+  unsigned int performed;
+  auto unconstrained = solve(0 , performed);
+  REQUIRE(performed == 0);
+  auto constrained   = solve(50, performed);
+  REQUIRE(performed >  0 );
+  REQUIRE(performed <  50);
+
+  SECTION("The iterations exit once the constrained directions do not change.") {
+    unsigned int exact;
+    REQUIRE(solve(performed, exact) == constrained);
+    REQUIRE(exact == performed);
+    REQUIRE(solve(performed - 1, exact) != constrained);
+  }
+  SECTION("The constraints suppress the negative lobes, and the maxima are at the fibers.") {
+    auto unconstrained_amplitudes = amplitudes(unconstrained);
+    auto constrained_amplitudes   = amplitudes(constrained  );
+    auto maximum = std::max_element(constrained_amplitudes.begin(), constrained_amplitudes.end());
+    auto minimum = *std::min_element(constrained_amplitudes.begin(), constrained_amplitudes.end());
+    REQUIRE(*std::min_element(unconstrained_amplitudes.begin(), unconstrained_amplitudes.end()) < -0.05 * *maximum);
+    REQUIRE(minimum > -0.05 * *maximum);
+
+    auto& peak = constraint_vectors[maximum - constrained_amplitudes.begin()];
+    REQUIRE(std::min(angle(peak.y, peak.z, fibers[0][0], fibers[0][1]), angle(peak.y, peak.z, fibers[1][0], fibers[1][1])) < 0.2);
+    for (auto& fiber : fibers)
+    {
+      REQUIRE(cush::evaluate_sum(max_l, fiber[0], fiber[1], constrained.data()) > 0.9 * *maximum);
+      REQUIRE(cush::evaluate_sum(max_l, fiber[0], fiber[1], constrained.data()) > 2.0 * cush::evaluate_sum(max_l, fiber[0], fiber[1] + 1.2, constrained.data()));
+    }
+  }
+
+  cudaFree(device_output     );
+  cudaFree(device_samples    );
+  cudaFree(device_constraints);
+  cudaFree(device_vectors    );
+}
+
+TEST_CASE("Deconvolution plans reject normal matrices which are not positive definite.", "[deconvolution]") {
+  const unsigned int vector_count = 30, coefficient_count = 25;
+  double response[] = {1.0, 0.0, 0.5, 0.0, 0.25};
+
+  // At the pole, all harmonics of m != 0 vanish.
+  auto device_vectors = to_device(std::vector<double3>(vector_count, double3 {1.0, 0.0, 0.0}));
+  REQUIRE_THROWS_AS((cush::deconvolution_plan<double>(vector_count, coefficient_count, device_vectors, response, vector_count, device_vectors, 0.0)), std::runtime_error);
+  REQUIRE_NOTHROW  ((cush::deconvolution_plan<double>(vector_count, coefficient_count, device_vectors, response, vector_count, device_vectors, 1.0)));
+  cudaFree(device_vectors);
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include "catch.hpp"
+
+#ifndef CUSH_CPU_ONLY
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <cush/distance.h>
+#include <cush/host.h>
+
+namespace
+{
+template<typename type>
+type*             to_device(const std::vector<type>& values)
+{
+  type* pointer;
+  cudaMalloc(reinterpret_cast<void**>(&pointer), values.size() * sizeof(type));
+  cudaMemcpy(pointer, values.data(), values.size() * sizeof(type), cudaMemcpyHostToDevice);
+  return pointer;
+}
+template<typename type>
+std::vector<type> to_host  (const type* pointer, const size_t size)
+{
+  std::vector<type> values(size);
+  cudaMemcpy(values.data(), pointer, size * sizeof(type), cudaMemcpyDeviceToHost);
+  return values;
+}
+
+// The vector-major database in the given layout.
+template<cush::coefficient_layout layout>
+std::vector<double> relayout(const std::vector<double>& database, const unsigned int database_count, const unsigned int coefficient_count)
+{
+  std::vector<double> values(cush::layout_size<layout>(database_count, coefficient_count), 0.0);
+  for (auto vector = 0u; vector < database_count; vector++)
+    for (auto index = 0u; index < coefficient_count; index++)
+      values[cush::layout_offset<layout>(database_count, coefficient_count, vector, index)] = database[vector * coefficient_count + index];
+  return values;
+}
+
+struct distance_fixture
+{
+  static constexpr unsigned int query_count = 37, database_count = 75, coefficient_count = 25;
+
+  distance_fixture() : queries(query_count * coefficient_count), database(database_count * coefficient_count),
+    l1(query_count * database_count), l2(query_count * database_count)
+  {
+    std::mt19937                           generator(3);
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+    for (auto& value : queries ) value = distribution(generator);
+    for (auto& value : database) value = distribution(generator);
+    // A tie, broken by index.
+    std::copy_n(database.begin() + 7 * coefficient_count, coefficient_count, database.begin() + 3 * coefficient_count);
+
+    cush::host::pairwise_distances(query_count, database_count, coefficient_count, queries.data(), database.data(), l1.data(), cush::distance_metric::l1);
+    cush::host::pairwise_distances(query_count, database_count, coefficient_count, queries.data(), database.data(), l2.data(), cush::distance_metric::l2);
+  }
+
+  // The neighbor_count nearest database indices of each query by the host distances.
+  std::vector<unsigned int> nearest(const std::vector<double>& distances, const unsigned int neighbor_count) const
+  {
+    std::vector<unsigned int> indices;
+    for (auto query = 0u; query < query_count; query++)
+    {
+      std::vector<std::pair<double, unsigned int>> pairs;
+      for (auto vector = 0u; vector < database_count; vector++)
+        pairs.emplace_back(distances[vector + database_count * query], vector);
+      std::sort(pairs.begin(), pairs.end());
+      for (auto neighbor = 0u; neighbor < neighbor_count; neighbor++)
+        indices.push_back(pairs[neighbor].second);
+    }
+    return indices;
+  }
+
+  std::vector<double> queries, database, l1, l2;
+};
+
+template<cush::coefficient_layout layout>
+void check_distances(const distance_fixture& fixture, cublasHandle_t cublas)
+{
+  const auto query_count = fixture.query_count, database_count = fixture.database_count, coefficient_count = fixture.coefficient_count;
+  auto device_queries   = to_device(fixture.queries);
+  auto device_database  = to_device(relayout<layout>(fixture.database, database_count, coefficient_count));
+  auto device_distances = to_device(std::vector<double>(query_count * database_count));
+
+  cush::launch_pairwise_distances<double, layout>(query_count, database_count, coefficient_count, device_queries, device_database, device_distances, cush::distance_metric::l1);
+  auto l1 = to_host(device_distances, query_count * database_count);
+  cush::launch_pairwise_distances<double, layout>(query_count, database_count, coefficient_count, device_queries, device_database, device_distances, cush::distance_metric::l2);
+  auto l2 = to_host(device_distances, query_count * database_count);
+  cush::launch_l2_distances<double, layout>(cublas, query_count, database_count, coefficient_count, device_queries, device_database, device_distances);
+  auto gemm = to_host(device_distances, query_count * database_count);
+
+  for (auto index = 0u; index < query_count * database_count; index++)
+  {
+    REQUIRE(l1  [index] == Approx(fixture.l1[index]).margin(1e-10));
+    REQUIRE(l2  [index] == Approx(fixture.l2[index]).margin(1e-10));
+    REQUIRE(gemm[index] == Approx(fixture.l2[index]).margin(1e-6 ));
+  }
+
+  cudaFree(device_distances);
+  cudaFree(device_database );
+  cudaFree(device_queries  );
+}
+}
+
+TEST_CASE("Device distances match the host distances in every layout.", "[distance]") {
+  distance_fixture fixture;
+  cublasHandle_t   cublas;
+  cublasCreate(&cublas);
+
+  check_distances<cush::coefficient_layout::aos  >(fixture, cublas);
+  check_distances<cush::coefficient_layout::soa  >(fixture, cublas);
+  check_distances<cush::coefficient_layout::aosoa>(fixture, cublas);
+
+  cublasDestroy(cublas);
+}
+
+TEST_CASE("Nearest neighbors are the smallest host distances in ascending order, ties broken by index.", "[distance]") {
+  distance_fixture fixture;
+  const auto query_count = fixture.query_count, database_count = fixture.database_count, coefficient_count = fixture.coefficient_count;
+  const unsigned int neighbor_count = 5;
+
+  cublasHandle_t cublas;
+  cublasCreate(&cublas);
+  auto device_queries   = to_device(fixture.queries );
+  auto device_database  = to_device(fixture.database);
+  auto device_indices   = to_device(std::vector<unsigned int>(query_count * (database_count + 5)));
+  auto device_distances = to_device(std::vector<double>      (query_count * (database_count + 5)));
+
+  SECTION("In batches, for both metrics.") {
+    for (auto metric : {cush::distance_metric::l1, cush::distance_metric::l2})
+    {
+      auto& reference = metric == cush::distance_metric::l1 ? fixture.l1 : fixture.l2;
+      cush::launch_nearest_neighbors<double>(cublas, query_count, database_count, coefficient_count, device_queries, device_database,
+        neighbor_count, device_indices, device_distances, metric, 10);
+      auto indices   = to_host(device_indices  , query_count * neighbor_count);
+      auto distances = to_host(device_distances, query_count * neighbor_count);
+      auto expected  = fixture.nearest(reference, neighbor_count);
+      // The GEMM may round the distances of the tie apart.
+      if (metric == cush::distance_metric::l1)
+        REQUIRE(indices == expected);
+      for (auto index = 0u; index < query_count * neighbor_count; index++)
+      {
+        auto offset = database_count * (index / neighbor_count);
+        REQUIRE(distances[index] == Approx(reference[indices [index] + offset]).margin(1e-6));
+        REQUIRE(distances[index] == Approx(reference[expected[index] + offset]).margin(1e-6));
+      }
+    }
+  }
+  SECTION("The neighbors beyond the database are marked by database_count and infinite distances.") {
+    auto device_reference = to_device(fixture.l1);
+    cush::launch_select_nearest(query_count, database_count, database_count + 5, device_reference, device_indices, device_distances);
+    auto indices   = to_host(device_indices  , query_count * (database_count + 5));
+    auto distances = to_host(device_distances, query_count * (database_count + 5));
+    auto expected  = fixture.nearest(fixture.l1, database_count);
+    for (auto query = 0u; query < query_count; query++)
+    {
+      REQUIRE(std::equal(expected.begin() + query * database_count, expected.begin() + (query + 1) * database_count, indices.begin() + query * (database_count + 5)));
+      for (auto neighbor = database_count; neighbor < database_count + 5; neighbor++)
+      {
+        REQUIRE(indices  [query * (database_count + 5) + neighbor] == database_count);
+        REQUIRE(std::isinf(distances[query * (database_count + 5) + neighbor]));
+      }
+    }
+    cudaFree(device_reference);
+  }
+
+  cudaFree(device_distances);
+  cudaFree(device_indices  );
+  cudaFree(device_database );
+  cudaFree(device_queries  );
+  cublasDestroy(cublas);
+}
+
+#endif
@@ -9,3 +9,20 @@ TEST_CASE("Factorials are computed.", "[factorial]") {
   REQUIRE(cush::factorial<float>(3)  == 6);
   REQUIRE(cush::factorial<float>(10) == 3628800);
 }
+
+TEST_CASE("Double and logarithmic factorials are computed.", "[factorial]") {
+  REQUIRE(cush::double_factorial<float>(0)   == 1);
+  REQUIRE(cush::double_factorial<float>(7)   == 105);
+  REQUIRE(cush::double_factorial<float>(10)  == 3840);
+  REQUIRE(cush::ln_factorial<double>(20)     == Approx(42.3356164608));
+  REQUIRE(cush::ln_factorial<double>(200)    == Approx(863.2319871924));
+  REQUIRE(cush::ln_factorial<float> (200)    == Approx(863.2319871924f));
+  REQUIRE(cush::ln_double_factorial<double>(9) == Approx(log(945.0)));
+}
+
+TEST_CASE("Fixed degree factorials are computed at compile time.", "[factorial]") {
+  static_assert(cush::factorial       <double, 0>() == 1   , "");
+  static_assert(cush::factorial       <double, 5>() == 120 , "");
+  static_assert(cush::double_factorial<double, 7>() == 105 , "");
+  REQUIRE((cush::factorial<float, 10>() == cush::factorial<float>(10)));
+}
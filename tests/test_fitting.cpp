@@ -0,0 +1,113 @@
+#include "catch.hpp"
+
+#ifndef CUSH_CPU_ONLY
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <cush/fitting.h>
+
+namespace
+{
+template<typename type>
+type*             to_device(const std::vector<type>& values)
+{
+  type* pointer;
+  cudaMalloc(reinterpret_cast<void**>(&pointer), values.size() * sizeof(type));
+  cudaMemcpy(pointer, values.data(), values.size() * sizeof(type), cudaMemcpyHostToDevice);
+  return pointer;
+}
+template<typename type>
+std::vector<type> to_host  (const type* pointer, const size_t size)
+{
+  std::vector<type> values(size);
+  cudaMemcpy(values.data(), pointer, size * sizeof(type), cudaMemcpyDeviceToHost);
+  return values;
+}
+
+// Well spread (unused, theta, phi) directions, or directions at the pole, at which all harmonics of m != 0 vanish.
+std::vector<double3> directions(const unsigned int count, const bool polar = false)
+{
+  std::vector<double3> vectors(count);
+  for (auto index = 0u; index < count; index++)
+    vectors[index] = polar ? double3 {1.0, 0.0, 0.0} : double3 {1.0, 2.399963 * index, std::acos(1.0 - 2.0 * (index + 0.5) / count)};
+  return vectors;
+}
+std::vector<double>  samples   (const std::vector<double3>& vectors, const unsigned int coefficient_count, const double* coefficients)
+{
+  std::vector<double> values(vectors.size());
+  for (auto index = 0u; index < vectors.size(); index++)
+    values[index] = cush::evaluate_sum(cush::maximum_degree(coefficient_count), vectors[index].y, vectors[index].z, coefficients);
+  return values;
+}
+}
+
+TEST_CASE("Fitting plans recover the coefficients of their samples.", "[fitting]") {
+  const unsigned int vector_count = 64, coefficient_count = 25;
+  std::vector<double> coefficients(coefficient_count);
+  for (auto index = 0u; index < coefficient_count; index++)
+    coefficients[index] = std::sin(0.7 * index);
+
+  auto vectors        = directions(vector_count);
+  auto device_vectors = to_device (vectors);
+  auto device_samples = to_device (samples(vectors, coefficient_count, coefficients.data()));
+  auto device_output  = to_device (std::vector<double>(coefficient_count));
+
+  cush::fitting_plan<double> plan(vector_count, coefficient_count, device_vectors);
+  plan.fit(1u, device_samples, device_output);
+  cudaDeviceSynchronize();
+  auto output = to_host(device_output, coefficient_count);
+  for (auto index = 0u; index < coefficient_count; index++)
+    REQUIRE(output[index] == Approx(coefficients[index]).margin(1e-8));
+
+  cudaFree(device_output );
+  cudaFree(device_samples);
+  cudaFree(device_vectors);
+}
+
+TEST_CASE("Fitting reports normal matrices which are not positive definite.", "[fitting]") {
+  const unsigned int vector_count = 64, coefficient_count = 25;
+  std::vector<double> coefficients(coefficient_count, 1.0);
+
+  // The second voxel samples the pole only.
+  auto vectors = directions(vector_count), polar_vectors = directions(vector_count, true);
+  auto values  = samples   (vectors, coefficient_count, coefficients.data()), polar_values = samples(polar_vectors, coefficient_count, coefficients.data());
+  vectors.insert(vectors.end(), polar_vectors.begin(), polar_vectors.end());
+  values .insert(values .end(), polar_values .begin(), polar_values .end());
+
+  auto device_polar   = to_device(polar_vectors);
+  auto device_vectors = to_device(vectors);
+  auto device_samples = to_device(values);
+  auto device_output  = to_device(std::vector<double>(2 * coefficient_count));
+
+  REQUIRE_THROWS_AS((cush::fitting_plan<double>(vector_count, coefficient_count, device_polar)), std::runtime_error);
+  REQUIRE_NOTHROW  ((cush::fitting_plan<double>(vector_count, coefficient_count, device_polar, false, 1e-3)));
+
+  cublasHandle_t     cublas  ;
+  cusolverDnHandle_t cusolver;
+  cublasCreate    (&cublas  );
+  cusolverDnCreate(&cusolver);
+
+  REQUIRE_THROWS_AS(cush::fit_batched(cublas, cusolver, uint3 {2, 1, 1}, vector_count, coefficient_count, device_vectors, device_samples, device_output), std::runtime_error);
+
+  cush::workspace scratch(cush::fit_batched_workspace_size<double>(uint3 {2, 1, 1}, vector_count, coefficient_count) + cush::workspace_size<cush::solver_failures>(1));
+  auto failures = scratch.allocate<cush::solver_failures>(1);
+  cush::fit_batched(cublas, cusolver, uint3 {2, 1, 1}, vector_count, coefficient_count, device_vectors, device_samples, device_output, scratch, false, 0.0, failures);
+  cudaDeviceSynchronize();
+  auto result = to_host(failures, 1)[0];
+  REQUIRE(result.count       == 1);
+  REQUIRE(result.first_voxel == 1);
+  auto output = to_host(device_output, coefficient_count);
+  for (auto index = 0u; index < coefficient_count; index++)
+    REQUIRE(output[index] == Approx(coefficients[index]).margin(1e-8));
+
+  cusolverDnDestroy(cusolver);
+  cublasDestroy    (cublas  );
+  cudaFree(device_output );
+  cudaFree(device_samples);
+  cudaFree(device_vectors);
+  cudaFree(device_polar  );
+}
+
+#endif
@@ -0,0 +1,175 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#ifndef CUSH_CPU_ONLY
+#include <device_launch_parameters.h>
+#endif
+
+#include <cush/gaunt.h>
+#ifndef CUSH_CPU_ONLY
+#include <cush/launch.h>
+#include <cush/spherical_harmonics.h>
+#endif
+
+#ifndef CUSH_CPU_ONLY
+namespace
+{
+// Computes the entries of max_l on the device, from a single thread.
+__global__ void calculate_device_entries(const unsigned int max_l, unsigned int* entry_count, cush::gaunt_entry<double>* entries)
+{
+  if (blockIdx.x == 0 && threadIdx.x == 0)
+    *entry_count = cush::calculate_gaunt_entries(max_l, entries);
+}
+}
+#endif
+
+TEST_CASE("Gaunt coefficients are computed.", "[gaunt]") {
+  REQUIRE(cush::gaunt_coefficient<double>(0, 0, 0, 0, 0, 0) == Approx( 0.2820947918));
+  REQUIRE(cush::gaunt_coefficient<double>(1, 0, 1, 0, 2, 0) == Approx( 0.2523132522));
+  REQUIRE(cush::gaunt_coefficient<double>(1, 1, 1, 0, 2, 1) == Approx( 0.2185096861));
+  REQUIRE(cush::gaunt_coefficient<double>(1, 0, 1, 0, 1, 0) == Approx( 0           ));
+}
+
+TEST_CASE("Gaunt entries are computed.", "[gaunt]") {
+  REQUIRE(cush::calculate_gaunt_entries<double>(0) == 1);
+  REQUIRE(cush::calculate_gaunt_entries<double>(2) == 71);
+  REQUIRE(cush::calculate_gaunt_entries<double>(4) == 798);
+
+  std::vector<cush::gaunt_entry<double>> entries(cush::calculate_gaunt_entries<double>(2));
+  REQUIRE(cush::calculate_gaunt_entries(2, entries.data()) == entries.size());
+  for (size_t i = 1; i < entries.size(); i++)
+    REQUIRE(entries[i - 1].out_index <= entries[i].out_index);
+  REQUIRE(entries[0].lhs_index == 0);
+  REQUIRE(entries[0].rhs_index == 0);
+  REQUIRE(entries[0].out_index == 0);
+  REQUIRE(entries[0].value     == Approx(0.2820947918));
+
+  std::vector<cush::gaunt_entry<double>> high(cush::calculate_gaunt_entries<double>(6));
+  cush::calculate_gaunt_entries(6, high.data());
+  auto entry_index = 0u;
+  for (int l3 = 0; l3 <= 6; l3++)
+    for (int m3 = -l3; m3 <= l3; m3++)
+      cush::for_each_gaunt_coupling<double>(6, l3, m3, 
+      [&] (const unsigned int lhs_index, const unsigned int rhs_index, const double& value)
+      {
+        REQUIRE(entry_index < high.size());
+        REQUIRE(high[entry_index].lhs_index == lhs_index);
+        REQUIRE(high[entry_index].rhs_index == rhs_index);
+        REQUIRE(high[entry_index].out_index == unsigned(l3 * (l3 + 1) + m3));
+        REQUIRE(high[entry_index].value     == Approx(value).margin(1e-12));
+        entry_index++;
+      });
+  REQUIRE(entry_index == high.size());
+
+  std::vector<cush::gaunt_entry<double>> recursive(cush::calculate_gaunt_entries_recursive<double>(6));
+  REQUIRE(cush::calculate_gaunt_entries_recursive(6, recursive.data()) == high.size());
+  for (auto index = 0u; index < high.size(); index++)
+  {
+    REQUIRE(recursive[index].lhs_index == high[index].lhs_index);
+    REQUIRE(recursive[index].rhs_index == high[index].rhs_index);
+    REQUIRE(recursive[index].out_index == high[index].out_index);
+    REQUIRE(recursive[index].value     == Approx(high[index].value).margin(1e-12));
+  }
+}
+
+TEST_CASE("Gaunt entries drop the accidental zeros relative to the precision.", "[gaunt]") {
+  // The same couplings survive in float and double.
+  REQUIRE(cush::calculate_gaunt_entries          <float>(6 ) == cush::calculate_gaunt_entries          <double>(6 ));
+  REQUIRE(cush::calculate_gaunt_entries_recursive<float>(12) == cush::calculate_gaunt_entries_recursive<double>(12));
+
+  // The couplings of high degrees below an absolute 1e-6 are kept in double.
+  std::vector<cush::gaunt_entry<double>> entries(cush::calculate_gaunt_entries_recursive<double>(24));
+  cush::calculate_gaunt_entries_recursive(24, entries.data());
+  REQUIRE(std::any_of(entries.begin(), entries.end(), [ ] (const cush::gaunt_entry<double>& entry)
+  {
+    return std::abs(entry.value) < 1e-6;
+  }));
+}
+
+TEST_CASE("Gaunt offsets are computed.", "[gaunt]") {
+  std::vector<cush::gaunt_entry<double>> entries(cush::calculate_gaunt_entries<double>(2));
+  cush::calculate_gaunt_entries(2, entries.data());
+
+  std::vector<unsigned int> offsets(10);
+  cush::calculate_gaunt_offsets(9, entries.size(), entries.data(), offsets.data());
+  REQUIRE(offsets[0] == 0);
+  REQUIRE(offsets[9] == entries.size());
+  for (auto out_index = 0u; out_index < 9; out_index++)
+    for (auto entry_index = offsets[out_index]; entry_index < offsets[out_index + 1]; entry_index++)
+      REQUIRE(entries[entry_index].out_index == out_index);
+}
+
+TEST_CASE("Host Gaunt tables hold the entries and offsets, and are cached per degree.", "[gaunt]") {
+  std::vector<cush::gaunt_entry<double>> entries(cush::calculate_gaunt_entries_recursive<double>(3));
+  cush::calculate_gaunt_entries_recursive(3, entries.data());
+  std::vector<unsigned int>              offsets(17);
+  cush::calculate_gaunt_offsets(16, unsigned(entries.size()), entries.data(), offsets.data());
+
+  const cush::host_gaunt_table<double> table(3);
+  REQUIRE(table.coefficient_count() == 16);
+  REQUIRE(table.entry_count()       == entries.size());
+  REQUIRE(std::equal(offsets.begin(), offsets.end(), table.offsets()));
+  for (auto index = 0u; index < entries.size(); index++)
+    REQUIRE(table.entries()[index].value == entries[index].value);
+
+  REQUIRE(&cush::cached_host_gaunt_table<double>(3) == &cush::cached_host_gaunt_table<double>(3));
+  REQUIRE( cush::cached_host_gaunt_table<double>(4).max_l() == 4);
+}
+
+#ifndef CUSH_CPU_ONLY
+TEST_CASE("Gaunt entries are computed on the device.", "[gaunt]") {
+  std::vector<cush::gaunt_entry<double>> expected(cush::calculate_gaunt_entries_recursive<double>(4));
+  cush::calculate_gaunt_entries_recursive(4, expected.data());
+
+  unsigned int*              device_count  ;
+  cush::gaunt_entry<double>* device_entries;
+  cudaMalloc(reinterpret_cast<void**>(&device_count  ), sizeof(unsigned int));
+  cudaMalloc(reinterpret_cast<void**>(&device_entries), expected.size() * sizeof(cush::gaunt_entry<double>));
+  cush::launch_1d(calculate_device_entries, cush::block_grid(1), 0, nullptr, 4u, device_count, device_entries);
+
+  unsigned int                           entry_count;
+  std::vector<cush::gaunt_entry<double>> entries(expected.size());
+  cudaMemcpy(&entry_count  , device_count  , sizeof(unsigned int)                                , cudaMemcpyDeviceToHost);
+  cudaMemcpy(entries.data(), device_entries, entries.size() * sizeof(cush::gaunt_entry<double>), cudaMemcpyDeviceToHost);
+  REQUIRE(entry_count == expected.size());
+  for (auto index = 0u; index < entries.size(); index++)
+  {
+    REQUIRE(entries[index].out_index == expected[index].out_index);
+    REQUIRE(entries[index].value     == Approx(expected[index].value).margin(1e-12));
+  }
+
+  cudaFree(device_entries);
+  cudaFree(device_count  );
+}
+
+TEST_CASE("Products read the cached Gaunt tables, and agree with the couplings on the fly.", "[gaunt]") {
+  const uint3        dimensions {3, 2, 2};
+  const unsigned int voxel_count = 12, coefficient_count = 36;
+  std::vector<double> lhs(voxel_count * coefficient_count), rhs(lhs.size());
+  for (auto index = 0u; index < lhs.size(); index++)
+  {
+    lhs[index] = std::sin(0.3 * index);
+    rhs[index] = std::cos(0.2 * index);
+  }
+
+  double* device_values;
+  cudaMalloc(reinterpret_cast<void**>(&device_values), 4 * lhs.size() * sizeof(double));
+  cudaMemcpy(device_values              , lhs.data(), lhs.size() * sizeof(double), cudaMemcpyHostToDevice);
+  cudaMemcpy(device_values + lhs.size(), rhs.data(), rhs.size() * sizeof(double), cudaMemcpyHostToDevice);
+  cush::launch_product          (dimensions, coefficient_count, device_values, device_values + lhs.size(), device_values + 2 * lhs.size());
+  cush::launch_product_on_the_fly(dimensions, coefficient_count, device_values, device_values + lhs.size(), device_values + 3 * lhs.size());
+
+  std::vector<double> table(lhs.size()), on_the_fly(lhs.size());
+  cudaMemcpy(table     .data(), device_values + 2 * lhs.size(), lhs.size() * sizeof(double), cudaMemcpyDeviceToHost);
+  cudaMemcpy(on_the_fly.data(), device_values + 3 * lhs.size(), lhs.size() * sizeof(double), cudaMemcpyDeviceToHost);
+  for (auto index = 0u; index < lhs.size(); index++)
+    REQUIRE(table[index] == Approx(on_the_fly[index]).margin(1e-12));
+
+  REQUIRE(&cush::cached_gaunt_table<double>(5) == &cush::cached_gaunt_table<double>(5));
+  REQUIRE( cush::cached_gaunt_table<double>(5).entry_count() == cush::calculate_gaunt_entries_recursive<double>(5));
+
+  cudaFree(device_values);
+}
+#endif
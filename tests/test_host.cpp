@@ -0,0 +1,93 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include <cush/host.h>
+
+TEST_CASE("Batched harmonics match the per direction evaluation.", "[host]") {
+  float thetas[16], phis[16];
+  for (auto lane = 0; lane < 16; lane++)
+  {
+    thetas[lane] = 0.4F * lane;
+    phis  [lane] = 0.2F * lane;
+  }
+
+  cush::host::for_each_harmonic_batch(8, thetas, phis, [&] (const unsigned int index, const float* values)
+  {
+    for (auto lane = 0; lane < 16; lane++)
+      REQUIRE(values[lane] == Approx(cush::evaluate(index, thetas[lane], phis[lane])).margin(1e-5));
+  });
+
+  double coefficients[81];
+  for (auto index = 0; index < 81; index++)
+    coefficients[index] = std::sin(0.7 * index);
+  std::vector<double> directions_theta(37), directions_phi(37), values(37);
+  for (auto index = 0; index < 37; index++)
+  {
+    directions_theta[index] = 0.17 * index;
+    directions_phi  [index] = 0.08 * index;
+  }
+  cush::host::evaluate_sums(8, 37, directions_theta.data(), directions_phi.data(), coefficients, values.data());
+  for (auto index = 0; index < 37; index++)
+    REQUIRE(values[index] == Approx(cush::evaluate_sum(8, directions_theta[index], directions_phi[index], coefficients)));
+}
+
+TEST_CASE("Host volume operations match the per voxel functions.", "[host]") {
+  const uint3    dimensions {3, 2, 1};
+  const unsigned voxel_count = 6, coefficient_count = 25;
+  std::vector<float> lhs(voxel_count * coefficient_count), rhs(lhs.size()), product(lhs.size());
+  for (auto index = 0u; index < lhs.size(); index++)
+  {
+    lhs[index] = std::sin(0.3F * index);
+    rhs[index] = std::cos(0.2F * index);
+  }
+
+  cush::host::product(dimensions, coefficient_count, lhs.data(), rhs.data(), product.data());
+  for (auto voxel = 0u; voxel < voxel_count; voxel++)
+    for (auto index = 0u; index < coefficient_count; index++)
+      REQUIRE(product[voxel * coefficient_count + index] == Approx(cush::product_coefficient(coefficient_count, index,
+        lhs.data() + voxel * coefficient_count, rhs.data() + voxel * coefficient_count)).margin(1e-6));
+
+  const uint2 tessellations {8, 5};
+  std::vector<float3>   points (voxel_count * 40);
+  std::vector<unsigned> indices(voxel_count * 40 * 6), expected_indices(6 * 40);
+  cush::host::sample_sums(dimensions, coefficient_count, tessellations, lhs.data(), points.data(), indices.data(), 0, false);
+  for (auto point = 0u; point < 40; point++)
+  {
+    REQUIRE(points[40 + point].y == Approx(2 * cush::pi<float>() * (point / 5) / 8));
+    REQUIRE(points[40 + point].z == Approx(    cush::pi<float>() * (point % 5) / 4));
+    REQUIRE(points[40 + point].x == Approx(cush::evaluate_sum(4, points[40 + point].y, points[40 + point].z, lhs.data() + coefficient_count)).margin(1e-5));
+    cush::sample_indices(tessellations, point / 5, point % 5, expected_indices.data(), 40);
+  }
+  REQUIRE(std::equal(expected_indices.begin(), expected_indices.end(), indices.begin() + 6 * 40));
+
+  std::vector<float> distances(voxel_count * voxel_count);
+  cush::host::pairwise_distances(voxel_count, voxel_count, coefficient_count, lhs.data(), rhs.data(), distances.data());
+  for (auto query = 0u; query < voxel_count; query++)
+    for (auto vector = 0u; vector < voxel_count; vector++)
+      REQUIRE(distances[vector + voxel_count * query] == Approx(cush::l2_distance(coefficient_count,
+        lhs.data() + query * coefficient_count, rhs.data() + vector * coefficient_count)));
+}
+
+TEST_CASE("Host fits recover the coefficients of the samples.", "[host]") {
+  const unsigned vector_count = 60, coefficient_count = 25;
+  std::vector<double3> vectors(2 * vector_count);
+  for (auto index = 0u; index < vectors.size(); index++)
+    vectors[index] = {0.0, 0.37 * index, std::acos(1.0 - 2.0 * (index % vector_count + 0.5) / vector_count)};
+
+  double expected[2 * coefficient_count];
+  for (auto index = 0u; index < 2 * coefficient_count; index++)
+    expected[index] = std::sin(0.9 * index);
+  std::vector<double> samples(2 * vector_count);
+  for (auto index = 0u; index < samples.size(); index++)
+    samples[index] = cush::evaluate_sum(4, vectors[index].y, vectors[index].z, expected + index / vector_count * coefficient_count);
+
+  std::vector<double> batched(2 * coefficient_count), shared(2 * coefficient_count);
+  cush::host::fit_batched(uint3 {2, 1, 1}, vector_count, coefficient_count, vectors.data(), samples.data(), batched.data());
+  cush::host::fit        (vector_count, coefficient_count, vectors.data(), 1, samples.data(), shared.data());
+  for (auto index = 0u; index < 2 * coefficient_count; index++)
+    REQUIRE(batched[index] == Approx(expected[index]).margin(1e-8));
+  for (auto index = 0u; index < coefficient_count; index++)
+    REQUIRE(shared [index] == Approx(expected[index]).margin(1e-8));
+}
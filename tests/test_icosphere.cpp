@@ -0,0 +1,43 @@
+#include "catch.hpp"
+
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <cush/icosphere.h>
+
+TEST_CASE("Icospheres are computed.", "[icosphere]") {
+  for (auto frequency = 1U; frequency <= 4; frequency++)
+  {
+    std::vector<double3>      directions;
+    std::vector<unsigned int> indices, neighbors, antipodes;
+    cush::calculate_icosphere(frequency, directions, indices, neighbors, antipodes);
+
+    REQUIRE(directions.size() == 10 * frequency * frequency + 2);
+    REQUIRE(indices   .size() == 60 * frequency * frequency);
+    REQUIRE(neighbors .size() == cush::icosphere_neighbor_count * directions.size());
+    REQUIRE(antipodes .size() == directions.size());
+
+    // Euler characteristic of the sphere.
+    std::set<std::pair<unsigned int, unsigned int>> edges;
+    for (auto i = 0U; i < indices.size(); i += 3)
+      for (auto k = 0U; k < 3; k++)
+        edges.insert(std::minmax(indices[i + k], indices[i + (k + 1) % 3]));
+    REQUIRE(directions.size() - edges.size() + indices.size() / 3 == 2);
+
+    auto pentagons = 0U;
+    for (auto i = 0U; i < directions.size(); i++)
+    {
+      if (neighbors[i * cush::icosphere_neighbor_count + 5] == cush::icosphere_no_neighbor)
+        pentagons++;
+
+      auto& point    = directions[i];
+      auto& antipode = directions[antipodes[i]];
+      REQUIRE(antipodes[antipodes[i]] == i);
+      REQUIRE(sin(antipode.z) * cos(antipode.y) == Approx(-sin(point.z) * cos(point.y)).margin(1e-12));
+      REQUIRE(sin(antipode.z) * sin(antipode.y) == Approx(-sin(point.z) * sin(point.y)).margin(1e-12));
+      REQUIRE(cos(antipode.z)                   == Approx(-cos(point.z)                ).margin(1e-12));
+    }
+    REQUIRE(pentagons == 12);
+  }
+}
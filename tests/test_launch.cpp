@@ -0,0 +1,118 @@
+#include "catch.hpp"
+
+#include <cush/launch.h>
+
+namespace
+{
+#ifndef CUSH_CPU_ONLY
+void kernel_stub(unsigned)
+{
+}
+
+// Counts its launches, the second argument is unused.
+__global__ void count_launches(unsigned* launches, const unsigned* unused)
+{
+  if (blockIdx.x == 0 && threadIdx.x == 0)
+    atomicAdd(launches, 1u);
+}
+#endif
+}
+
+TEST_CASE("Grid sizes cover the target dimensions for any block size.", "[launch]") {
+  REQUIRE(cush::grid_size_1d(1000) == cush::grid_size_1d(1000, cush::block_size_1d()));
+  REQUIRE(cush::grid_size_1d(1000, 256) == 4);
+  REQUIRE(cush::grid_size_1d(1024, 256) == 4);
+  REQUIRE(cush::grid_size_1d(1025, 256) == 5);
+
+  auto grid = cush::grid_size_2d(dim3(100, 90), cush::block_shape_2d(256));
+  REQUIRE(grid.x == 4 );
+  REQUIRE(grid.y == 12);
+  REQUIRE(grid.z == 1 );
+
+  REQUIRE(cush::thread_grid(1025)(256) == 5   );
+  REQUIRE(cush::block_grid (1025)(256) == 1025);
+}
+
+TEST_CASE("Two dimensional block shapes consist of full warps.", "[launch]") {
+  for (auto block_size : cush::autotune_block_sizes)
+  {
+    auto shape = cush::block_shape_2d(block_size);
+    REQUIRE(shape.x           == 32);
+    REQUIRE(shape.x * shape.y == block_size);
+    REQUIRE(shape.z           == 1 );
+  }
+  REQUIRE(cush::block_shape_2d(16).y == 1);
+}
+
+TEST_CASE("Autotuning results are cached per power of two of the problem size.", "[launch]") {
+  REQUIRE(cush::autotune_size_class(0)    == 0 );
+  REQUIRE(cush::autotune_size_class(1)    == 0 );
+  REQUIRE(cush::autotune_size_class(2)    == 1 );
+  REQUIRE(cush::autotune_size_class(1023) == 9 );
+  REQUIRE(cush::autotune_size_class(1024) == 10);
+  REQUIRE(cush::autotune_size_class(size_t(1) << 40) == 40);
+}
+
+TEST_CASE("Aliasing pointer arguments are detected.", "[launch]") {
+  float  storage[2];
+  double other_storage;
+  auto   values = storage;
+  auto   other  = &other_storage;
+  REQUIRE(!cush::arguments_alias());
+  REQUIRE(!cush::arguments_alias(1u, values, values + 1, 2.0F));
+  REQUIRE(!cush::arguments_alias(values, static_cast<float*>(nullptr), static_cast<float*>(nullptr), other));
+  REQUIRE( cush::arguments_alias(values, 3u, static_cast<const float*>(values)));
+  REQUIRE( cush::arguments_alias(other, other));
+}
+
+#ifndef CUSH_CPU_ONLY
+TEST_CASE("The fixed launch policy selects the fallback block sizes.", "[launch]") {
+  auto policy = cush::current_launch_policy();
+  cush::set_launch_policy(cush::launch_policy::fixed);
+
+  auto launches = 0;
+  auto run      = [&] (unsigned) { launches++; };
+  REQUIRE(cush::select_block_size(&kernel_stub, 0, 1000, nullptr, run)              == cush::block_size_1d());
+  REQUIRE(cush::select_block_size(&kernel_stub, 0, 1000, nullptr, run, true, 1024u) == 1024u);
+  REQUIRE(launches == 0);
+
+  cush::set_launch_policy(policy);
+}
+
+TEST_CASE("The autotune launch policy relaunches repeatable launches only, once per problem size.", "[launch]") {
+  auto policy = cush::current_launch_policy();
+  cush::set_launch_policy(cush::launch_policy::autotune);
+
+  unsigned* launches;
+  unsigned* unused  ;
+  cudaMalloc(reinterpret_cast<void**>(&launches), sizeof(unsigned));
+  cudaMalloc(reinterpret_cast<void**>(&unused  ), sizeof(unsigned));
+  const auto count  = [&] ()
+  {
+    unsigned value = 0;
+    cudaMemcpy(&value, launches, sizeof(unsigned), cudaMemcpyDeviceToHost);
+    cudaMemset(launches, 0, sizeof(unsigned));
+    return value;
+  };
+  count();
+
+  // The aliasing and in-place launches are launched once, by the occupancy policy.
+  cush::launch_1d         (count_launches, cush::block_grid(1), 0, nullptr, launches, static_cast<const unsigned*>(launches));
+  REQUIRE(count() == 1);
+  cush::launch_1d_in_place(count_launches, cush::block_grid(3), 0, nullptr, launches, unused);
+  REQUIRE(count() == 1);
+
+  // The first repeatable launch of a problem size is timed a few times per candidate, the next ones are cached.
+  cush::launch_1d         (count_launches, cush::block_grid(5), 0, nullptr, launches, unused);
+  REQUIRE(count() >  1);
+  cush::launch_1d         (count_launches, cush::block_grid(6), 0, nullptr, launches, unused);
+  REQUIRE(count() == 1);
+  cush::launch_1d         (count_launches, cush::block_grid(9), 0, nullptr, launches, unused);
+  REQUIRE(count() >  1);
+  REQUIRE(cudaPeekAtLastError() == cudaSuccess);
+
+  cudaFree(unused  );
+  cudaFree(launches);
+  cush::set_launch_policy(policy);
+}
+#endif
@@ -0,0 +1,65 @@
+#include "catch.hpp"
+
+#include <type_traits>
+#include <vector>
+
+#include <cush/layout.h>
+#include <cush/spherical_harmonics.h>
+
+TEST_CASE("Layout offsets are a bijection onto the layout size.", "[layout]") {
+  using layout = cush::coefficient_layout;
+  REQUIRE(cush::layout_size<layout::aos  >(33, 9) == 33 * 9);
+  REQUIRE(cush::layout_size<layout::soa  >(33, 9) == 33 * 9);
+  REQUIRE(cush::layout_size<layout::aosoa>(33, 9) == 64 * 9);
+  REQUIRE(cush::layout_size<layout::aosoa>(32, 9) == 32 * 9);
+
+  REQUIRE(cush::layout_offset<layout::aos  >(40, 9, 3, 2) == 3 * 9  + 2);
+  REQUIRE(cush::layout_offset<layout::soa  >(40, 9, 3, 2) == 2 * 40 + 3);
+  REQUIRE(cush::layout_offset<layout::aosoa>(40, 9, 3, 2) == 2 * 32 + 3);
+  REQUIRE(cush::layout_offset<layout::aosoa>(40, 9, 35, 2) == 32 * 9 + 2 * 32 + 3);
+
+  const unsigned voxel_count = 40, coefficient_count = 9;
+  std::vector<int> soa_hits  (cush::layout_size<layout::soa  >(voxel_count, coefficient_count), 0);
+  std::vector<int> aosoa_hits(cush::layout_size<layout::aosoa>(voxel_count, coefficient_count), 0);
+  for (auto voxel_index = 0u; voxel_index < voxel_count; voxel_index++)
+    for (auto coefficient_index = 0u; coefficient_index < coefficient_count; coefficient_index++)
+    {
+      auto soa_offset   = cush::layout_offset<layout::soa  >(voxel_count, coefficient_count, voxel_index, coefficient_index);
+      auto aosoa_offset = cush::layout_offset<layout::aosoa>(voxel_count, coefficient_count, voxel_index, coefficient_index);
+      soa_hits  [soa_offset  ]++;
+      aosoa_hits[aosoa_offset]++;
+
+      auto soa_position   = cush::layout_position<layout::soa  >(voxel_count, coefficient_count, soa_offset  );
+      auto aosoa_position = cush::layout_position<layout::aosoa>(voxel_count, coefficient_count, aosoa_offset);
+      REQUIRE((soa_position  .x == voxel_index && soa_position  .y == coefficient_index));
+      REQUIRE((aosoa_position.x == voxel_index && aosoa_position.y == coefficient_index));
+    }
+
+  for (auto hits : soa_hits)
+    REQUIRE(hits == 1);
+  // The padding of the last aosoa tile is the only gap.
+  for (auto offset = 0u; offset < aosoa_hits.size(); offset++)
+    REQUIRE(aosoa_hits[offset] == (cush::layout_position<layout::aosoa>(voxel_count, coefficient_count, offset).x < voxel_count ? 1 : 0));
+}
+
+TEST_CASE("Voxel coefficients in any layout evaluate as contiguous coefficients.", "[layout]") {
+  using layout = cush::coefficient_layout;
+  const unsigned voxel_count = 3, coefficient_count = 25;
+  std::vector<float> aos(voxel_count * coefficient_count), soa(aos.size());
+  for (auto voxel_index = 0u; voxel_index < voxel_count; voxel_index++)
+    for (auto coefficient_index = 0u; coefficient_index < coefficient_count; coefficient_index++)
+    {
+      auto value = 0.1F * coefficient_index - 0.3F * voxel_index;
+      aos[cush::layout_offset<layout::aos>(voxel_count, coefficient_count, voxel_index, coefficient_index)] = value;
+      soa[cush::layout_offset<layout::soa>(voxel_count, coefficient_count, voxel_index, coefficient_index)] = value;
+    }
+
+  auto contiguous = cush::voxel_coefficients<layout::aos>(aos.data(), voxel_count, coefficient_count, 1);
+  REQUIRE((std::is_same<decltype(contiguous), float*>::value));
+  REQUIRE(contiguous == aos.data() + coefficient_count);
+  auto strided    = cush::voxel_coefficients<layout::soa>(soa.data(), voxel_count, coefficient_count, 1);
+  REQUIRE(strided.stride == voxel_count);
+  REQUIRE(cush::evaluate_sum   (4, 0.3F, 0.7F, strided)     == cush::evaluate_sum   (4, 0.3F, 0.7F, contiguous));
+  REQUIRE(cush::evaluate_sum<4>(   0.3F, 0.7F, strided)     == cush::evaluate_sum<4>(   0.3F, 0.7F, contiguous));
+  REQUIRE(cush::product_coefficient(coefficient_count, 6, strided, strided) == cush::product_coefficient(coefficient_count, 6, contiguous, contiguous));
+}
@@ -1,5 +1,8 @@
 #include "catch.hpp"
 
+#include <cmath>
+
+#include <cush/factorial.h>
 #include <cush/legendre.h>
 
 TEST_CASE("Associated Legendre polynomials are computed.", "[legendre]") {
@@ -9,3 +12,43 @@ TEST_CASE("Associated Legendre polynomials are computed.", "[legendre]") {
   REQUIRE(cush::associated_legendre(6 , 4, 0.5) == Approx(465.1171875   ));
   REQUIRE(cush::associated_legendre(10, 6, 0.5) == Approx(-82397.3785400));
 }
+TEST_CASE("Normalized associated Legendre polynomials match the normalized polynomials.", "[legendre]") {
+  for (auto l = 0; l <= 10; l++)
+    for (auto m = 0; m <= l; m++)
+      for (auto x : {-0.9, -0.3, 0.0, 0.5, 0.99})
+      {
+        auto kml = std::sqrt((2 * l + 1) * cush::factorial<double>(l - m) / (4 * cush::pi<double>() * cush::factorial<double>(l + m)));
+        REQUIRE(cush::normalized_associated_legendre(l, m, x) == Approx(kml * cush::associated_legendre(l, m, x)).margin(1e-12));
+      }
+}
+TEST_CASE("Normalized associated Legendre polynomials are accurate at high degrees.", "[legendre]") {
+  // Unsold's theorem, i.e. the sum of the squared real harmonics of degree l is (2l + 1) / 4 pi.
+  for (auto l : {64, 150, 500})
+    for (auto x : {-0.7, 0.1, 0.95})
+    {
+      double sum = 0.0;
+      for (auto m = 0; m <= l; m++)
+        sum += (m == 0 ? 1 : 2) * std::pow(cush::normalized_associated_legendre(l, m, x), 2);
+      REQUIRE(sum == Approx((2 * l + 1) / (4 * cush::pi<double>())).epsilon(1e-12));
+    }
+  for (auto x : {-0.7F, 0.1F, 0.95F})
+  {
+    float sum = 0.0F;
+    for (auto m = 0; m <= 64; m++)
+      sum += (m == 0 ? 1 : 2) * std::pow(cush::normalized_associated_legendre(64, m, x), 2);
+    REQUIRE(sum == Approx(129 / (4 * cush::pi<double>())).epsilon(1e-4));
+  }
+
+  // The sectoral closed form (-1)^l sqrt((2l + 1) (2l)! / (4 pi 4^l l!^2)) (1 - x^2)^(l / 2), in logarithms.
+  for (auto l : {64, 100})
+  {
+    auto x        = 0.6;
+    auto expected = (l % 2 ? -1 : 1) * std::exp(0.5 * (std::log((2 * l + 1) / (4 * cush::pi<double>())) + cush::ln_factorial<double>(2 * l) - 2 * cush::ln_factorial<double>(l) - l * std::log(4.0)) + 0.5 * l * std::log(1 - x * x));
+    REQUIRE(cush::normalized_associated_legendre(l, l, x) == Approx(expected).epsilon(1e-12));
+    REQUIRE(cush::normalized_associated_legendre(l, l, float(x)) == Approx(expected).epsilon(1e-4));
+  }
+
+  // The zonal functions, whose unnormalized recurrence does not overflow.
+  for (auto x : {-0.7, 0.1, 0.95})
+    REQUIRE(cush::normalized_associated_legendre(100, 0, x) == Approx(std::sqrt(201 / (4 * cush::pi<double>())) * cush::associated_legendre(100, 0, x)).epsilon(1e-10));
+}
@@ -0,0 +1,30 @@
+#include "catch.hpp"
+
+#include <type_traits>
+
+#include <cush/math.h>
+
+TEST_CASE("Float arguments are not promoted to double.", "[math]") {
+  REQUIRE((std::is_same<decltype(cush::math::sqrt      (1.0F      )), float >::value));
+  REQUIRE((std::is_same<decltype(cush::math::rsqrt     (1.0F      )), float >::value));
+  REQUIRE((std::is_same<decltype(cush::math::sqrt_ratio(1.0F, 2.0F)), float >::value));
+  REQUIRE((std::is_same<decltype(cush::math::exp       (1.0F      )), float >::value));
+  REQUIRE((std::is_same<decltype(cush::math::pow       (1.0F, 2.0F)), float >::value));
+  REQUIRE((std::is_same<decltype(cush::math::atan2     (1.0F, 2.0F)), float >::value));
+  REQUIRE((std::is_same<decltype(cush::math::sqrt      (1.0       )), double>::value));
+}
+
+TEST_CASE("Elementary functions match the double precision functions.", "[math]") {
+  for (auto x = 0.05F; x < 4.0F; x += 0.05F)
+  {
+    float sine, cosine;
+    cush::math::sincos(x, &sine, &cosine);
+    REQUIRE(sine                            == Approx(sin (double(x))).margin(1e-6));
+    REQUIRE(cosine                          == Approx(cos (double(x))).margin(1e-6));
+    REQUIRE(cush::math::rsqrt     (x)       == Approx(1.0 / sqrt(double(x))));
+    REQUIRE(cush::math::sqrt_ratio(x, 3.0F) == Approx(sqrt(double(x) / 3.0)));
+    REQUIRE(cush::math::exp       (x)       == Approx(exp (double(x))));
+    REQUIRE(cush::math::log       (x)       == Approx(log (double(x))).margin(1e-6));
+    REQUIRE(cush::math::pow       (x, 1.5F) == Approx(pow (double(x), 1.5)));
+  }
+}
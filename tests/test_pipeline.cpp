@@ -0,0 +1,94 @@
+#include "catch.hpp"
+
+#ifndef CUSH_CPU_ONLY
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <cush/fitting.h>
+#include <cush/pipeline.h>
+
+namespace
+{
+template<typename type>
+type*             to_device(const std::vector<type>& values)
+{
+  type* pointer;
+  cudaMalloc(reinterpret_cast<void**>(&pointer), values.size() * sizeof(type));
+  cudaMemcpy(pointer, values.data(), values.size() * sizeof(type), cudaMemcpyHostToDevice);
+  return pointer;
+}
+template<typename type>
+std::vector<type> to_host  (const type* pointer, const size_t size)
+{
+  std::vector<type> values(size);
+  cudaMemcpy(values.data(), pointer, size * sizeof(type), cudaMemcpyDeviceToHost);
+  return values;
+}
+}
+
+TEST_CASE("Slab executors process every slab of a volume on a single device.", "[pipeline]") {
+  const uint3        dimensions = {7, 5, 11};
+  const unsigned int vector_count = 30, coefficient_count = 25, voxel_count = dimensions.x * dimensions.y * dimensions.z;
+
+  // Well spread (unused, theta, phi) directions on a spiral.
+  std::vector<double3> vectors(vector_count);
+  for (auto index = 0u; index < vector_count; index++)
+    vectors[index] = double3 {1.0, 2.399963 * index, std::acos(1.0 - 2.0 * (index + 0.5) / vector_count)};
+  std::vector<double> samples(voxel_count * vector_count);
+  for (auto index = 0u; index < samples.size(); index++)
+    samples[index] = std::sin(0.37 * index);
+
+  // The reference fits the whole volume at once.
+  auto device_vectors   = to_device(vectors);
+  auto device_samples   = to_device(samples);
+  auto device_reference = to_device(std::vector<double>(voxel_count * coefficient_count));
+  cush::fitting_plan<double> plan(vector_count, coefficient_count, device_vectors);
+  plan.fit(voxel_count, device_samples, device_reference);
+  cudaDeviceSynchronize();
+  auto reference = to_host(device_reference, voxel_count * coefficient_count);
+
+  cush::slab_executor<double, double> executor(dimensions, vector_count, coefficient_count, 3, {cush::visible_devices().front()});
+  REQUIRE(executor.slab_count() == 4);
+  REQUIRE(executor.lane_count() == 2);
+
+  std::vector<unsigned int> slabs;
+  const auto fit = [&] (const cush::slab<double, double>& slab)
+  {
+    plan.fit(slab.voxel_count(), slab.input, slab.output, slab.stream);
+    slabs.push_back(slab.index);
+  };
+
+  SECTION("The output matches the fit of the whole volume.") {
+    std::vector<double> output(voxel_count * coefficient_count, -1.0);
+    executor.run(samples.data(), output.data(), fit);
+    REQUIRE(slabs == (std::vector<unsigned int> {0, 1, 2, 3}));
+    for (auto index = 0u; index < output.size(); index++)
+      REQUIRE(output[index] == Approx(reference[index]).margin(1e-10));
+  }
+  SECTION("A throwing stage is rethrown after the lanes are idle, and the executor remains usable.") {
+    std::vector<double> output(voxel_count * coefficient_count, -1.0);
+    REQUIRE_THROWS_AS(executor.run(samples.data(), output.data(), [&] (const cush::slab<double, double>& slab)
+    {
+      if (slab.index == 2)
+        throw std::runtime_error("stage");
+      fit(slab);
+    }), std::runtime_error);
+    REQUIRE(slabs == (std::vector<unsigned int> {0, 1}));
+
+    executor.run(samples.data(), output.data(), fit);
+    for (auto index = 0u; index < output.size(); index++)
+      REQUIRE(output[index] == Approx(reference[index]).margin(1e-10));
+  }
+
+  cudaFree(device_reference);
+  cudaFree(device_samples  );
+  cudaFree(device_vectors  );
+}
+
+TEST_CASE("Slab executors reject empty device lists.", "[pipeline]") {
+  REQUIRE_THROWS_AS((cush::slab_executor<float, float>(uint3 {4, 4, 4}, 1, 1, 2, std::vector<int>())), std::runtime_error);
+}
+
+#endif
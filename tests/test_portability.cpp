@@ -0,0 +1,32 @@
+#include "catch.hpp"
+
+#include <cush/portability.h>
+
+TEST_CASE("Vector types have the CUDA sizes and alignments.", "[portability]") {
+  REQUIRE(sizeof(int2)    ==  8); REQUIRE(alignof(int2)    ==  8);
+  REQUIRE(sizeof(int3)    == 12); REQUIRE(alignof(int3)    ==  4);
+  REQUIRE(sizeof(int4)    == 16); REQUIRE(alignof(int4)    == 16);
+  REQUIRE(sizeof(uint2)   ==  8); REQUIRE(alignof(uint2)   ==  8);
+  REQUIRE(sizeof(uint3)   == 12); REQUIRE(alignof(uint3)   ==  4);
+  REQUIRE(sizeof(uint4)   == 16); REQUIRE(alignof(uint4)   == 16);
+  REQUIRE(sizeof(float2)  ==  8); REQUIRE(alignof(float2)  ==  8);
+  REQUIRE(sizeof(float3)  == 12); REQUIRE(alignof(float3)  ==  4);
+  REQUIRE(sizeof(float4)  == 16); REQUIRE(alignof(float4)  == 16);
+  REQUIRE(sizeof(double2) == 16); REQUIRE(alignof(double2) == 16);
+  REQUIRE(sizeof(double3) == 24); REQUIRE(alignof(double3) ==  8);
+  REQUIRE(sizeof(dim3)    == 12);
+}
+
+TEST_CASE("Vector types are aggregates and dim3 defaults to 1.", "[portability]") {
+  float4 vector {1.0F, 2.0F, 3.0F, 4.0F};
+  REQUIRE(vector.x == 1.0F);
+  REQUIRE(vector.w == 4.0F);
+
+  uint2 pair {3, 5};
+  REQUIRE(pair.y == 5);
+
+  dim3 grid(8);
+  REQUIRE(grid.x == 8);
+  REQUIRE(grid.y == 1);
+  REQUIRE(grid.z == 1);
+}
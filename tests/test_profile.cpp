@@ -0,0 +1,101 @@
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+#include <cush/profile.h>
+#if defined(CUSH_PROFILE) && !defined(CUSH_CPU_ONLY)
+#include <cush/spherical_harmonics.h>
+#endif
+
+TEST_CASE("Profile reports aggregate the launches per launcher.", "[profile]") {
+  cush::profile_report report;
+  report.add("product"    , 2.0, 1000, 4000000, 10);
+  report.add("sample_sums", 1.0,  500, 1000000);
+  report.add("product"    , 2.0, 1000, 4000000, 20);
+
+  auto entries = report.entries();
+  REQUIRE(entries.size() == 2);
+  REQUIRE(entries[0].name         == "product");
+  REQUIRE(entries[0].launches     == 2);
+  REQUIRE(entries[0].milliseconds == Approx(4.0));
+  REQUIRE(entries[0].voxels       == 2000);
+  REQUIRE(entries[0].bytes        == 8000000);
+  REQUIRE(entries[0].zero_voxels  == 30);
+  REQUIRE(entries[0].gigabytes_per_second() == Approx(2.0));
+  REQUIRE(entries[1].name         == "sample_sums");
+  REQUIRE(entries[1].zero_voxels  == 0);
+
+  report.reset();
+  REQUIRE(report.entries().empty());
+  REQUIRE(cush::profile_entry().gigabytes_per_second() == 0.0);
+}
+
+TEST_CASE("Profile reports are exported in the Prometheus text format.", "[profile]") {
+  cush::profile_report report;
+  report.add("product", 500.0, 1000, 2000000000, 10);
+
+  auto text = report.prometheus();
+  REQUIRE(text.find("# TYPE cush_seconds_total counter\n")                   != std::string::npos);
+  REQUIRE(text.find("cush_seconds_total{launcher=\"product\"} 0.5\n")         != std::string::npos);
+  REQUIRE(text.find("cush_voxels_total{launcher=\"product\"} 1000\n")         != std::string::npos);
+  REQUIRE(text.find("cush_zero_voxels_total{launcher=\"product\"} 10\n")      != std::string::npos);
+  REQUIRE(text.find("cush_gigabytes_per_second{launcher=\"product\"} 4\n")    != std::string::npos);
+  REQUIRE(report.prometheus("pipeline").find("pipeline_launches_total{launcher=\"product\"} 1\n") != std::string::npos);
+}
+
+#if defined(CUSH_PROFILE) && !defined(CUSH_CPU_ONLY)
+TEST_CASE("Profiled launches count the zero voxels of their input and exclude autotuning.", "[profile]") {
+  const uint3        dimensions {2, 2, 1};
+  const unsigned int coefficient_count = cush::coefficient_count(2);
+
+  // The first voxel is zero, the scales zero all of them in place.
+  std::vector<float> coefficients(4 * coefficient_count, 1.0F), scales(3, 0.0F);
+  std::fill(coefficients.begin(), coefficients.begin() + coefficient_count, 0.0F);
+  float* device_coefficients;
+  float* device_scales      ;
+  float* device_descriptors ;
+  cudaMalloc(reinterpret_cast<void**>(&device_coefficients), coefficients.size() * sizeof(float));
+  cudaMalloc(reinterpret_cast<void**>(&device_scales)      , scales      .size() * sizeof(float));
+  cudaMalloc(reinterpret_cast<void**>(&device_descriptors) , 4 * scales  .size() * sizeof(float));
+  cudaMemcpy(device_coefficients, coefficients.data(), coefficients.size() * sizeof(float), cudaMemcpyHostToDevice);
+  cudaMemcpy(device_scales      , scales      .data(), scales      .size() * sizeof(float), cudaMemcpyHostToDevice);
+
+  auto& report = cush::current_profile_report();
+  report.reset();
+  cush::launch_convolve_zonal(dimensions, coefficient_count, device_coefficients, device_scales, device_coefficients);
+  auto entries = report.entries();
+  REQUIRE(entries.size() == 1);
+  REQUIRE(entries[0].name        == "convolve_zonal");
+  REQUIRE(entries[0].zero_voxels == 1);
+  REQUIRE(entries[0].voxels      == 4);
+
+  // More launches than a chunk of the pool, of which those which autotune are not recorded.
+  auto policy = cush::current_launch_policy();
+  cush::set_launch_policy(cush::launch_policy::autotune);
+  report.reset();
+  for (auto launch = 0; launch < 100; launch++)
+    cush::launch_calculate_descriptors(dimensions, coefficient_count, device_coefficients, device_descriptors);
+  entries = report.entries();
+  REQUIRE(entries.size() == 1);
+  REQUIRE(entries[0].launches    == 99 );
+  REQUIRE(entries[0].zero_voxels == 396);
+  cush::set_launch_policy(policy);
+
+  cudaFree(device_descriptors );
+  cudaFree(device_scales      );
+  cudaFree(device_coefficients);
+}
+
+TEST_CASE("Profile report slots belong to the current device.", "[profile]") {
+  int device;
+  cudaGetDevice(&device);
+
+  cush::profile_report              report;
+  cush::profile_report::launch_slot slot;
+  REQUIRE(report.acquire(slot));
+  REQUIRE(slot.device == device);
+  report.add_pending("slot", slot, 0, 0, false, true);
+  REQUIRE(report.entries().empty());
+}
+#endif
@@ -0,0 +1,110 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include <cush/rotation.h>
+
+namespace
+{
+// Rotation by angle about the axis (1, 2, 3) / sqrt(14), by Rodrigues' formula.
+void axis_rotation(const double angle, double* rotation)
+{
+  const double axis[3] = {1 / sqrt(14.0), 2 / sqrt(14.0), 3 / sqrt(14.0)};
+  for (auto row = 0; row < 3; row++)
+    for (auto column = 0; column < 3; column++)
+    {
+      auto cross = row == column ? 0.0 : ((column - row + 3) % 3 == 1 ? -1.0 : 1.0) * axis[3 - row - column];
+      rotation[row * 3 + column] = (row == column ? cos(angle) : 0.0) + (1 - cos(angle)) * axis[row] * axis[column] + sin(angle) * cross;
+    }
+}
+}
+
+TEST_CASE("Rotation matrix blocks are computed.", "[rotation]") {
+  REQUIRE(cush::rotation_block_offset(0) ==   0);
+  REQUIRE(cush::rotation_block_offset(1) ==   1);
+  REQUIRE(cush::rotation_block_offset(2) ==  10);
+  REQUIRE(cush::rotation_matrix_size (8) == 969);
+  REQUIRE(cush::rotation_matrix_index(2, -2, -2) == 10);
+  REQUIRE(cush::rotation_matrix_index(2,  2,  2) == 34);
+
+  // rotate_voxels keeps two blocks of the maximum degree rather than the whole matrix.
+  REQUIRE(cush::rotate_voxels_shared_size<double>(31 * 31) == (10 + 2 * 61 * 61) * sizeof(double));
+  REQUIRE(cush::rotate_voxels_shared_size<double>(31 * 31) <  cush::rotation_matrix_size(30) * sizeof(double) / 5);
+}
+
+TEST_CASE("Rotated coefficients evaluate to the rotated function.", "[rotation]") {
+  double rotation[9];
+  axis_rotation(0.9, rotation);
+
+  double matrix[969];
+  cush::calculate_rotation_matrix(8, rotation, matrix);
+  for (auto l = 0; l <= 8; l++)
+    for (auto m = -l; m <= l; m++)
+      for (auto n = -l; n <= l; n++)
+      {
+        auto dot = 0.0;
+        for (auto k = -l; k <= l; k++)
+          dot += matrix[cush::rotation_matrix_index(l, m, k)] * matrix[cush::rotation_matrix_index(l, n, k)];
+        REQUIRE(dot == Approx(m == n ? 1.0 : 0.0).margin(1e-12));
+      }
+
+  double coefficients[81], rotated[81];
+  for (auto index = 0; index < 81; index++)
+    coefficients[index] = sin(1.3 * index);
+  cush::rotate(81, matrix, coefficients, rotated);
+
+  for (auto theta = 0.1; theta < 2 * M_PI; theta += 0.7)
+    for (auto phi = 0.2; phi < M_PI; phi += 0.5)
+    {
+      double point[3] = {sin(phi) * cos(theta), sin(phi) * sin(theta), cos(phi)}, inverse[3];
+      for (auto row = 0; row < 3; row++)
+        inverse[row] = rotation[row] * point[0] + rotation[3 + row] * point[1] + rotation[6 + row] * point[2];
+      REQUIRE(cush::evaluate_sum(8, theta, phi, rotated) == 
+              Approx(cush::evaluate_sum(8, atan2(inverse[1], inverse[0]), acos(inverse[2]), coefficients)));
+    }
+
+  double descriptor[9], rotated_descriptor[9];
+  cush::energy_descriptor(8, coefficients, descriptor        );
+  cush::energy_descriptor(8, rotated     , rotated_descriptor);
+  for (auto l = 0; l <= 8; l++)
+    REQUIRE(rotated_descriptor[l] == Approx(descriptor[l]));
+}
+
+#ifndef CUSH_CPU_ONLY
+TEST_CASE("Rotated voxels match the host rotation beyond the default shared memory of the whole matrix.", "[rotation]") {
+  // The whole matrix of max_l = 20 in double exceeds 48 KB of shared memory.
+  const unsigned int max_l = 20, coefficient_count = (max_l + 1) * (max_l + 1), voxel_count = 3;
+  REQUIRE(cush::rotation_matrix_size(max_l) * sizeof(double) > 48 * 1024);
+
+  std::vector<double> rotations(9 * voxel_count), coefficients(voxel_count * coefficient_count), expected(voxel_count * coefficient_count);
+  std::vector<double> matrix(cush::rotation_matrix_size(max_l));
+  for (auto voxel = 0u; voxel < voxel_count; voxel++)
+  {
+    axis_rotation(0.4 + 0.7 * voxel, rotations.data() + 9 * voxel);
+    for (auto index = 0u; index < coefficient_count; index++)
+      coefficients[voxel * coefficient_count + index] = sin(1.3 * index + voxel);
+    cush::calculate_rotation_matrix(max_l, rotations.data() + 9 * voxel, matrix.data());
+    cush::rotate(coefficient_count, matrix.data(), coefficients.data() + voxel * coefficient_count, expected.data() + voxel * coefficient_count);
+  }
+
+  double* device_rotations;
+  double* device_coefficients;
+  double* device_output;
+  cudaMalloc(reinterpret_cast<void**>(&device_rotations   ), rotations   .size() * sizeof(double));
+  cudaMalloc(reinterpret_cast<void**>(&device_coefficients), coefficients.size() * sizeof(double));
+  cudaMalloc(reinterpret_cast<void**>(&device_output      ), coefficients.size() * sizeof(double));
+  cudaMemcpy(device_rotations   , rotations   .data(), rotations   .size() * sizeof(double), cudaMemcpyHostToDevice);
+  cudaMemcpy(device_coefficients, coefficients.data(), coefficients.size() * sizeof(double), cudaMemcpyHostToDevice);
+
+  cush::launch_rotate_voxels(uint3 {voxel_count, 1, 1}, coefficient_count, device_rotations, device_coefficients, device_output);
+  std::vector<double> output(coefficients.size());
+  cudaMemcpy(output.data(), device_output, output.size() * sizeof(double), cudaMemcpyDeviceToHost);
+  for (auto index = 0u; index < output.size(); index++)
+    REQUIRE(output[index] == Approx(expected[index]).margin(1e-10));
+
+  cudaFree(device_output      );
+  cudaFree(device_coefficients);
+  cudaFree(device_rotations   );
+}
+#endif
@@ -1,5 +1,8 @@
 #include "catch.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include <cush/spherical_harmonics.h>
 
 TEST_CASE("Spherical harmonics coefficient counts are computed.", "[spherical_harmonics]") {
@@ -10,15 +13,211 @@ TEST_CASE("Spherical harmonics coefficient counts are computed.", "[spherical_ha
   REQUIRE(cush::coefficient_count(8) == 81);
 }
 
-// Computed by WolframAlpha: SphericalHarmonicY[l, m, theta, phi]
+TEST_CASE("Even degree coefficient counts and indices are computed.", "[spherical_harmonics]") {
+  REQUIRE(cush::even_coefficient_count(0) == 1);
+  REQUIRE(cush::even_coefficient_count(2) == 6);
+  REQUIRE(cush::even_coefficient_count(3) == 6);
+  REQUIRE(cush::even_coefficient_count(8) == 45);
+  REQUIRE(cush::even_coefficient_index(0,  0) == 0);
+  REQUIRE(cush::even_coefficient_index(2, -2) == 1);
+  REQUIRE(cush::even_coefficient_index(4, -4) == 6);
+  REQUIRE(cush::even_coefficient_index(8,  8) == 44);
+  REQUIRE(cush::matrix_column_count(81, false) == 81);
+  REQUIRE(cush::matrix_column_count(81, true ) == 45);
+}
+
+// Computed by WolframAlpha: SphericalHarmonicY[l, m, theta, phi], of which the real harmonics of m != 0 are sqrt(2) times
+// the real part.
 TEST_CASE("Spherical harmonics are computed.", "[spherical_harmonics]") {
-  REQUIRE(cush::evaluate(0, 0, M_PI / 2, M_PI / 2) == Approx( 0.2820947918));
-  REQUIRE(cush::evaluate(2, 0, M_PI / 2, M_PI / 2) == Approx(-0.3153915652));
-  REQUIRE(cush::evaluate(4, 2, M_PI / 2, M_PI / 2) == Approx( 0.3345232718));
-  REQUIRE(cush::evaluate(6, 6, M_PI / 2, M_PI / 2) == Approx(-0.4830841135));
-  REQUIRE(cush::evaluate(6, 5, M_PI / 2, M_PI / 2) == Approx( 0           ));
-  REQUIRE(cush::evaluate(6, 4, M_PI / 2, M_PI / 2) == Approx(-0.3567812628));
-  REQUIRE(cush::evaluate(8, 7, M_PI / 2, M_PI / 2) == Approx( 0           ));
-  REQUIRE(cush::evaluate(8, 6, M_PI / 2, M_PI / 2) == Approx( 0.3764161087));
-  REQUIRE(cush::evaluate(8, 5, M_PI / 2, M_PI / 2) == Approx( 0           ));
-}
\ No newline at end of file
+  REQUIRE(cush::evaluate(0, 0, M_PI / 2, M_PI / 2) == Approx(               0.2820947918));
+  REQUIRE(cush::evaluate(2, 0, M_PI / 2, M_PI / 2) == Approx(              -0.3153915652));
+  REQUIRE(cush::evaluate(4, 2, M_PI / 2, M_PI / 2) == Approx(std::sqrt(2) *  0.3345232718));
+  REQUIRE(cush::evaluate(6, 6, M_PI / 2, M_PI / 2) == Approx(std::sqrt(2) * -0.4830841135));
+  REQUIRE(cush::evaluate(6, 5, M_PI / 2, M_PI / 2) == Approx(               0           ).margin(1e-12));
+  REQUIRE(cush::evaluate(6, 4, M_PI / 2, M_PI / 2) == Approx(std::sqrt(2) * -0.3567812628));
+  REQUIRE(cush::evaluate(8, 7, M_PI / 2, M_PI / 2) == Approx(               0           ).margin(1e-12));
+  REQUIRE(cush::evaluate(8, 6, M_PI / 2, M_PI / 2) == Approx(std::sqrt(2) *  0.3764161087));
+  REQUIRE(cush::evaluate(8, 5, M_PI / 2, M_PI / 2) == Approx(               0           ).margin(1e-12));
+}
+TEST_CASE("Spherical harmonics are computed in a single pass.", "[spherical_harmonics]") {
+  double values[81];
+  for (auto theta = 0.0; theta < 2 * M_PI; theta += 0.4)
+    for (auto phi = 0.0; phi <= M_PI; phi += 0.3)
+    {
+      cush::evaluate_all(8, theta, phi, values);
+      for (auto index = 0; index < 81; index++)
+        REQUIRE(values[index] == Approx(cush::evaluate(index, theta, phi)));
+    }
+
+  float float_values[25];
+  cush::evaluate_all<float, 4>(0.3F, 0.7F, float_values);
+  for (auto index = 0; index < 25; index++)
+    REQUIRE(float_values[index] == Approx(cush::evaluate(index, 0.3F, 0.7F)).epsilon(1e-4));
+}
+
+// Pins the float error per degree: the recurrences accumulate about 4e-7 absolute error per degree.
+TEST_CASE("Float spherical harmonics are accurate per degree.", "[spherical_harmonics]") {
+  double worst_errors[9] {};
+  for (auto theta = 0.05F; theta < 2 * M_PI; theta += 0.1F)
+    for (auto phi = 0.0F; phi <= M_PI; phi += 0.05F)
+    {
+      double values      [81];
+      float  float_values[81];
+      cush::evaluate_all(8, double(theta), double(phi), values      );
+      cush::evaluate_all(8,        theta ,        phi , float_values);
+      for (auto index = 0; index < 81; index++)
+      {
+        auto& worst_error = worst_errors[cush::coefficient_lm(index).x];
+        worst_error = std::max(worst_error, std::abs(float_values[index] - values[index]));
+      }
+    }
+
+  for (auto l = 0; l <= 8; l++)
+    REQUIRE(worst_errors[l] < 4e-7 * (l + 1));
+}
+
+TEST_CASE("Fixed degree variants match the runtime degree variants.", "[spherical_harmonics]") {
+  float lhs[25], rhs[25];
+  for (auto index = 0; index < 25; index++)
+  {
+    lhs[index] = 0.1F * index;
+    rhs[index] = 1.0F - 0.05F * index;
+  }
+
+  REQUIRE(cush::evaluate_sum<4>(0.3F, 0.7F, lhs) == Approx(cush::evaluate_sum(4, 0.3F, 0.7F, lhs)));
+  REQUIRE(cush::l1_distance <4>(lhs, rhs)        == Approx(cush::l1_distance (25, lhs, rhs)));
+  REQUIRE(cush::l2_distance <4>(lhs, rhs)        == Approx(cush::l2_distance (25, lhs, rhs)));
+
+  auto fixed   = cush::evaluate_sum_derivatives<4>(0.3F, 0.7F, lhs);
+  auto runtime = cush::evaluate_sum_derivatives   (4, 0.3F, 0.7F, lhs);
+  REQUIRE(fixed.value       == Approx(runtime.value      ));
+  REQUIRE(fixed.theta       == Approx(runtime.theta      ));
+  REQUIRE(fixed.phi_phi     == Approx(runtime.phi_phi    ));
+  REQUIRE(fixed.theta_phi   == Approx(runtime.theta_phi  ));
+
+  float loaded[25];
+  cush::load_coefficients<4>(lhs, loaded);
+  REQUIRE(std::equal(lhs, lhs + 25, loaded));
+
+  auto dispatched = 0U;
+  REQUIRE( cush::dispatch_max_l(8, [&] (auto degree) { dispatched = decltype(degree)::value; }));
+  REQUIRE(!cush::dispatch_max_l(3, [&] (auto degree) { dispatched = decltype(degree)::value; }));
+  REQUIRE(dispatched == 8);
+}
+
+// The 16-bit types are the ones of the CUDA toolkit.
+#ifndef CUSH_CPU_ONLY
+TEST_CASE("16-bit coefficients are evaluated and compared in float.", "[spherical_harmonics]") {
+  float         coefficients         [25], rhs         [25];
+  __half        half_coefficients    [25], half_rhs    [25];
+  __nv_bfloat16 bfloat16_coefficients[25], bfloat16_rhs[25];
+  for (auto index = 0; index < 25; index++)
+  {
+    coefficients[index] = cush::convert<float>(cush::convert<__half>(0.1F * index));
+    rhs         [index] = cush::convert<float>(cush::convert<__half>(1.0F - 0.05F * index));
+    half_coefficients    [index] = cush::convert<__half       >(coefficients[index]);
+    half_rhs             [index] = cush::convert<__half       >(rhs         [index]);
+    bfloat16_coefficients[index] = cush::convert<__nv_bfloat16>(half_coefficients[index]);
+    bfloat16_rhs         [index] = cush::convert<__nv_bfloat16>(half_rhs         [index]);
+  }
+
+  REQUIRE(cush::evaluate_sum<4>(0.3F, 0.7F, half_coefficients)     == Approx(cush::evaluate_sum<4>(0.3F, 0.7F, coefficients)));
+  REQUIRE(cush::evaluate_sum<4>(0.3F, 0.7F, bfloat16_coefficients) == Approx(cush::evaluate_sum<4>(0.3F, 0.7F, coefficients)).epsilon(1e-2));
+  REQUIRE(cush::l2_distance<4>(half_coefficients, half_rhs)               == Approx(cush::l2_distance<4>(coefficients, rhs)));
+  REQUIRE(cush::l1_distance<4>(bfloat16_coefficients, bfloat16_rhs)       == Approx(cush::l1_distance<4>(coefficients, rhs)).epsilon(1e-2));
+}
+#endif
+
+TEST_CASE("Energy descriptors are invariant to rotations.", "[spherical_harmonics]") {
+  // Rotating by alpha about the z axis mixes the coefficients (l, m) and (l, -m) by the angle m alpha.
+  const auto alpha = 0.7;
+  double coefficients[81], rotated[81];
+  for (auto index = 0; index < 81; index++)
+    coefficients[index] = sin(1.3 * index);
+  for (auto l = 0; l <= 8; l++)
+  {
+    rotated[cush::coefficient_index(l, 0)] = coefficients[cush::coefficient_index(l, 0)];
+    for (auto m = 1; m <= l; m++)
+    {
+      auto cosine = coefficients[cush::coefficient_index(l, m)], sine = coefficients[cush::coefficient_index(l, -m)];
+      rotated[cush::coefficient_index(l,  m)] = cosine * cos(m * alpha) - sine * sin(m * alpha);
+      rotated[cush::coefficient_index(l, -m)] = cosine * sin(m * alpha) + sine * cos(m * alpha);
+    }
+  }
+  REQUIRE(cush::evaluate_sum(8, 1.1 + alpha, 0.4, rotated) == Approx(cush::evaluate_sum(8, 1.1, 0.4, coefficients)));
+
+  double descriptor[9], rotated_descriptor[9];
+  cush::energy_descriptor   (8, coefficients, descriptor        );
+  cush::energy_descriptor<8>(   rotated     , rotated_descriptor);
+  for (auto l = 0; l <= 8; l++)
+    REQUIRE(rotated_descriptor[l] == Approx(descriptor[l]));
+  REQUIRE(descriptor[0] == Approx(0.0));
+  REQUIRE(descriptor[1] == Approx(sqrt(pow(sin(1.3), 2) + pow(sin(2.6), 2) + pow(sin(3.9), 2))));
+}
+
+TEST_CASE("Zonal convolution scales match the convolution integral.", "[spherical_harmonics]") {
+  double coefficients[9], zonal_coefficients[3] = {0.8, 0.3, 0.5}, scales[3], convolved[9];
+  for (auto index = 0; index < 9; index++)
+    coefficients[index] = sin(1.3 * index + 0.2);
+  cush::zonal_convolution_scales(2, zonal_coefficients, scales);
+  for (auto index = 0; index < 9; index++)
+    convolved[index] = scales[cush::coefficient_lm(index).x] * coefficients[index];
+
+  // (f * h)(x) = integral of f(y) h(x . y) dy, with h(t) = sum_l h_l0 sqrt((2l + 1) / 4 pi) P_l(t).
+  const auto theta = 0.6, phi = 1.1;
+  const auto theta_steps = 200, phi_steps = 100;
+  const double point[3] = {sin(phi) * cos(theta), sin(phi) * sin(theta), cos(phi)};
+  auto integral = 0.0;
+  for (auto theta_index = 0; theta_index < theta_steps; theta_index++)
+    for (auto phi_index = 0; phi_index < phi_steps; phi_index++)
+    {
+      auto y_theta = 2 * M_PI * (theta_index + 0.5) / theta_steps;
+      auto y_phi   =     M_PI * (phi_index   + 0.5) / phi_steps  ;
+      auto t       = point[0] * sin(y_phi) * cos(y_theta) + point[1] * sin(y_phi) * sin(y_theta) + point[2] * cos(y_phi);
+      auto kernel  = 0.0;
+      for (auto l = 0; l <= 2; l++)
+        kernel += zonal_coefficients[l] * sqrt((2 * l + 1) / (4 * M_PI)) * cush::associated_legendre(l, 0, t);
+      integral += cush::evaluate_sum(2, y_theta, y_phi, coefficients) * kernel * sin(y_phi) * (2 * M_PI / theta_steps) * (M_PI / phi_steps);
+    }
+  REQUIRE(cush::evaluate_sum(2, theta, phi, convolved) == Approx(integral).epsilon(1e-3));
+}
+
+TEST_CASE("Spherical harmonics derivatives match finite differences.", "[spherical_harmonics]") {
+  double coefficients[81];
+  for (auto index = 0; index < 81; index++)
+    coefficients[index] = sin(1.3 * index);
+
+  const auto h = 1e-4;
+  for (auto theta = 0.1; theta < 2 * M_PI; theta += 0.7)
+    for (auto phi = 0.2; phi < M_PI; phi += 0.5)
+    {
+      auto sum         = [&] (double t, double p) { return cush::evaluate_sum(8, t, p, coefficients); };
+      auto derivatives = cush::evaluate_sum_derivatives(8, theta, phi, coefficients);
+      REQUIRE(derivatives.value       == Approx(sum(theta, phi)));
+      REQUIRE(derivatives.theta       == Approx((sum(theta + h, phi) - sum(theta - h, phi)) / (2 * h)).epsilon(1e-5));
+      REQUIRE(derivatives.phi         == Approx((sum(theta, phi + h) - sum(theta, phi - h)) / (2 * h)).epsilon(1e-5));
+      REQUIRE(derivatives.theta_theta == Approx((sum(theta + h, phi) - 2 * sum(theta, phi) + sum(theta - h, phi)) / (h * h)).epsilon(1e-3));
+      REQUIRE(derivatives.phi_phi     == Approx((sum(theta, phi + h) - 2 * sum(theta, phi) + sum(theta, phi - h)) / (h * h)).epsilon(1e-3));
+      REQUIRE(derivatives.theta_phi   == Approx((sum(theta + h, phi + h) - sum(theta + h, phi - h) - sum(theta - h, phi + h) + sum(theta - h, phi - h)) / (4 * h * h)).epsilon(1e-3));
+    }
+}
+
+TEST_CASE("Maxima are refined to the true peak.", "[spherical_harmonics]") {
+  // A degree 1 function is linear in the direction, c_1 Y_1^-1 + c_2 Y_1^0 + c_3 Y_1^1 peaks at (-c_3, -c_1, c_2).
+  double coefficients[4] = {0.0, 0.3, 0.5, -0.8};
+  auto   derivatives     = [&] (double theta, double phi) { return cush::evaluate_sum_derivatives(1, theta, phi, coefficients); };
+
+  double3 maximum {0.0, 0.7, 1.0};
+  cush::refine_maximum(maximum, 16, 0.2, 1e-9, derivatives);
+  auto norm = sqrt(0.3 * 0.3 + 0.5 * 0.5 + 0.8 * 0.8);
+  REQUIRE(sin(maximum.z) * cos(maximum.y) == Approx( 0.8 / norm));
+  REQUIRE(sin(maximum.z) * sin(maximum.y) == Approx(-0.3 / norm));
+  REQUIRE(cos(maximum.z)                  == Approx( 0.5 / norm));
+  REQUIRE(maximum.x                       == Approx(sqrt(3.0 / (4.0 * M_PI)) * norm));
+
+  // Peaks at the poles are reached from either side.
+  double  polar[4] = {0.0, 0.0, 1.0, 0.0};
+  double3 pole {0.0, 2.5, 0.3};
+  cush::refine_maximum(pole, 16, 0.2, 1e-9, [&] (double theta, double phi) { return cush::evaluate_sum_derivatives(1, theta, phi, polar); });
+  REQUIRE(pole.z == Approx(0.0).margin(1e-3));
+}
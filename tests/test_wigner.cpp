@@ -1,5 +1,9 @@
 #include "catch.hpp"
 
+#include <cmath>
+#include <vector>
+
+#include <cush/factorial.h>
 #include <cush/wigner.h>
 
 TEST_CASE("Wigner 3J coefficients are computed.", "[wigner]") {
@@ -7,3 +11,106 @@ TEST_CASE("Wigner 3J coefficients are computed.", "[wigner]") {
   REQUIRE(cush::wigner_3j<float>(12, 8, 4, 0, 0, 0) == Approx(0.186989f));
   REQUIRE(cush::wigner_3j<float>( 6, 4, 6, 0, 0, 0) == Approx(0.19518f ));
 }
+TEST_CASE("Float Wigner 3J coefficients match the double precision coefficients.", "[wigner]") {
+  for (auto l1 = 0; l1 <= 8; l1++)
+    for (auto l2 = 0; l2 <= 8; l2++)
+      for (auto l3 = std::abs(l1 - l2); l3 <= l1 + l2; l3++)
+        for (auto m1 = -l1; m1 <= l1; m1++)
+          for (auto m2 = -l2; m2 <= l2; m2++)
+            REQUIRE(cush::wigner_3j<float>(2 * l1, 2 * l2, 2 * l3, 2 * m1, 2 * m2, -2 * (m1 + m2)) == 
+                    Approx(cush::wigner_3j<double>(2 * l1, 2 * l2, 2 * l3, 2 * m1, 2 * m2, -2 * (m1 + m2))).margin(2e-6));
+}
+TEST_CASE("Recursive Wigner 3J coefficients match the Racah formula.", "[wigner]") {
+  // Including the half-integer symbols.
+  for (auto two_l1 = 0; two_l1 <= 9; two_l1++)
+    for (auto two_l2 = 0; two_l2 <= 9; two_l2++)
+      for (auto two_l3 = 0; two_l3 <= 18; two_l3++)
+        for (auto two_m1 = -two_l1; two_m1 <= two_l1; two_m1 += 2)
+          for (auto two_m2 = -two_l2; two_m2 <= two_l2; two_m2 += 2)
+            REQUIRE(cush::wigner_3j_recursive<double>(two_l1, two_l2, two_l3, two_m1, two_m2, -two_m1 - two_m2) == 
+                    Approx(cush::wigner_3j<double>(two_l1, two_l2, two_l3, two_m1, two_m2, -two_m1 - two_m2)).margin(1e-13));
+  REQUIRE(cush::wigner_3j_recursive<double>(4, 4, 4, 2, 0, 0) == 0.0);
+  REQUIRE(cush::wigner_3j_recursive<double>(2, 2, 2, 0, 0, 0) == 0.0);
+}
+TEST_CASE("Wigner 3J coefficients are accurate at high degrees.", "[wigner]") {
+  // The closed forms of (l1 l2 l3 0 0 0) and of (l1 l2 l1+l2 m1 m2 -m1-m2), in logarithms.
+  auto zero_m = [] (int l1, int l2, int l3)
+  {
+    auto g = (l1 + l2 + l3) / 2;
+    return (g % 2 ? -1 : 1) * std::exp(
+      0.5 * (cush::ln_factorial<double>(2 * g - 2 * l1) + cush::ln_factorial<double>(2 * g - 2 * l2) + cush::ln_factorial<double>(2 * g - 2 * l3) - cush::ln_factorial<double>(2 * g + 1)) +
+      cush::ln_factorial<double>(g) - cush::ln_factorial<double>(g - l1) - cush::ln_factorial<double>(g - l2) - cush::ln_factorial<double>(g - l3));
+  };
+  auto stretched = [] (int l1, int l2, int m1, int m2)
+  {
+    auto l = l1 + l2, m = m1 + m2;
+    return ((l1 - l2 + m) % 2 ? -1 : 1) * std::exp(0.5 * (
+      cush::ln_factorial<double>(2 * l1) + cush::ln_factorial<double>(2 * l2) + cush::ln_factorial<double>(l + m) + cush::ln_factorial<double>(l - m) - cush::ln_factorial<double>(2 * l + 1) -
+      cush::ln_factorial<double>(l1 + m1) - cush::ln_factorial<double>(l1 - m1) - cush::ln_factorial<double>(l2 + m2) - cush::ln_factorial<double>(l2 - m2)));
+  };
+  for (auto l1 : {21, 40, 64, 100})
+    for (auto l2 : {17, 64, 90})
+      for (auto l3 = std::abs(l1 - l2); l3 <= l1 + l2; l3 += 6)
+      {
+        if ((l1 + l2 + l3) % 2)
+          continue;
+        REQUIRE(cush::wigner_3j<double>(2 * l1, 2 * l2, 2 * l3, 0, 0, 0) == Approx(zero_m(l1, l2, l3)).epsilon(1e-10).margin(1e-14));
+        REQUIRE(cush::wigner_3j<float> (2 * l1, 2 * l2, 2 * l3, 0, 0, 0) == Approx(zero_m(l1, l2, l3)).epsilon(1e-3).margin(1e-6));
+      }
+  for (auto m1 : {-30, 0, 11, 40})
+    for (auto m2 : {-50, -7, 25})
+    {
+      REQUIRE(cush::wigner_3j<double>(80, 120, 200, 2 * m1, 2 * m2, -2 * (m1 + m2)) == Approx(stretched(40, 60, m1, m2)).epsilon(1e-10).margin(1e-14));
+      REQUIRE(cush::wigner_3j<float> (80, 120, 200, 2 * m1, 2 * m2, -2 * (m1 + m2)) == Approx(stretched(40, 60, m1, m2)).epsilon(1e-3).margin(1e-6));
+    }
+
+  // The orthogonality of the symbols of different l3 over (m1, m2).
+  const auto l1 = 40, l2 = 30, m3 = 5;
+  for (auto l3 : {15, 40, 69})
+    for (auto l3_other : {15, 41, 69})
+    {
+      double sum = 0.0;
+      for (auto m1 = -l1; m1 <= l1; m1++)
+        sum += (2 * l3 + 1) * 
+          cush::wigner_3j<double>(2 * l1, 2 * l2, 2 * l3      , 2 * m1, -2 * (m1 + m3), 2 * m3) *
+          cush::wigner_3j<double>(2 * l1, 2 * l2, 2 * l3_other, 2 * m1, -2 * (m1 + m3), 2 * m3);
+      REQUIRE(sum == Approx(l3 == l3_other ? 1.0 : 0.0).margin(1e-12));
+    }
+}
+TEST_CASE("Wigner 3J ranges match the single coefficients.", "[wigner]") {
+  REQUIRE(cush::wigner_3j_range_begin(4, 8, 2, 8) == 10);
+  REQUIRE(cush::wigner_3j_range_size (4, 8, 2, 8) == 2);
+  REQUIRE(cush::wigner_3j_range_size (8, 4, 2, -6) == 0);
+  REQUIRE(cush::wigner_3j_range_size (8, 4, 9, -1) == 0);
+
+  // Including the half-integer symbols.
+  std::vector<double> range(19);
+  for (auto two_l1 = 0; two_l1 <= 9; two_l1++)
+    for (auto two_l2 = 0; two_l2 <= 9; two_l2++)
+      for (auto two_m1 = -two_l1; two_m1 <= two_l1; two_m1 += 2)
+        for (auto two_m2 = -two_l2; two_m2 <= two_l2; two_m2 += 2)
+        {
+          const auto begin = cush::wigner_3j_range_begin(two_l1, two_l2, two_m1, two_m2);
+          const auto size  = cush::wigner_3j_range      (two_l1, two_l2, two_m1, two_m2, range.data());
+          REQUIRE(size == cush::wigner_3j_range_size(two_l1, two_l2, two_m1, two_m2));
+          for (auto index = 0; index < size; index++)
+            REQUIRE(range[index] == Approx(cush::wigner_3j<double>(two_l1, two_l2, begin + 2 * index, two_m1, two_m2, -two_m1 - two_m2)).margin(1e-13));
+        }
+
+  // At high degrees, against the recursion for a single symbol.
+  std::vector<double> high(106);
+  std::vector<float>  high_float(106);
+  for (auto m1 : {-60, -13, 0, 2, 45})
+    for (auto m2 : {-45, -9, 0, 30})
+    {
+      const auto begin = cush::wigner_3j_range_begin(120, 90, 2 * m1, 2 * m2);
+      const auto size  = cush::wigner_3j_range      (120, 90, 2 * m1, 2 * m2, high.data());
+      REQUIRE(cush::wigner_3j_range(120, 90, 2 * m1, 2 * m2, high_float.data()) == size);
+      for (auto index = 0; index < size; index++)
+      {
+        const auto expected = cush::wigner_3j_recursive<double>(120, 90, begin + 2 * index, 2 * m1, 2 * m2, -2 * (m1 + m2));
+        REQUIRE(high      [index] == Approx(expected).margin(1e-14));
+        REQUIRE(high_float[index] == Approx(expected).margin(1e-6 ));
+      }
+    }
+}
@@ -0,0 +1,47 @@
+#include "catch.hpp"
+
+#include <stdexcept>
+
+#ifndef CUSH_CPU_ONLY
+#include <cush/pipeline.h>
+#endif
+#include <cush/workspace.h>
+
+TEST_CASE("Workspace sizes are aligned.", "[workspace]") {
+  REQUIRE(cush::workspace_aligned_size(0)   == 0  );
+  REQUIRE(cush::workspace_aligned_size(1)   == 256);
+  REQUIRE(cush::workspace_aligned_size(256) == 256);
+  REQUIRE(cush::workspace_aligned_size(257) == 512);
+  REQUIRE(cush::workspace_size<double>(33)  == 512);
+  REQUIRE(cush::workspace_size<float >(64)  == 256);
+}
+
+#ifndef CUSH_CPU_ONLY
+TEST_CASE("Workspaces throw instead of exceeding their capacity.", "[workspace]") {
+  cush::workspace workspace(1000);
+  REQUIRE(workspace.capacity() == 1024);
+  {
+    cush::workspace_scope scope(workspace);
+    REQUIRE(workspace.allocate<float>(200) != nullptr);
+    REQUIRE(workspace.used() == 1024);
+    REQUIRE_THROWS_AS(workspace.allocate<float>(1), std::length_error);
+  }
+  REQUIRE(workspace.used() == 0);
+  REQUIRE(workspace.allocate<double>(128) != nullptr);
+}
+
+TEST_CASE("The pipeline workspace size covers its intermediates.", "[workspace]") {
+  const uint3        dimensions    {10, 10, 10};
+  const unsigned int max_l         = 8;
+  const uint2        tessellations {32, 16};
+  const auto         voxel_count   = dimensions.x * dimensions.y * dimensions.z;
+
+  // The allocations of a fit -> product -> sample -> extract_maxima stage, which exhaust the workspace.
+  cush::workspace workspace(cush::pipeline_workspace_size<float>(dimensions, max_l, tessellations));
+  REQUIRE_NOTHROW(workspace.allocate<float>(voxel_count * cush::coefficient_count(max_l)));
+  REQUIRE_NOTHROW(workspace.allocate<float>(voxel_count * cush::coefficient_count(max_l)));
+  REQUIRE_NOTHROW(workspace.allocate<float>(voxel_count * tessellations.x * tessellations.y));
+  REQUIRE(workspace.used() == workspace.capacity());
+  REQUIRE_THROWS_AS(workspace.allocate<float>(1), std::length_error);
+}
+#endif